@@ -0,0 +1,462 @@
+#include <iostream>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
+#include "mm/setmm.h"
+#include "mm/toolbox.h"
+#include "parsing/unif.h"
+#include "parsing/earley.h"
+#include "parsing/fingerprint.h"
+#include "utils/utils.h"
+#include "utils/parallel.h"
+
+static size_t per_second(size_t num, std::chrono::steady_clock::duration time) {
+    auto usecs = std::chrono::duration_cast< std::chrono::microseconds >(time).count();
+    return static_cast< size_t >(num * 1000000.0 / std::max< decltype(usecs) >(usecs, 1));
+}
+
+// Worst case benchmark of the LR parser, on the longest sentences of the library
+int lr_benchmark_main(int argc, char *argv[]) {
+    size_t sents_num = 100;
+    size_t reps = 10;
+    if (argc >= 2) {
+        sents_num = std::stoul(argv[1]);
+    }
+    if (argc >= 3) {
+        reps = std::stoul(argv[2]);
+    }
+
+    auto &data = get_set_mm();
+    auto &lib = data.lib;
+    auto &tb = data.tb;
+    const auto &parser = tb.get_parser();
+
+    std::vector< std::pair< size_t, LabTok > > sents;
+    for (LabTok label : tb.gen_labels()) {
+        sents.push_back(std::make_pair(lib.get_sentence(label).size(), label));
+    }
+    std::sort(sents.begin(), sents.end(), [](const auto &x, const auto &y) { return x.first > y.first; });
+    sents.resize(std::min(sents.size(), sents_num));
+
+    std::vector< std::pair< int64_t, LabTok > > times;
+    auto t = tic();
+    for (const auto &x : sents) {
+        const auto &sent = lib.get_sentence(x.second);
+        const SymTok type = tb.get_parsing_addendum().get_syntax().at(sent[0]);
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < reps; i++) {
+            auto pt = parser.parse(sent.begin()+1, sent.end(), type);
+            assert_or_throw< MMPPException >(pt.label != LabTok{}, "Failed to parse a sentence in the library");
+        }
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::make_pair(std::chrono::duration_cast< std::chrono::microseconds >(end - begin).count() / static_cast< int64_t >(reps), x.second));
+    }
+    std::cout << "Parsing the " << sents.size() << " longest sentences " << reps << " times" << std::endl;
+    toc(t, static_cast< int >(sents.size() * reps));
+
+    std::sort(times.begin(), times.end(), [](const auto &x, const auto &y) { return x.first > y.first; });
+    std::cout << "Slowest sentences:" << std::endl;
+    for (size_t i = 0; i < std::min(times.size(), size_t(10)); i++) {
+        std::cout << "  " << lib.resolve_label(times[i].second) << " (" << lib.get_sentence(times[i].second).size() << " symbols): " << times[i].first << " microseconds" << std::endl;
+    }
+
+    return 0;
+}
+static_block {
+    register_main_function("lr_benchmark", lr_benchmark_main);
+}
+
+// Compare the LR and the Earley parsers on the longest sentences of the library and on an ambiguous grammar
+int parsers_benchmark_main(int argc, char *argv[]) {
+    size_t sents_num = 100;
+    size_t terms_num = 12;
+    if (argc >= 2) {
+        sents_num = std::stoul(argv[1]);
+    }
+    if (argc >= 3) {
+        terms_num = std::stoul(argv[2]);
+    }
+
+    auto &data = get_set_mm();
+    auto &lib = data.lib;
+    auto &tb = data.tb;
+    const auto &ders = tb.get_derivations();
+
+    std::vector< std::pair< size_t, LabTok > > sents;
+    for (LabTok label : tb.gen_labels()) {
+        sents.push_back(std::make_pair(lib.get_sentence(label).size(), label));
+    }
+    std::sort(sents.begin(), sents.end(), [](const auto &x, const auto &y) { return x.first > y.first; });
+    sents.resize(std::min(sents.size(), sents_num));
+
+    std::function< std::ostream&(std::ostream&, SymTok) > sym_printer = [&](std::ostream &os, SymTok sym)->std::ostream& { return os << lib.resolve_symbol(sym); };
+    std::function< std::ostream&(std::ostream&, LabTok) > lab_printer = [&](std::ostream &os, LabTok lab)->std::ostream& { return os << lib.resolve_label(lab); };
+    LRParser< SymTok, LabTok > lr_parser(ders, sym_printer, lab_printer);
+    lr_parser.initialize();
+    EarleyParser< SymTok, LabTok > earley_parser(ders);
+    for (const Parser< SymTok, LabTok > *parser : std::vector< const Parser< SymTok, LabTok >* >({ &lr_parser, &earley_parser })) {
+        std::cout << (parser == &lr_parser ? "LR" : "Earley") << " parser on the " << sents.size() << " longest sentences" << std::endl;
+        auto t = tic();
+        for (const auto &x : sents) {
+            const auto &sent = lib.get_sentence(x.second);
+            auto pt = parser->parse(sent.begin()+1, sent.end(), tb.get_parsing_addendum().get_syntax().at(sent[0]));
+            assert_or_throw< MMPPException >(pt2_to_pt(tb.get_parsed_sent2(x.second)) == pt, "The parsers disagree on a sentence in the library");
+        }
+        toc(t, static_cast< int >(sents.size()));
+    }
+
+    // The grammar E -> E + E | n has a Catalan number of parsing trees for each sentence
+    std::unordered_map< std::string, std::vector< std::pair< size_t, std::vector< std::string > > > > amb_ders;
+    amb_ders["E"].push_back(std::make_pair(1, std::vector< std::string >({ "E", "+", "E" })));
+    amb_ders["E"].push_back(std::make_pair(2, std::vector< std::string >({ "n" })));
+    LRParser< std::string, size_t > amb_lr_parser(amb_ders);
+    amb_lr_parser.initialize();
+    EarleyParser< std::string, size_t > amb_earley_parser(amb_ders);
+    std::vector< std::string > sent = { "n" };
+    for (size_t i = 1; i < terms_num; i++) {
+        sent.push_back("+");
+        sent.push_back("n");
+    }
+    // Adding a final "+" makes the sentence invalid, so the whole search space must be explored
+    std::vector< std::string > bad_sent = sent;
+    bad_sent.push_back("+");
+    for (const Parser< std::string, size_t > *parser : std::vector< const Parser< std::string, size_t >* >({ &amb_lr_parser, &amb_earley_parser })) {
+        std::cout << (parser == &amb_lr_parser ? "LR" : "Earley") << " parser on an ambiguous sentence with " << terms_num << " terms" << std::endl;
+        auto t = tic();
+        auto pt = parser->parse(sent, "E");
+        toc(t, 1);
+        assert_or_throw< MMPPException >(pt.label != size_t{}, "Failed to parse a valid sentence");
+        std::cout << (parser == &amb_lr_parser ? "LR" : "Earley") << " parser on an invalid sentence with " << terms_num << " terms" << std::endl;
+        t = tic();
+        pt = parser->parse(bad_sent, "E");
+        toc(t, 1);
+        assert_or_throw< MMPPException >(pt.label == size_t{}, "Parsed an invalid sentence");
+    }
+
+    return 0;
+}
+static_block {
+    register_main_function("parsers_benchmark", parsers_benchmark_main);
+}
+
+/* Measure how many unification queries per second the toolbox can answer, using as queries the
+ * theorems of the library; the correctness of the results is checked by the tests in test_parsing.cpp */
+int unification_benchmark_main(int argc, char *argv[]) {
+    size_t queries_num = 1000;
+    size_t min_hyps_num = 5;
+    size_t threads_num = default_threads_num();
+    if (argc >= 2) {
+        queries_num = std::stoul(argv[1]);
+    }
+    if (argc >= 3) {
+        min_hyps_num = std::stoul(argv[2]);
+    }
+    if (argc >= 4) {
+        threads_num = std::stoul(argv[3]);
+    }
+
+    auto &data = get_set_mm();
+    auto &tb = data.tb;
+    const auto is_var = tb.get_standard_is_var_fast();
+
+    const auto queries = pick_unification_queries(tb, queries_num);
+    std::cout << "Running " << queries.size() << " queries on " << tb.get_theses_index().get_values_num() << " indexed theses (" << tb.get_theses_index().get_nodes_num() << " index nodes)" << std::endl;
+
+    size_t candidates_num = 0;
+    size_t linear_num = 0;
+    size_t indexed_num = 0;
+    std::chrono::steady_clock::duration linear_time{}, indexed_time{};
+    for (const auto &query : queries) {
+        const auto &pt = tb.get_parsed_sent2(query);
+        auto begin = std::chrono::steady_clock::now();
+        for (const Assertion &ass : tb.gen_assertions()) {
+            UnilateralUnificator< SymTok, LabTok, StandardIsVar > unif(is_var);
+            unif.add_parsing_trees2(tb.get_parsed_sent2(ass.get_thesis()), pt);
+            linear_num += unif.is_unifiable();
+        }
+        auto middle = std::chrono::steady_clock::now();
+        for (const auto &cand : tb.get_theses_index().retrieve(pt)) {
+            candidates_num++;
+            UnilateralUnificator< SymTok, LabTok, StandardIsVar > unif(is_var);
+            unif.add_parsing_trees2(tb.get_parsed_sent2(cand), pt);
+            indexed_num += unif.is_unifiable();
+        }
+        linear_time += middle - begin;
+        indexed_time += std::chrono::steady_clock::now() - middle;
+    }
+    std::cout << "The index returns " << candidates_num / std::max< size_t >(queries.size(), 1) << " candidates per query on average" << std::endl;
+    std::cout << "Linear scan of the unifiable theses: " << linear_num << " found, " << per_second(queries.size(), linear_time) << " queries per second" << std::endl;
+    std::cout << "Indexed retrieval of the unifiable theses: " << indexed_num << " found, " << per_second(queries.size(), indexed_time) << " queries per second" << std::endl;
+
+    for (bool just_first : { true, false }) {
+        for (size_t cur_threads_num : { static_cast< size_t >(1), threads_num }) {
+            tb.clear_unification_cache();
+            auto begin = std::chrono::steady_clock::now();
+            size_t results_num = 0;
+            for (const auto &label : queries) {
+                const auto query = make_unification_query(tb, tb.get_assertion(label));
+                results_num += tb.unify_assertion(query.hyps, query.thesis, just_first, true, {}, cur_threads_num).size();
+            }
+            std::cout << "unify_assertion with just_first=" << just_first << " on " << cur_threads_num << " threads" << ": " << results_num << " results, " << per_second(queries.size(), std::chrono::steady_clock::now() - begin) << " queries per second" << std::endl;
+        }
+    }
+
+    // The time until the first result is what an interactive client waits for
+    {
+        std::chrono::steady_clock::duration first_time{}, total_time{};
+        size_t first_num = 0;
+        for (const auto &label : queries) {
+            const auto query = make_unification_query(tb, tb.get_assertion(label));
+            bool first = true;
+            auto begin = std::chrono::steady_clock::now();
+            tb.unify_assertion_stream(query.hyps, query.thesis, [&](const auto&) {
+                if (first) {
+                    first_time += std::chrono::steady_clock::now() - begin;
+                    first_num++;
+                    first = false;
+                }
+                return true;
+            });
+            total_time += std::chrono::steady_clock::now() - begin;
+        }
+        auto first_usecs = std::chrono::duration_cast< std::chrono::microseconds >(first_time).count();
+        auto total_usecs = std::chrono::duration_cast< std::chrono::microseconds >(total_time).count();
+        std::cout << "unify_assertion_stream: first result after " << first_usecs / std::max< size_t >(first_num, 1) << " us on average, complete search in " << total_usecs / std::max< size_t >(queries.size(), 1) << " us on average" << std::endl;
+    }
+
+    // Queries that only differ by a renaming of their variables should be answered from the unification cache
+    tb.clear_unification_cache();
+    auto stats_before = tb.get_unification_cache_stats();
+    for (const auto &label : queries) {
+        const auto query = make_unification_query(tb, tb.get_assertion(label));
+        tb.unify_assertion(query.hyps, query.thesis, false, true);
+        tb.new_temp_var_frame();
+        std::unordered_map< SymTok, SymTok > sym_subst;
+        const auto renamed = rename_query_vars(tb, query, sym_subst);
+        tb.unify_assertion(renamed.hyps, renamed.thesis, false, true);
+        tb.release_temp_var_frame();
+    }
+    auto stats_after = tb.get_unification_cache_stats();
+    std::cout << "Renamed queries: " << stats_after.hits - stats_before.hits << " cache hits and " << stats_after.misses - stats_before.misses << " misses, " << stats_after.entries_num << " entries taking " << size_to_string(stats_after.size) << std::endl;
+
+    // Theorems with many hypotheses, passed in reverse order, stress the search for the right permutation
+    const auto hyps_queries = pick_unification_queries(tb, queries_num, min_hyps_num);
+    std::cout << "Running " << hyps_queries.size() << " queries on theorems with at least " << min_hyps_num << " hypotheses" << std::endl;
+    if (!hyps_queries.empty()) {
+        tb.clear_unification_cache();
+        auto begin = std::chrono::steady_clock::now();
+        size_t results_num = 0;
+        for (const auto &label : hyps_queries) {
+            const auto query = make_unification_query(tb, tb.get_assertion(label), true);
+            results_num += tb.unify_assertion(query.hyps, query.thesis, false, true).size();
+        }
+        auto time = std::chrono::steady_clock::now() - begin;
+
+        // Check how many of the hypotheses that do not unify are already rejected by their fingerprints
+        size_t pairs_num = 0, failing_num = 0, rejected_num = 0;
+        for (const auto &label : hyps_queries) {
+            const Assertion &ass = tb.get_assertion(label);
+            for (const auto &cand : tb.get_theses_index().retrieve(tb.get_parsed_sent2(label))) {
+                const Assertion &cand_ass = tb.get_assertion(cand);
+                if (cand_ass.get_ess_hyps().size() != ass.get_ess_hyps().size()) {
+                    continue;
+                }
+                for (const auto &hyp : ass.get_ess_hyps()) {
+                    const auto hyp_fp = make_target_fingerprint(tb.get_parsed_sent2(hyp));
+                    for (const auto &cand_hyp : cand_ass.get_ess_hyps()) {
+                        UnilateralUnificator< SymTok, LabTok, StandardIsVar > unif(is_var);
+                        unif.add_parsing_trees2(tb.get_parsed_sent2(cand_hyp), tb.get_parsed_sent2(hyp));
+                        pairs_num++;
+                        failing_num += !unif.is_unifiable();
+                        rejected_num += !fingerprints_compatible(tb.get_fingerprint(cand_hyp), hyp_fp);
+                    }
+                }
+            }
+        }
+        std::cout << "Hypotheses pairs: " << pairs_num << ", of which " << failing_num << " do not unify; fingerprints reject " << rejected_num << " of them (" << (failing_num == 0 ? 0 : rejected_num * 100 / failing_num) << "%)" << std::endl;
+        std::cout << "unify_assertion with permuted hypotheses: " << results_num << " results, " << per_second(hyps_queries.size(), time) << " queries per second" << std::endl;
+    }
+
+    return 0;
+}
+static_block {
+    register_main_function("unification_benchmark", unification_benchmark_main);
+}
+
+/* Compare the two ways of trying alternative branches on a BilateralUnificator: copying it or
+ * rolling it back to a mark */
+int unificator_trail_benchmark_main(int argc, char *argv[]) {
+    size_t queries_num = 100;
+    size_t base_size = 10;
+    if (argc >= 2) {
+        queries_num = std::stoul(argv[1]);
+    }
+    if (argc >= 3) {
+        // The first assertion is the one whose thesis is branched on
+        base_size = std::max< size_t >(1, std::stoul(argv[2]));
+    }
+
+    auto &data = get_set_mm();
+    auto &tb = data.tb;
+    const auto &is_var = tb.get_standard_is_var();
+
+    std::vector< LabTok > theses;
+    for (const Assertion &ass : tb.gen_assertions()) {
+        if (tb.get_sentence(ass.get_thesis()).at(0) == tb.get_turnstile()) {
+            theses.push_back(ass.get_thesis());
+        }
+    }
+    std::vector< LabTok > queries;
+    for (size_t i = 0; i < std::min(queries_num, theses.size()); i++) {
+        queries.push_back(theses[i * theses.size() / std::min(queries_num, theses.size())]);
+    }
+    std::cout << "Branching " << queries.size() << " unificators built from " << base_size << " assertions over " << theses.size() << " theses" << std::endl;
+
+    /* Each query is a unificator that already matched fresh copies of base_size assertions with
+     * the assertions themselves; from there every thesis of the library is tried as an alternative
+     * for the first one, either on a copy of the unificator or on the unificator itself, rolling
+     * back afterwards */
+    std::vector< size_t > successes;
+    for (bool use_trail : { false, true }) {
+        size_t success_num = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (const auto &query : queries) {
+            tb.new_temp_var_frame();
+            BilateralUnificator< SymTok, LabTok > unif(is_var);
+            ParsingTree2< SymTok, LabTok > thesis;
+            size_t query_idx = std::find(theses.begin(), theses.end(), query) - theses.begin();
+            for (size_t j = 0; j < base_size; j++) {
+                const Assertion &ass = tb.get_assertion(theses[(query_idx + j) % theses.size()]);
+                ParsingTree2< SymTok, LabTok > base_thesis;
+                std::vector< ParsingTree2< SymTok, LabTok > > hyps;
+                std::tie(hyps, base_thesis) = tb.refresh_assertion2(ass);
+                for (size_t i = 0; i < hyps.size(); i++) {
+                    unif.add_parsing_trees2(hyps[i], tb.get_parsed_sent2(ass.get_ess_hyps()[i]));
+                }
+                if (j == 0) {
+                    thesis = base_thesis;
+                } else {
+                    unif.add_parsing_trees2(base_thesis, tb.get_parsed_sent2(ass.get_thesis()));
+                }
+            }
+            for (const auto &other : theses) {
+                if (use_trail) {
+                    auto mark = unif.mark();
+                    unif.add_parsing_trees2(thesis, tb.get_parsed_sent2(other));
+                    success_num += unif.is_unifiable();
+                    unif.undo_to(mark);
+                } else {
+                    auto unif2 = unif;
+                    unif2.add_parsing_trees2(thesis, tb.get_parsed_sent2(other));
+                    success_num += unif2.is_unifiable();
+                }
+            }
+            tb.release_temp_var_frame();
+        }
+        auto usecs = std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - begin).count();
+        successes.push_back(success_num);
+        std::cout << (use_trail ? "Rolling back to a mark" : "Copying the unificator") << ": " << success_num << " successful branches, " << static_cast< size_t >(queries.size() * theses.size() * 1000000.0 / std::max< decltype(usecs) >(usecs, 1)) << " branches per second" << std::endl;
+    }
+    assert_or_throw< MMPPException >(successes[0] == successes[1], "Copying and rolling back disagree");
+
+    return 0;
+}
+static_block {
+    register_main_function("unificator_trail_benchmark", unificator_trail_benchmark_main);
+}
+
+/* Compare substitute2() with the std::function variable predicate and with the inlined one, on
+ * large trees built from the largest theses of the library */
+int substitute_benchmark_main(int argc, char *argv[]) {
+    size_t trees_num = 100;
+    size_t rounds = 100;
+    if (argc >= 2) {
+        trees_num = std::stoul(argv[1]);
+    }
+    if (argc >= 3) {
+        rounds = std::stoul(argv[2]);
+    }
+
+    auto &data = get_set_mm();
+    auto &tb = data.tb;
+    const auto &is_var = tb.get_standard_is_var();
+    const auto is_var_fast = tb.get_standard_is_var_fast();
+
+    std::vector< LabTok > theses;
+    for (const Assertion &ass : tb.gen_assertions()) {
+        if (tb.get_sentence(ass.get_thesis()).at(0) == tb.get_turnstile()) {
+            theses.push_back(ass.get_thesis());
+        }
+    }
+    std::sort(theses.begin(), theses.end(), [&tb](LabTok x, LabTok y) {
+        return tb.get_parsed_sent2(x).get_nodes_len() > tb.get_parsed_sent2(y).get_nodes_len();
+    });
+    theses.resize(std::min(trees_num, theses.size()));
+
+    /* Each of the largest theses is made larger by replacing each of its variables with the
+     * thesis itself; then its variables are renamed with a rotation, so that the time goes
+     * in visiting the tree rather than in copying large substituted subtrees */
+    std::vector< std::pair< ParsingTree2< SymTok, LabTok >, SubstMap2< SymTok, LabTok > > > cases;
+    size_t nodes_num = 0;
+    for (const auto &thesis : theses) {
+        const auto &pt = tb.get_parsed_sent2(thesis);
+        std::set< LabTok > vars;
+        collect_variables2(pt, is_var, vars);
+        SubstMap2< SymTok, LabTok > grow;
+        SubstMap2< SymTok, LabTok > rename;
+        for (auto it = vars.begin(); it != vars.end(); it++) {
+            auto next = std::next(it) == vars.end() ? vars.begin() : std::next(it);
+            grow[*it] = pt;
+            ParsingTree2Generator< SymTok, LabTok > gen;
+            gen.open_node(*next, tb.get_var_lab_to_type_sym(*next));
+            gen.close_node();
+            rename[*it] = gen.get_parsing_tree();
+        }
+        cases.emplace_back(substitute2(pt, is_var, grow), rename);
+        nodes_num += cases.back().first.get_nodes_len();
+    }
+    // The first label past the library is a temporary variable for both predicates
+    for (size_t i = 1; i <= tb.get_labels_num() + 1; i++) {
+        const LabTok label(static_cast< LabTok::val_type >(i));
+        bool slow;
+        try {
+            slow = is_var(label);
+        } catch (const std::out_of_range&) {
+            throw MMPPException("The std::function predicate does not know label " + std::to_string(i) + ", which the inlined functor classifies as " + (is_var_fast(label) ? "a variable" : "not a variable"));
+        }
+        assert_or_throw< MMPPException >(slow == is_var_fast(label), "The two predicates disagree on label " + std::to_string(i));
+    }
+    std::cout << "Substituting in " << cases.size() << " trees with " << nodes_num << " nodes in total, " << rounds << " times" << std::endl;
+
+    std::vector< size_t > checksums;
+    auto run = [&](const auto &pred, const std::string &name) {
+        size_t checksum = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t round = 0; round < rounds; round++) {
+            for (const auto &c : cases) {
+                const auto res = substitute2(c.first, pred, c.second);
+                checksum += res.get_nodes_len() + res.get_nodes()[0].label.val();
+            }
+        }
+        auto usecs = std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - begin).count();
+        checksums.push_back(checksum);
+        std::cout << name << ": " << static_cast< size_t >(nodes_num * rounds / std::max< double >(usecs, 1.0)) << " million nodes per second" << std::endl;
+    };
+    run(is_var, "std::function");
+    run(is_var_fast, "Inlined functor");
+    assert_or_throw< MMPPException >(checksums[0] == checksums[1], "The two predicates disagree");
+    for (const auto &c : cases) {
+        assert_or_throw< MMPPException >(substitute2(c.first, is_var, c.second) == substitute2(c.first, is_var_fast, c.second), "The two predicates disagree");
+    }
+
+    return 0;
+}
+static_block {
+    register_main_function("substitute_benchmark", substitute_benchmark_main);
+}
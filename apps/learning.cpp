@@ -8,6 +8,7 @@
 #include "mm/setmm.h"
 #include "mm/toolbox.h"
 #include "mm/proof.h"
+#include "mm/proofstats.h"
 #include "parsing/unif.h"
 #include "utils/utils.h"
 
@@ -110,18 +111,6 @@ struct StepProof {
 
 std::unordered_map< StepContext, StepProof, boost::hash< StepContext > > mega_map;
 
-void proof_stat_unwind_tree(const ProofTree< Sentence > &pt, const Assertion &ass, ProofStat &stat) {
-    if (pt.essential) {
-        stat.ess_proof_size++;
-        if (find(ass.get_ess_hyps().begin(), ass.get_ess_hyps().end(), pt.label) != ass.get_ess_hyps().end()) {
-            stat.ess_hyp_steps++;
-        }
-    }
-    for (const auto &child : pt.children) {
-        proof_stat_unwind_tree(child, ass, stat);
-    }
-}
-
 int proofs_stats_main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -130,30 +119,18 @@ int proofs_stats_main(int argc, char *argv[]) {
     auto &lib = data.lib;
     //auto &tb = data.tb;
 
-    TextProgressBar tpb(100, (double) lib.get_assertions().size());
+    // Statistics are computed on the compressed proofs; uncompressed proofs are compressed first
+    auto t = tic();
     std::vector< std::pair< LabTok, ProofStat > > proofs_stats;
-    for (const Assertion &ass : lib.get_assertions()) {
-        if (!ass.is_valid()) {
-            continue;
-        }
-        if (!ass.is_theorem()) {
-            continue;
-        }
-        if (!ass.has_proof()) {
-            continue;
-        }
-        auto proof = ass.get_proof_operator(lib)->compress();
-        auto exec = proof.get_executor< Sentence >(lib, ass, true);
-        exec->execute();
-
+    for (const auto &x : compute_all_proof_stats(lib)) {
         ProofStat stat;
-        //stat.proof_size = proof.get_labels().size();
-        stat.ess_hyp_num = ass.get_ess_hyps().size();
-        proof_stat_unwind_tree(exec->get_proof_tree(), ass, stat);
-        proofs_stats.push_back(std::make_pair(ass.get_thesis(), stat));
-        tpb.report(ass.get_thesis().val());
+        stat.proof_size = x.second.steps_num;
+        stat.ess_proof_size = x.second.ess_steps_num;
+        stat.ess_hyp_num = lib.get_assertion(x.first).get_ess_hyps().size();
+        stat.ess_hyp_steps = x.second.ess_hyp_steps;
+        proofs_stats.push_back(std::make_pair(x.first, stat));
     }
-    tpb.finished();
+    toc(t, 1);
 
     sort(proofs_stats.begin(), proofs_stats.end(), [](const auto &x, const auto &y) {
         return (x.second.ess_proof_size - x.second.ess_hyp_steps) < (y.second.ess_proof_size - y.second.ess_hyp_steps);
@@ -169,7 +146,7 @@ static_block {
     register_main_function("proofs_stats", proofs_stats_main);
 }
 
-void gen_theorems(const BilateralUnificator< SymTok, LabTok > &unif,
+void gen_theorems(BilateralUnificator< SymTok, LabTok > &unif,
                   const std::vector< ParsingTree2< SymTok, LabTok > > &open_hyps,
                   const std::vector< LabTok > &steps,
                   size_t hyps_pos,
@@ -178,18 +155,20 @@ void gen_theorems(const BilateralUnificator< SymTok, LabTok > &unif,
                   LibraryToolbox &tb,
                   size_t depth,
                   const std::function< void(const ParsingTree2< SymTok, LabTok >&, const std::vector< ParsingTree2< SymTok, LabTok > >&, const std::vector< LabTok >&, LibraryToolbox&)> &callback) {
+    // The unificator is shared along the search: each branch rolls back its changes before returning
     if (depth == 0 || hyps_pos == open_hyps.size()) {
-        auto unif2 = unif;
+        auto mark = unif.mark();
         SubstMap2< SymTok, LabTok > subst;
         bool res;
-        tie(res, subst) = unif2.unify2();
+        tie(res, subst) = unif.unify2();
+        unif.undo_to(mark);
         if (!res) {
             return;
         }
-        auto thesis = substitute2(final_thesis, tb.get_standard_is_var(), subst);
+        auto thesis = substitute2(final_thesis, tb.get_standard_is_var_fast(), subst);
         std::vector< ParsingTree2< SymTok, LabTok > > hyps;
         for (const auto &hyp : open_hyps) {
-            hyps.push_back(substitute2(hyp, tb.get_standard_is_var(), subst));
+            hyps.push_back(substitute2(hyp, tb.get_standard_is_var_fast(), subst));
         }
         callback(thesis, hyps, steps, tb);
     } else {
@@ -200,17 +179,18 @@ void gen_theorems(const BilateralUnificator< SymTok, LabTok > &unif,
             ParsingTree2< SymTok, LabTok > thesis;
             std::vector< ParsingTree2< SymTok, LabTok > > hyps;
             tie(hyps, thesis) = tb.refresh_assertion2(ass);
-            auto unif2 = unif;
+            auto mark = unif.mark();
             auto steps2 = steps;
-            unif2.add_parsing_trees2(open_hyps[hyps_pos], thesis);
+            unif.add_parsing_trees2(open_hyps[hyps_pos], thesis);
             steps2.push_back(ass.get_thesis());
-            if (unif2.is_unifiable()) {
+            if (unif.is_unifiable()) {
                 //std::cout << "Attaching " << tb.resolve_label(ass.get_thesis()) << " in position " << hyps_pos << std::endl;
                 auto open_hyps2 = open_hyps;
                 open_hyps2.erase(open_hyps2.begin() + hyps_pos);
                 open_hyps2.insert(open_hyps2.end(), hyps.begin(), hyps.end());
-                gen_theorems(unif2, open_hyps2, steps2, hyps_pos, useful_asses, final_thesis, tb, depth-1, callback);
+                gen_theorems(unif, open_hyps2, steps2, hyps_pos, useful_asses, final_thesis, tb, depth-1, callback);
             }
+            unif.undo_to(mark);
             tb.release_temp_var_frame();
         }
     }
@@ -245,7 +225,7 @@ int gen_random_theorems_main(int argc, char *argv[]) {
     auto &data = get_set_mm();
     auto &lib = data.lib;
     auto &tb = data.tb;
-    auto standard_is_var = tb.get_standard_is_var();
+    auto standard_is_var = tb.get_standard_is_var_fast();
 
     //string target_label_str(argv[1]);
     //LabTok target_label = lib.get_label(target_label_str);
@@ -320,15 +300,15 @@ int gen_random_theorems_main(int argc, char *argv[]) {
             ParsingTree2< SymTok, LabTok > thesis;
             std::vector< ParsingTree2< SymTok, LabTok > > hyps;
             tie(hyps, thesis) = tb.refresh_assertion2(ass);
-            auto unif2 = unif;
-            unif2.add_parsing_trees2(open_hyps[hyp_idx], thesis);
-            if (unif2.unify2().first) {
+            auto mark = unif.mark();
+            unif.add_parsing_trees2(open_hyps[hyp_idx], thesis);
+            if (unif.unify2().first) {
                 std::cout << "Attaching " << tb.resolve_label(ass.get_thesis()) << " in position " << hyp_idx << std::endl;
-                unif = unif2;
                 open_hyps.erase(open_hyps.begin() + hyp_idx);
                 open_hyps.insert(open_hyps.end(), hyps.begin(), hyps.end());
                 break;
             }
+            unif.undo_to(mark);
         }
     }
 
@@ -338,10 +318,10 @@ int gen_random_theorems_main(int argc, char *argv[]) {
 
     if (res) {
         std::cout << "Unification succedeed and proved:" << std::endl;
-        std::cout << tb.print_sentence(substitute2(final_thesis, tb.get_standard_is_var(), subst)) << std::endl;
+        std::cout << tb.print_sentence(substitute2(final_thesis, tb.get_standard_is_var_fast(), subst)) << std::endl;
         std::cout << "with the hypotheses:" << std::endl;
         for (const auto &hyp : open_hyps) {
-            std::cout << " * " << tb.print_sentence(substitute2(hyp, tb.get_standard_is_var(), subst)) << std::endl;
+            std::cout << " * " << tb.print_sentence(substitute2(hyp, tb.get_standard_is_var_fast(), subst)) << std::endl;
         }
     } else {
         std::cout << "Unification failed" << std::endl;
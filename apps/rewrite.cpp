@@ -0,0 +1,55 @@
+
+#include <string>
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+#include "platform.h"
+#include "utils/utils.h"
+#include "mm/reader.h"
+#include "mm/writer.h"
+#include "mm/proof.h"
+
+int rewrite_main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: rewrite <input> <output> [compress|uncompress]" << std::endl;
+        return 1;
+    }
+    std::string mode = argc == 4 ? argv[3] : "";
+    if (mode != "" && mode != "compress" && mode != "uncompress") {
+        std::cerr << "Unknown mode " << mode << std::endl;
+        return 1;
+    }
+
+    std::cout << "Reading database from file " << argv[1] << "..." << std::endl;
+    FileTokenizer ft(boost::filesystem::path(argv[1]), nullptr, true);
+    Reader p(ft, false, true, true);
+    p.run();
+    LibraryImpl lib = p.get_library();
+
+    if (mode != "") {
+        std::cout << "Rewriting all proofs..." << std::endl;
+        for (const auto &ass : lib.get_assertions()) {
+            if (ass.is_valid() && ass.is_theorem() && ass.get_proof() != nullptr) {
+                std::shared_ptr< const Proof > proof;
+                if (mode == "compress") {
+                    proof = std::make_shared< CompressedProof >(ass.get_proof_operator(lib)->compress());
+                } else {
+                    proof = std::make_shared< UncompressedProof >(ass.get_proof_operator(lib)->uncompress());
+                }
+                lib.set_proof(ass.get_thesis(), proof);
+            }
+        }
+    }
+
+    std::cout << "Writing database to file " << argv[2] << "..." << std::endl;
+    auto t = tic();
+    Writer writer(lib);
+    writer.write(boost::filesystem::path(argv[2]));
+    toc(t, 1);
+
+    return 0;
+}
+static_block {
+    register_main_function("rewrite", rewrite_main);
+}
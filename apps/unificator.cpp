@@ -26,6 +26,27 @@ void unification_loop() {
             line = line.substr(dollar_pos+1);
         }
         std::vector< SymTok > sent = tb.read_sentence(line);
+
+        // Parse all the sentences in one batch, so that parsing errors are reported and the trees are cached for the unification
+        std::vector< std::pair< Sentence, SymTok > > to_parse;
+        for (const auto &x : hypotheses) {
+            to_parse.push_back(std::make_pair(Sentence(x.begin() + (x.empty() ? 0 : 1), x.end()), tb.get_turnstile_alias()));
+        }
+        to_parse.push_back(std::make_pair(Sentence(sent.begin() + (sent.empty() ? 0 : 1), sent.end()), tb.get_turnstile_alias()));
+        bool parsed = true;
+        tb.parse_sentences(to_parse, [&](size_t idx, const ParsingTree2< SymTok, LabTok > &pt) {
+            if (pt.get_nodes_len() == 0) {
+                if (idx < hypotheses.size()) {
+                    std::cout << "Could not parse hypothesis " << idx+1 << std::endl;
+                } else {
+                    std::cout << "Could not parse thesis" << std::endl;
+                }
+                parsed = false;
+            }
+        });
+        if (!parsed) {
+            continue;
+        }
         /*auto sent_wff = sent;
         sent_wff[0] = lib.get_symbol("wff");
         auto res = lib.prove_type(sent_wff);
@@ -34,7 +55,7 @@ void unification_loop() {
             cout << " " << lib.resolve_label(label);
         }
         cout << endl;*/
-        auto res2 = tb.unify_assertion(hypotheses, sent);
+        auto res2 = tb.unify_assertion(hypotheses, sent, true, true, {}, 0);
         std::cout << "Found " << res2.size() << " matching assertions:" << std::endl;
         for (auto &match : res2) {
             auto &label = std::get<0>(match);
@@ -10,6 +10,8 @@
 #include "utils/utils.h"
 #include "mm/reader.h"
 #include "mm/proof.h"
+#include "mm/toolbox.h"
+#include "mm/treeverifier.h"
 
 bool verify_database(boost::filesystem::path filename, bool advanced_tests) {
     bool success = true;
@@ -183,3 +185,57 @@ static_block {
     register_main_function("verify_all", test_all_main);
 }
 
+
+int verify_trees_main(int argc, char *argv[]) {
+    if (argc != 2 && argc != 3) {
+        std::cerr << "Usage: verify_trees <file> [turnstile]" << std::endl;
+        return 1;
+    }
+    boost::filesystem::path filename(argv[1]);
+    std::string turnstile = argc == 3 ? argv[2] : "|-";
+    FileTokenizer ft(filename);
+    Reader p(ft, false, true);
+    std::cout << "Reading library..." << std::endl;
+    p.run();
+    LibraryImpl lib = p.get_library();
+    std::cout << "Library has " << lib.get_symbols_num() << " symbols and " << lib.get_labels_num() << " labels" << std::endl;
+
+    std::shared_ptr< ToolboxCache > cache = std::make_shared< FileToolboxCache >(filename.string() + ".cache");
+    LibraryToolbox tb(lib, turnstile, cache);
+
+    std::cout << "Executing all proofs on sentences..." << std::endl;
+    size_t sent_failures = 0;
+    auto t = tic();
+    for (const auto &ass : lib.get_assertions()) {
+        if (ass.is_valid() && ass.is_theorem() && ass.get_proof() != nullptr) {
+            try {
+                ass.get_proof_executor< Sentence >(lib)->execute();
+            } catch (const ProofException< Sentence >&) {
+                sent_failures++;
+            } catch (const MMPPException&) {
+                sent_failures++;
+            }
+        }
+    }
+    toc(t, 1);
+
+    std::cout << "Executing all proofs on parsing trees..." << std::endl;
+    TreeVerifier verifier(tb);
+    t = tic();
+    auto failures = verifier.verify_all(1);
+    toc(t, 1);
+
+    std::cout << "Executing all proofs on parsing trees, in parallel..." << std::endl;
+    t = tic();
+    verifier.verify_all();
+    toc(t, 1);
+
+    for (const auto &failure : failures) {
+        std::cout << "Proof of " << lib.resolve_label(failure.first) << " failed: " << failure.second << std::endl;
+    }
+    std::cout << sent_failures << " proofs failed on sentences and " << failures.size() << " on parsing trees" << std::endl;
+    return (sent_failures == 0 && failures.empty()) ? 0 : 1;
+}
+static_block {
+    register_main_function("verify_trees", verify_trees_main);
+}
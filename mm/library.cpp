@@ -216,7 +216,23 @@ LabTok Assertion::get_mand_hyp(size_t i) const
 
 std::shared_ptr<ProofOperator> Assertion::get_proof_operator(const Library &lib) const
 {
-    return this->proof->get_operator(lib, *this);
+    return this->get_proof()->get_operator(lib, *this);
+}
+
+std::shared_ptr<const Proof> Assertion::get_proof() const
+{
+    if (this->lazy_proof != nullptr) {
+        return this->lazy_proof->get_proof();
+    }
+    return this->proof;
+}
+
+std::shared_ptr<const Proof> Assertion::decode_proof() const
+{
+    if (this->lazy_proof != nullptr) {
+        return this->lazy_proof->decode();
+    }
+    return this->proof;
 }
 
 const StackFrame &LibraryImpl::get_final_stack_frame() const
@@ -290,6 +306,23 @@ void LibraryImpl::set_parsing_addendum(const ParsingAddendumImpl &add)
     this->parsing_addendum = add;
 }
 
+void LibraryImpl::set_proof(LabTok label, std::shared_ptr< const Proof > proof)
+{
+    Assertion &ass = this->assertions.at(label.val());
+    assert_or_throw< MMPPException >(ass.is_valid() && ass.is_theorem(), "Cannot set the proof of something that is not a theorem");
+    ass.set_proof(proof);
+}
+
+const std::vector< LayoutItem > &LibraryImpl::get_layout() const
+{
+    return this->layout;
+}
+
+void LibraryImpl::add_layout_item(LayoutItem &&item)
+{
+    this->layout.push_back(std::move(item));
+}
+
 bool Library::is_immutable() const
 {
     return false;
@@ -28,6 +28,31 @@ struct StackFrame {
     std::vector< LabTok > hyps;
 };
 
+/* The layout of a database as it was found in its source file, so that it can be
+ * written back by Writer. Every item is a sequence of tokens; the whitespace that precedes
+ * each of them is recorded only when it is different from a single space. Statement contents
+ * are not stored here, since they are found in the library; only the symbols of $c, $v and $d
+ * statements, which the library does not otherwise remember, are kept.
+ */
+struct LayoutItem {
+    enum Type {
+        STATEMENT,
+        COMMENT,
+        OPEN_BLOCK,
+        CLOSE_BLOCK,
+        END_OF_FILE,
+    };
+
+    Type type = STATEMENT;
+    char keyword = 0;                                       // For statements, the letter after the dollar
+    LabTok label;
+    std::vector< SymTok > symbols;                          // Only for $c, $v and $d statements
+    std::string text;                                       // Only for comments
+    uint32_t tokens_num = 0;
+    std::vector< std::pair< uint32_t, std::string > > spacing;
+    std::vector< uint32_t > proof_chunks;                   // Length of the pieces of the code string of compressed proofs
+};
+
 class LibraryAddendum {
 public:
     virtual const std::string &get_htmldef(SymTok tok) const = 0;
@@ -243,10 +268,17 @@ public:
     {
         assert(this->theorem);
         this->proof = proof;
+        this->lazy_proof = nullptr;
     }
-    std::shared_ptr< const Proof > get_proof() const {
-        return this->proof;
+    void set_lazy_proof(std::shared_ptr< const LazyCompressedProof > lazy_proof)
+    {
+        assert(this->theorem);
+        this->proof = nullptr;
+        this->lazy_proof = lazy_proof;
     }
+    std::shared_ptr< const Proof > get_proof() const;
+    // Same as get_proof(), but a lazy proof is decoded without being kept in memory
+    std::shared_ptr< const Proof > decode_proof() const;
 
 private:
     bool valid;
@@ -259,6 +291,7 @@ private:
     LabTok thesis;
     LabTok number;
     std::shared_ptr< const Proof > proof;
+    std::shared_ptr< const LazyCompressedProof > lazy_proof;
     std::string comment;
     bool modif_disc;
     bool usage_disc;
@@ -346,6 +379,9 @@ public:
     void set_max_number(LabTok max_number);
     void set_addendum(const LibraryAddendumImpl &add);
     void set_parsing_addendum(const ParsingAddendumImpl &add);
+    void set_proof(LabTok label, std::shared_ptr< const Proof > proof);
+    const std::vector< LayoutItem > &get_layout() const;
+    void add_layout_item(LayoutItem &&item);
 
 private:
     StringCache< SymTok > syms;
@@ -363,6 +399,7 @@ private:
     StackFrame final_stack_frame;
     LibraryAddendumImpl addendum;
     ParsingAddendumImpl parsing_addendum;
+    std::vector< LayoutItem > layout;
 
     LabTok max_number;
 };
@@ -17,6 +17,7 @@ class Assertion;
 class Proof;
 class CompressedProof;
 class UncompressedProof;
+class LazyCompressedProof;
 template< typename SentType_ >
 class ProofExecutor;
 class ProofOperator;
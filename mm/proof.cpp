@@ -9,6 +9,7 @@
 
 #include "utils/utils.h"
 #include "library.h"
+#include "tokenizer.h"
 
 const size_t max_decompression_size = 1024 * 1024;
 
@@ -36,6 +37,55 @@ const std::vector<CodeTok> &CompressedProof::get_codes() const
     return this->codes;
 }
 
+LazyCompressedProof::LazyCompressedProof(const std::vector<LabTok> &refs, std::shared_ptr<const MappedFile> source, size_t begin, size_t end) :
+    refs(refs), source(source), begin(begin), end(end)
+{
+}
+
+std::shared_ptr< const CompressedProof > LazyCompressedProof::get_proof() const
+{
+    std::unique_lock< std::mutex > lock(this->mutex);
+    if (this->proof == nullptr) {
+        this->proof = this->decode_internal();
+        this->refs.clear();
+        this->refs.shrink_to_fit();
+        this->source = nullptr;
+    }
+    return this->proof;
+}
+
+std::shared_ptr< const CompressedProof > LazyCompressedProof::decode() const
+{
+    std::unique_lock< std::mutex > lock(this->mutex);
+    if (this->proof != nullptr) {
+        return this->proof;
+    }
+    return this->decode_internal();
+}
+
+std::shared_ptr< const CompressedProof > LazyCompressedProof::decode_internal() const
+{
+    assert_or_throw< MMPPParsingError >(this->begin <= this->end && this->end <= this->source->get_size(), "Proof is out of its source file");
+    const char *data = this->source->get_data();
+    std::vector< CodeTok > codes;
+    CompressedDecoder cd;
+    for (size_t i = this->begin; i < this->end; i++) {
+        if (data[i] == '$') {
+            // Skip a comment embedded in the proof
+            assert_or_throw< MMPPParsingError >(i+1 < this->end && data[i+1] == '(', "Invalid character in compressed proof");
+            for (i += 2; i+1 < this->end && !(data[i] == '$' && data[i+1] == ')'); i++) {}
+            assert_or_throw< MMPPParsingError >(i+1 < this->end, "Unterminated comment in compressed proof");
+            i++;
+            continue;
+        }
+        CodeTok res = cd.push_char(data[i]);
+        if (res != INVALID_CODE) {
+            codes.push_back(res);
+        }
+    }
+    return std::make_shared< CompressedProof >(this->refs, codes);
+}
+
 const CompressedProof CompressedProofOperator::compress(CompressionStrategy strategy)
 {
     if (strategy == CS_ANY) {
@@ -5,6 +5,7 @@
 #include <limits>
 #include <type_traits>
 #include <memory>
+#include <mutex>
 
 #include "utils/vectormap.h"
 #include "funds.h"
@@ -187,6 +188,30 @@ private:
     const std::vector< CodeTok > codes;
 };
 
+class MappedFile;
+
+/* A compressed proof whose code string has not been decoded yet: it is kept as a
+ * range of bytes in the (memory mapped) source file and decoded the first time
+ * it is requested. The source file must not change while the proof is around.
+ */
+class LazyCompressedProof {
+public:
+    LazyCompressedProof(const std::vector< LabTok > &refs, std::shared_ptr< const MappedFile > source, size_t begin, size_t end);
+    std::shared_ptr< const CompressedProof > get_proof() const;
+    // Decode the proof without keeping it, unless it was already kept by get_proof()
+    std::shared_ptr< const CompressedProof > decode() const;
+
+private:
+    std::shared_ptr< const CompressedProof > decode_internal() const;
+
+    mutable std::mutex mutex;
+    mutable std::vector< LabTok > refs;
+    mutable std::shared_ptr< const MappedFile > source;
+    size_t begin;
+    size_t end;
+    mutable std::shared_ptr< const CompressedProof > proof;
+};
+
 class UncompressedProof : public Proof {
 public:
     UncompressedProof(const std::vector< LabTok > &labels);
@@ -276,5 +301,5 @@ void UncompressedProofExecutor< SentType_ >::execute()
 template< typename SentType_ >
 std::shared_ptr< ProofExecutor< SentType_ > > Assertion::get_proof_executor(const Library &lib, bool gen_proof_tree) const
 {
-    return this->proof->get_executor< SentType_ >(lib, *this, gen_proof_tree);
+    return this->get_proof()->get_executor< SentType_ >(lib, *this, gen_proof_tree);
 }
@@ -0,0 +1,219 @@
+
+#include "proofstats.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "utils/utils.h"
+#include "utils/parallel.h"
+
+static uint64_t saturating_add(uint64_t x, uint64_t y) {
+    if (x > std::numeric_limits< uint64_t >::max() - y) {
+        return std::numeric_limits< uint64_t >::max();
+    }
+    return x + y;
+}
+
+namespace {
+
+/* Builds the DAG of a proof, where each saved step is a single node referenced
+ * many times, and computes statistics on it; expanded counts are obtained
+ * propagating the multiplicity of each node from the root to the leaves. */
+class ProofDag {
+public:
+    ProofDag(const Library &lib, const Assertion &ass) : lib(lib), ass(ass) {
+    }
+
+    void push_label(LabTok label) {
+        const Assertion *child_ass = nullptr;
+        try {
+            child_ass = &this->lib.get_assertion(label);
+        } catch (std::out_of_range&) {
+        }
+        Node node;
+        node.label = label;
+        node.children_begin = this->children.size();
+        if (child_ass != nullptr && child_ass->is_valid()) {
+            size_t hyps_num = child_ass->get_mand_hyps_num();
+            assert_or_throw< MMPPException >(this->stack.size() >= hyps_num, "Stack too small to pop hypotheses");
+            size_t stack_base = this->stack.size() - hyps_num;
+            node.children_num = hyps_num;
+            node.float_num = child_ass->get_float_hyps().size();
+            for (size_t i = 0; i < hyps_num; i++) {
+                const auto &entry = this->stack[stack_base + i];
+                this->consume(entry, i >= node.float_num);
+                this->children.push_back(entry.node);
+            }
+            this->stack.resize(stack_base);
+        }
+        this->stack.push_back({ this->nodes.size(), false });
+        this->nodes.push_back(node);
+    }
+
+    void push_saved(size_t idx) {
+        assert_or_throw< MMPPException >(idx < this->saved.size(), "Code too big in compressed proof");
+        this->stack.push_back({ this->saved[idx], true });
+    }
+
+    void save() {
+        assert_or_throw< MMPPException >(!this->stack.empty(), "Saving a step with empty stack");
+        this->saved.push_back(this->stack.back().node);
+    }
+
+    ProofStats finish() {
+        assert_or_throw< MMPPException >(this->stack.size() == 1, "Proof did not end with a single element on the stack");
+        this->consume(this->stack[0], true);
+        size_t root = this->stack[0].node;
+
+        // Depths are computed from the leaves, since children always come before their parents
+        std::vector< size_t > depth(this->nodes.size());
+        std::vector< size_t > ess_depth(this->nodes.size());
+        for (size_t i = 0; i < this->nodes.size(); i++) {
+            const auto &node = this->nodes[i];
+            size_t max_depth = 0;
+            size_t max_ess_depth = 0;
+            for (size_t j = 0; j < node.children_num; j++) {
+                size_t child = this->children[node.children_begin + j];
+                max_depth = std::max(max_depth, depth[child]);
+                if (j >= node.float_num) {
+                    max_ess_depth = std::max(max_ess_depth, ess_depth[child]);
+                }
+            }
+            depth[i] = max_depth + 1;
+            ess_depth[i] = max_ess_depth + 1;
+        }
+        this->stats.depth = depth[root];
+        this->stats.ess_depth = ess_depth[root];
+
+        // Multiplicities are computed from the root
+        std::vector< uint64_t > mult(this->nodes.size());
+        std::vector< uint64_t > ess_mult(this->nodes.size());
+        mult[root] = 1;
+        ess_mult[root] = 1;
+        for (size_t i = this->nodes.size(); i-- > 0; ) {
+            const auto &node = this->nodes[i];
+            for (size_t j = 0; j < node.children_num; j++) {
+                size_t child = this->children[node.children_begin + j];
+                mult[child] = saturating_add(mult[child], mult[i]);
+                if (j >= node.float_num) {
+                    ess_mult[child] = saturating_add(ess_mult[child], mult[i]);
+                }
+            }
+        }
+
+        this->stats.ess_hyp_usage.resize(this->ass.get_ess_hyps().size());
+        for (size_t i = 0; i < this->nodes.size(); i++) {
+            const auto &node = this->nodes[i];
+            auto &usage = this->stats.label_usage[node.label];
+            usage = saturating_add(usage, mult[i]);
+            this->stats.expanded_steps_num = saturating_add(this->stats.expanded_steps_num, mult[i]);
+            this->stats.expanded_ess_steps_num = saturating_add(this->stats.expanded_ess_steps_num, ess_mult[i]);
+            size_t hyp_idx = this->ess_hyp_index(node.label);
+            if (hyp_idx != this->ass.get_ess_hyps().size()) {
+                this->stats.ess_hyp_usage[hyp_idx] = saturating_add(this->stats.ess_hyp_usage[hyp_idx], ess_mult[i]);
+                this->stats.expanded_ess_hyp_steps = saturating_add(this->stats.expanded_ess_hyp_steps, ess_mult[i]);
+            }
+        }
+
+        return this->stats;
+    }
+
+private:
+    struct Node {
+        LabTok label;
+        size_t children_begin = 0;
+        size_t children_num = 0;
+        size_t float_num = 0;
+    };
+
+    struct StackEntry {
+        size_t node;
+        bool ref;
+    };
+
+    size_t ess_hyp_index(LabTok label) const {
+        const auto &ess_hyps = this->ass.get_ess_hyps();
+        return find(ess_hyps.begin(), ess_hyps.end(), label) - ess_hyps.begin();
+    }
+
+    // Called when an element of the stack becomes a node of the proof tree
+    void consume(const StackEntry &entry, bool essential) {
+        this->stats.steps_num++;
+        if (essential) {
+            this->stats.ess_steps_num++;
+            // References to saved steps are unlabelled in the proof tree
+            if (!entry.ref && this->ess_hyp_index(this->nodes[entry.node].label) != this->ass.get_ess_hyps().size()) {
+                this->stats.ess_hyp_steps++;
+            }
+        }
+    }
+
+    const Library &lib;
+    const Assertion &ass;
+    std::vector< Node > nodes;
+    std::vector< size_t > children;
+    std::vector< StackEntry > stack;
+    std::vector< size_t > saved;
+    ProofStats stats;
+};
+
+}
+
+ProofStats compute_proof_stats(const Library &lib, const Assertion &ass, const CompressedProof &proof)
+{
+    ProofDag dag(lib, ass);
+    const auto &refs = proof.get_refs();
+    size_t mand_hyps_num = ass.get_mand_hyps_num();
+    for (const auto &code : proof.get_codes()) {
+        if (code == CodeTok{}) {
+            dag.save();
+        } else if (code.val() <= mand_hyps_num) {
+            dag.push_label(ass.get_mand_hyp(code.val()-1));
+        } else if (code.val() <= mand_hyps_num + refs.size()) {
+            dag.push_label(refs[code.val()-mand_hyps_num-1]);
+        } else {
+            dag.push_saved(code.val()-mand_hyps_num-refs.size()-1);
+        }
+    }
+    return dag.finish();
+}
+
+ProofStats compute_proof_stats(const Library &lib, const Assertion &ass, const UncompressedProof &proof)
+{
+    ProofDag dag(lib, ass);
+    for (const auto &label : proof.get_labels()) {
+        dag.push_label(label);
+    }
+    return dag.finish();
+}
+
+ProofStats compute_proof_stats(const Library &lib, const Assertion &ass)
+{
+    auto proof = ass.get_proof();
+    assert_or_throw< MMPPException >(proof != nullptr, "Assertion has no proof");
+    if (auto compressed = dynamic_cast< const CompressedProof* >(proof.get())) {
+        return compute_proof_stats(lib, ass, *compressed);
+    }
+    if (dynamic_cast< const UncompressedProof* >(proof.get()) != nullptr) {
+        // Compress first, so that repeated subproofs become saved steps as they used to
+        auto compressed = ass.get_proof_operator(lib)->compress();
+        return compute_proof_stats(lib, ass, compressed);
+    }
+    throw std::bad_cast();
+}
+
+std::vector< std::pair< LabTok, ProofStats > > compute_all_proof_stats(const ExtendedLibrary &lib, size_t threads_num)
+{
+    std::vector< std::pair< LabTok, ProofStats > > ret;
+    for (const auto &ass : lib.get_assertions()) {
+        if (ass.is_valid() && ass.is_theorem() && ass.has_proof()) {
+            ret.push_back(std::make_pair(ass.get_thesis(), ProofStats()));
+        }
+    }
+
+    parallel_for(ret.size(), threads_num, [&](size_t idx) {
+        ret[idx].second = compute_proof_stats(lib, lib.get_assertion(ret[idx].first));
+    });
+
+    return ret;
+}
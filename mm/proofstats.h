@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstdint>
+
+#include "library.h"
+#include "proof.h"
+
+/* Statistics about a proof, computed directly on the DAG described by the proof
+ * (i.e., without expanding saved steps, which can take exponential time and space).
+ *
+ * A step is essential when it is not used to fill a floating hypothesis of its parent
+ * (the final step is always essential); this is the same convention used by the
+ * essential flag in ProofTree.
+ */
+struct ProofStats {
+    /* Statistics on the proof as it is written, where each reference to a
+     * saved step counts as a single step. These are the same numbers one would obtain
+     * by walking the ProofTree generated by the proof executor. */
+    size_t steps_num = 0;
+    size_t ess_steps_num = 0;
+    size_t ess_hyp_steps = 0;
+
+    /* Statistics on the fully expanded proof, i.e., on the proof that one would
+     * obtain uncompressing it. Counts saturate instead of overflowing. */
+    uint64_t expanded_steps_num = 0;
+    uint64_t expanded_ess_steps_num = 0;
+    uint64_t expanded_ess_hyp_steps = 0;
+    size_t depth = 0;
+    size_t ess_depth = 0;
+    std::map< LabTok, uint64_t > label_usage;
+    std::vector< uint64_t > ess_hyp_usage;           // Essential uses of each essential hypothesis of the assertion
+};
+
+ProofStats compute_proof_stats(const Library &lib, const Assertion &ass, const CompressedProof &proof);
+ProofStats compute_proof_stats(const Library &lib, const Assertion &ass, const UncompressedProof &proof);
+// Uncompressed proofs are compressed before computing the statistics, so that the DAG has shared nodes
+ProofStats compute_proof_stats(const Library &lib, const Assertion &ass);
+std::vector< std::pair< LabTok, ProofStats > > compute_all_proof_stats(const ExtendedLibrary &lib, size_t threads_num = 0);
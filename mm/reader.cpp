@@ -22,9 +22,22 @@ void Reader::run () {
         bool &comment = token_pair.first;
         std::string &token = token_pair.second;
         if (comment) {
+            if (this->store_layout) {
+                if (this->label != LabTok{}) {
+                    this->record_comment_in_statement(this->tg->get_last_spacing(), token);
+                } else {
+                    this->layout_item.type = LayoutItem::COMMENT;
+                    this->layout_item.text = token;
+                    this->record_token(this->tg->get_last_spacing());
+                    this->flush_layout_item();
+                }
+            }
             this->process_comment(token);
             continue;
         }
+        if (this->store_layout) {
+            this->record_token(this->tg->get_last_spacing());
+        }
         if (token[0] == '$') {
             assert_or_throw< MMPPParsingError >(token.size() == 2, "Dollar sequence with wrong length");
             char c = token[1];
@@ -32,10 +45,18 @@ void Reader::run () {
             // Parse scoping blocks
             if (c == '{') {
                 this->stack.emplace_back();
+                if (this->store_layout) {
+                    this->layout_item.type = LayoutItem::OPEN_BLOCK;
+                    this->flush_layout_item();
+                }
                 continue;
             } else if (c == '}') {
                 assert_or_throw< MMPPParsingError >(!this->stack.empty(), "Unmatched closed scoping block");
                 this->stack.pop_back();
+                if (this->store_layout) {
+                    this->layout_item.type = LayoutItem::CLOSE_BLOCK;
+                    this->flush_layout_item();
+                }
                 continue;
             }
 
@@ -44,14 +65,26 @@ void Reader::run () {
                 bool &comment = token_pair.first;
                 std::string &token = token_pair.second;
                 if (comment) {
+                    if (this->store_layout) {
+                        this->record_comment_in_statement(this->tg->get_last_spacing(), token);
+                    }
                     this->process_comment(token);
                     continue;
                 }
                 if (token == "") {
                     throw MMPPParsingError("File ended in a statement");
                 }
+                if (this->store_layout) {
+                    this->record_token(this->tg->get_last_spacing());
+                }
+                if (this->lazy_proofs) {
+                    this->toks_locations.push_back(this->tg->get_last_token_location());
+                }
                 this->toks.push_back(token);
             }
+            if (this->store_layout) {
+                this->record_token(this->tg->get_last_spacing());
+            }
 
             // Process statement
             switch (c) {
@@ -80,14 +113,35 @@ void Reader::run () {
                 throw MMPPParsingError("Wrong statement type");
                 break;
             }
+            if (this->store_layout) {
+                this->layout_item.type = LayoutItem::STATEMENT;
+                this->layout_item.keyword = c;
+                this->layout_item.label = this->label;
+                if (c == 'c' || c == 'v' || c == 'd') {
+                    for (const auto &stok : this->toks) {
+                        this->layout_item.symbols.push_back(this->lib.get_symbol(stok));
+                    }
+                }
+                this->flush_layout_item();
+            }
             this->label = 0;
             this->toks.clear();
+            this->toks_locations.clear();
         } else {
             this->label = this->lib.create_label(token);
             assert_or_throw< MMPPParsingError >(this->label != LabTok{}, "Repeated label detected");
             //cout << "Found label " << token << endl;
         }
     }
+    if (this->store_layout) {
+        this->layout_item.type = LayoutItem::END_OF_FILE;
+        this->pending_spacing += this->tg->get_last_spacing();
+        if (this->pending_spacing != " ") {
+            this->layout_item.spacing.push_back(std::make_pair(0, this->pending_spacing));
+        }
+        this->pending_spacing.clear();
+        this->flush_layout_item();
+    }
     this->final_frame = this->stack.back();
     this->lib.set_final_stack_frame(this->final_frame);
     this->lib.set_max_number(LabTok(this->number.val()-1));
@@ -328,7 +382,12 @@ void Reader::parse_p()
     CompressedDecoder cd;
     bool in_proof = false;
     int8_t compressed_proof = 0;
-    for (auto &stok : this->toks) {
+    // In lazy mode the code string is not decoded here, we just remember where it is
+    bool lazy = this->lazy_proofs && !this->execute_proofs;
+    size_t first_code_tok = this->toks.size();
+    size_t last_code_tok = this->toks.size();
+    for (size_t tok_idx = 0; tok_idx < this->toks.size(); tok_idx++) {
+        const auto &stok = this->toks[tok_idx];
         if (!in_proof) {
             if (stok == "$=") {
                 in_proof = true;
@@ -363,6 +422,16 @@ void Reader::parse_p()
                 }
             }
             if (compressed_proof == 2) {
+                if (this->store_layout) {
+                    this->layout_item.proof_chunks.push_back(static_cast< uint32_t >(stok.size()));
+                }
+                if (first_code_tok == this->toks.size()) {
+                    first_code_tok = tok_idx;
+                }
+                last_code_tok = tok_idx;
+                if (lazy) {
+                    continue;
+                }
                 for (auto c : stok) {
                     CodeTok res = cd.push_char(c);
                     if (res != INVALID_CODE) {
@@ -399,7 +468,28 @@ void Reader::parse_p()
     Assertion ass(true, compressed_proof != 3, mand_dists, opt_dists, float_hyps, ess_hyps, opt_hyps, this->label, this->number, this->last_comment);
     this->number = LabTok(this->number.val()+1);
     this->last_comment = "";
-    if (compressed_proof != 3) {
+    if (lazy && compressed_proof == 2 && first_code_tok != this->toks.size() && std::get<0>(this->toks_locations.at(first_code_tok)) != nullptr) {
+        // The syntax of lazy proofs is checked only when they are decoded and used
+        const auto &first_loc = this->toks_locations.at(first_code_tok);
+        const auto &last_loc = this->toks_locations.at(last_code_tok);
+        assert_or_throw< MMPPParsingError >(*std::get<0>(first_loc) == *std::get<0>(last_loc), "Compressed proof spans more than one file");
+        auto &source = this->sources[*std::get<0>(first_loc)];
+        if (source == nullptr) {
+            source = std::make_shared< MappedFile >(*std::get<0>(first_loc));
+        }
+        ass.set_lazy_proof(std::make_shared< LazyCompressedProof >(proof_refs, source, std::get<1>(first_loc), std::get<2>(last_loc)));
+    } else if (compressed_proof != 3) {
+        if (lazy && compressed_proof == 2) {
+            // We could not record where the proof is, so we have to decode it anyway
+            for (size_t tok_idx = first_code_tok; tok_idx < this->toks.size(); tok_idx++) {
+                for (auto c : this->toks[tok_idx]) {
+                    CodeTok res = cd.push_char(c);
+                    if (res != INVALID_CODE) {
+                        proof_codes.push_back(res);
+                    }
+                }
+            }
+        }
         std::shared_ptr< Proof > proof;
         if (compressed_proof < 0) {
             proof = std::make_shared< UncompressedProof > (proof_labels);
@@ -715,6 +805,28 @@ void Reader::parse_j_comment(const std::string &comment)
     this->parse_j_code(code);
 }
 
+void Reader::record_token(const std::string &spacing)
+{
+    std::string full_spacing = this->pending_spacing + spacing;
+    this->pending_spacing.clear();
+    if (full_spacing != " ") {
+        this->layout_item.spacing.push_back(std::make_pair(this->layout_item.tokens_num, full_spacing));
+    }
+    this->layout_item.tokens_num++;
+}
+
+void Reader::record_comment_in_statement(const std::string &spacing, const std::string &comment)
+{
+    // Comments inside statements are kept verbatim as part of the whitespace before the following token
+    this->pending_spacing += spacing + "$(" + comment + "$)";
+}
+
+void Reader::flush_layout_item()
+{
+    this->lib.add_layout_item(std::move(this->layout_item));
+    this->layout_item = LayoutItem();
+}
+
 bool Reader::check_var(SymTok tok) const
 {
     for (auto &frame : this->stack) {
@@ -740,8 +852,8 @@ bool Reader::check_type(LabTok tok) const
     return false;
 }
 
-Reader::Reader(TokenGenerator &tg, bool execute_proofs, bool store_comments) :
-    tg(&tg), execute_proofs(execute_proofs), store_comments(store_comments),
+Reader::Reader(TokenGenerator &tg, bool execute_proofs, bool store_comments, bool store_layout, bool lazy_proofs) :
+    tg(&tg), execute_proofs(execute_proofs), store_comments(store_comments), store_layout(store_layout), lazy_proofs(lazy_proofs),
     number(1)
 {
 }
@@ -3,6 +3,9 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <map>
+#include <tuple>
+#include <memory>
 #include <unordered_map>
 
 #include <boost/filesystem.hpp>
@@ -13,7 +16,7 @@
 
 class Reader {
 public:
-    Reader(TokenGenerator &tg, bool execute_proofs=true, bool store_comments=false);
+    Reader(TokenGenerator &tg, bool execute_proofs=true, bool store_comments=false, bool store_layout=false, bool lazy_proofs=false);
     void run();
     const LibraryImpl &get_library() const;
 
@@ -27,6 +30,9 @@ private:
     void parse_a();
     void parse_p();
     void process_comment(const std::string &comment);
+    void record_token(const std::string &spacing);
+    void record_comment_in_statement(const std::string &spacing, const std::string &comment);
+    void flush_layout_item();
     std::vector<std::vector<std::pair<bool, std::string> > > parse_comment(const std::string &comment);
     void parse_t_comment(const std::string &comment);
     void parse_t_code(const std::vector<std::vector<std::pair<bool, std::string> > > &code);
@@ -49,13 +55,19 @@ private:
     TokenGenerator *tg;
     bool execute_proofs;
     bool store_comments;
+    bool store_layout;
+    bool lazy_proofs;
     LibraryImpl lib;
     LabTok label;
     LabTok number;
     std::string last_comment;
     std::vector< std::string > toks;
+    std::vector< std::tuple< const boost::filesystem::path*, size_t, size_t > > toks_locations;
+    std::map< boost::filesystem::path, std::shared_ptr< const MappedFile > > sources;
     std::string t_comment;
     std::string j_comment;
+    LayoutItem layout_item;
+    std::string pending_spacing;
 
     std::vector< StackFrame > stack;
     StackFrame final_frame;
@@ -1,7 +1,10 @@
 
 #include "setmm.h"
 
+#include <algorithm>
+
 #include "mm/reader.h"
+#include "parsing/unif.h"
 #include "platform.h"
 #include "utils/utils.h"
 
@@ -10,13 +13,13 @@ SetMmImpl::SetMmImpl(const boost::filesystem::path &filename, const boost::files
     std::cout << "Reading database from file " << filename << " using cache in file " << cache_filename << std::endl;
     TextProgressBar tpb;
     FileTokenizer ft(filename, &tpb);
-    Reader p(ft, false, true);
+    Reader p(ft, false, true, false, true);
     p.run();
     tpb.finished();
     this->lib = new LibraryImpl(p.get_library());
     std::shared_ptr< ToolboxCache > cache = std::make_shared< FileToolboxCache >(cache_filename);
     std::cout << "Memory usage after loading the library: " << size_to_string(platform_get_current_used_ram()) << std::endl;
-    this->tb = new LibraryToolbox(*this->lib, "|-", cache);
+    this->tb = new LibraryToolbox(*this->lib, "|-", cache, true);
     std::cout << "Memory usage after creating the toolbox: " << size_to_string(platform_get_current_used_ram()) << std::endl;
     std::cout << "The library has " << this->lib->get_symbols_num() << " symbols and " << this->lib->get_labels_num() << " labels" << std::endl << std::endl;
 }
@@ -36,3 +39,80 @@ const SetMm &get_set_mm() {
     static SetMm data(platform_get_resources_base() / "set.mm", platform_get_resources_base() / "set.mm.cache");
     return data;
 }
+
+UnificationQuery make_unification_query(const LibraryToolbox &tb, const Assertion &ass, bool reverse_hyps) {
+    UnificationQuery query;
+    for (const auto &hyp : ass.get_ess_hyps()) {
+        query.hyps.push_back(std::make_pair(tb.get_sentence(hyp).at(0), tb.get_parsed_sent2(hyp)));
+    }
+    if (reverse_hyps) {
+        std::reverse(query.hyps.begin(), query.hyps.end());
+    }
+    query.thesis = std::make_pair(tb.get_sentence(ass.get_thesis()).at(0), tb.get_parsed_sent2(ass.get_thesis()));
+    return query;
+}
+
+std::vector< LabTok > pick_unification_queries(const LibraryToolbox &tb, size_t num, size_t min_hyps_num) {
+    std::vector< LabTok > theses;
+    for (const Assertion &ass : tb.gen_assertions()) {
+        if (ass.is_theorem() && !ass.is_usage_disc() && ass.get_ess_hyps().size() >= min_hyps_num) {
+            theses.push_back(ass.get_thesis());
+        }
+    }
+    if (theses.size() <= num) {
+        return theses;
+    }
+    std::vector< LabTok > queries;
+    for (size_t i = 0; i < num; i++) {
+        queries.push_back(theses[i * theses.size() / num]);
+    }
+    return queries;
+}
+
+std::vector< LabTok > get_query_vars(const LibraryToolbox &tb, const UnificationQuery &query) {
+    const auto is_var = tb.get_standard_is_var_fast();
+    std::vector< LabTok > vars;
+    auto add_vars = [&](const ParsingTree2< SymTok, LabTok > &pt) {
+        for (size_t i = 0; i < pt.get_nodes_len(); i++) {
+            LabTok lab = pt.get_nodes()[i].label;
+            if (is_var(lab) && std::find(vars.begin(), vars.end(), lab) == vars.end()) {
+                vars.push_back(lab);
+            }
+        }
+    };
+    for (const auto &hyp : query.hyps) {
+        add_vars(hyp.second);
+    }
+    add_vars(query.thesis.second);
+    return vars;
+}
+
+UnificationQuery rename_query_vars(const LibraryToolbox &tb, const UnificationQuery &query, std::unordered_map< SymTok, SymTok > &sym_subst) {
+    const auto is_var = tb.get_standard_is_var_fast();
+    SubstMap2< SymTok, LabTok > subst;
+    for (const auto &var : get_query_vars(tb, query)) {
+        SymTok type_sym = tb.get_var_lab_to_type_sym(var);
+        auto temp_var = tb.new_temp_var(type_sym);
+        subst.insert(std::make_pair(var, var_parsing_tree(temp_var.first, type_sym)));
+        sym_subst.insert(std::make_pair(tb.get_var_lab_to_sym(var), temp_var.second));
+    }
+    UnificationQuery ret;
+    for (const auto &hyp : query.hyps) {
+        ret.hyps.push_back(std::make_pair(hyp.first, substitute2(hyp.second, is_var, subst)));
+    }
+    ret.thesis = std::make_pair(query.thesis.first, substitute2(query.thesis.second, is_var, subst));
+    return ret;
+}
+
+void rename_unification_results(std::vector< std::tuple< LabTok, std::vector< size_t >, std::unordered_map< SymTok, Sentence > > > &results, const std::unordered_map< SymTok, SymTok > &sym_subst) {
+    for (auto &res : results) {
+        for (auto &x : std::get<2>(res)) {
+            for (auto &sym : x.second) {
+                auto it = sym_subst.find(sym);
+                if (it != sym_subst.end()) {
+                    sym = it->second;
+                }
+            }
+        }
+    }
+}
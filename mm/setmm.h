@@ -1,6 +1,10 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <tuple>
 
 #include "mm/library.h"
 #include "mm/toolbox.h"
@@ -26,3 +30,25 @@ struct SetMm {
 };
 
 const SetMm &get_set_mm();
+
+/* A unification query, in the form taken by LibraryToolbox::unify_assertion() */
+struct UnificationQuery {
+    std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > hyps;
+    std::pair< SymTok, ParsingTree2< SymTok, LabTok > > thesis;
+};
+
+// The essential hypotheses and the thesis of an assertion, optionally with the hypotheses in reverse order
+UnificationQuery make_unification_query(const LibraryToolbox &tb, const Assertion &ass, bool reverse_hyps = false);
+
+// The theses of up to num theorems with at least min_hyps_num essential hypotheses, evenly spread across the library
+std::vector< LabTok > pick_unification_queries(const LibraryToolbox &tb, size_t num, size_t min_hyps_num = 0);
+
+// The variables of a query, in order of first appearance
+std::vector< LabTok > get_query_vars(const LibraryToolbox &tb, const UnificationQuery &query);
+
+/* Rename the variables of a query to new temporary variables, which belong to the current temporary
+ * variables frame; the renaming of their symbols is stored in sym_subst */
+UnificationQuery rename_query_vars(const LibraryToolbox &tb, const UnificationQuery &query, std::unordered_map< SymTok, SymTok > &sym_subst);
+
+// Apply to the substitutions of unification results the renaming computed by rename_query_vars()
+void rename_unification_results(std::vector< std::tuple< LabTok, std::vector< size_t >, std::unordered_map< SymTok, Sentence > > > &results, const std::unordered_map< SymTok, SymTok > &sym_subst);
@@ -31,14 +31,14 @@ std::vector< std::string > tokenize(const std::string &in) {
 {
 }*/
 
-FileTokenizer::FileTokenizer(const boost::filesystem::path &filename, Reportable *reportable) :
-    fin(filename), base_path(filename.parent_path()), cascade(nullptr), white(true), reportable(reportable)
+FileTokenizer::FileTokenizer(const boost::filesystem::path &filename, Reportable *reportable, bool keep_spacing) :
+    fin(filename), filename(filename), base_path(filename.parent_path()), cascade(nullptr), white(true), reportable(reportable), keep_spacing(keep_spacing)
 {
     this->set_file_size();
 }
 
-FileTokenizer::FileTokenizer(std::string filename, boost::filesystem::path base_path) :
-    fin(filename), base_path(base_path), cascade(nullptr), white(true), reportable(nullptr)
+FileTokenizer::FileTokenizer(std::string filename, boost::filesystem::path base_path, bool keep_spacing) :
+    fin(filename), filename(filename), base_path(base_path), cascade(nullptr), white(true), reportable(nullptr), keep_spacing(keep_spacing)
 {
     this->set_file_size();
 }
@@ -70,9 +70,16 @@ char FileTokenizer::get_char()
 }
 
 std::pair<bool, std::string> FileTokenizer::finalize_token(bool comment) {
+    if (this->keep_spacing) {
+        this->last_spacing = std::move(this->spacing);
+        this->spacing.clear();
+    }
+    this->last_from_cascade = false;
     if (this->white) {
         return std::make_pair(comment, "");
     } else {
+        this->last_token_begin = this->token_begin;
+        this->last_token_end = this->pos - 1;
         std::string res = std::string(this->buf.begin(), this->buf.end());
         this->buf.clear();
         this->white = true;
@@ -86,8 +93,17 @@ std::pair<bool, std::string> FileTokenizer::next()
         if (this->cascade != nullptr) {
             auto next_pair = this->cascade->next();
             if (next_pair.second != "") {
+                this->last_from_cascade = true;
+                if (this->keep_spacing) {
+                    // Whatever came before the file inclusion is attributed to the first token of the included file
+                    this->last_spacing = this->spacing + this->cascade->get_last_spacing();
+                    this->spacing.clear();
+                }
                 return next_pair;
             } else {
+                if (this->keep_spacing) {
+                    this->spacing += this->cascade->get_last_spacing();
+                }
                 delete this->cascade;
                 this->cascade = nullptr;
             }
@@ -122,14 +138,22 @@ std::pair<bool, std::string> FileTokenizer::next()
                             this->white = true;
                             if (comment) {
                                 if (content.empty()) {
+                                    if (this->keep_spacing) {
+                                        this->spacing += "$($)";
+                                    }
                                     break;
                                 } else {
+                                    if (this->keep_spacing) {
+                                        this->last_spacing = std::move(this->spacing);
+                                        this->spacing.clear();
+                                    }
+                                    this->last_from_cascade = false;
                                     return std::make_pair(true, std::string(content.begin(), content.end()));
                                 }
                             } else {
                                 std::string filename = trimmed(std::string(content.begin(), content.end()));
                                 std::string actual_filename = (this->base_path / filename).string();
-                                this->cascade = new FileTokenizer(actual_filename, this->base_path);
+                                this->cascade = new FileTokenizer(actual_filename, this->base_path, this->keep_spacing);
                                 break;
                             }
                         } else if (c == '$') {
@@ -152,6 +176,7 @@ std::pair<bool, std::string> FileTokenizer::next()
             } else if (c == ']') {
                 throw MMPPParsingError("File inclusion closed while not in comment");
             } else if (c == '$' || is_mm_valid(c)) {
+                this->token_begin = this->pos - 2;
                 this->buf.push_back('$');
                 this->buf.push_back(c);
                 this->white = false;
@@ -161,11 +186,20 @@ std::pair<bool, std::string> FileTokenizer::next()
                 throw MMPPParsingError("Forbidden input character");
             }
         } else if (is_mm_valid(c)) {
+            if (this->white) {
+                this->token_begin = this->pos - 1;
+            }
             this->buf.push_back(c);
             this->white = false;
         } else if (is_mm_whitespace(c)) {
             if (!this->white) {
-                return this->finalize_token(false);
+                auto ret = this->finalize_token(false);
+                if (this->keep_spacing) {
+                    this->spacing.push_back(c);
+                }
+                return ret;
+            } else if (this->keep_spacing) {
+                this->spacing.push_back(c);
             }
         } else {
             throw MMPPParsingError("Forbidden input character");
@@ -173,11 +207,50 @@ std::pair<bool, std::string> FileTokenizer::next()
     }
 }
 
+std::string FileTokenizer::get_last_spacing() const
+{
+    return this->last_spacing;
+}
+
+std::tuple< const boost::filesystem::path*, size_t, size_t > FileTokenizer::get_last_token_location() const
+{
+    if (this->last_from_cascade) {
+        return this->cascade->get_last_token_location();
+    }
+    return std::make_tuple(&this->filename, this->last_token_begin, this->last_token_end);
+}
+
 FileTokenizer::~FileTokenizer()
 {
     delete this->cascade;
 }
 
+std::string TokenGenerator::get_last_spacing() const
+{
+    return " ";
+}
+
+std::tuple< const boost::filesystem::path*, size_t, size_t > TokenGenerator::get_last_token_location() const
+{
+    return std::make_tuple(nullptr, 0, 0);
+}
+
 TokenGenerator::~TokenGenerator()
 {
 }
+
+MappedFile::MappedFile(const boost::filesystem::path &filename) :
+    mapping(filename.string().c_str(), boost::interprocess::read_only),
+    region(mapping, boost::interprocess::read_only)
+{
+}
+
+const char *MappedFile::get_data() const
+{
+    return static_cast< const char* >(this->region.get_address());
+}
+
+size_t MappedFile::get_size() const
+{
+    return this->region.get_size();
+}
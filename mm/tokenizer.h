@@ -2,9 +2,12 @@
 
 #include <vector>
 #include <utility>
+#include <tuple>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include "utils/utils.h"
 #include "funds.h"
@@ -19,21 +22,31 @@ std::vector< std::string > tokenize(const std::string &in);
 class TokenGenerator {
 public:
     virtual std::pair< bool, std::string > next() = 0;
+    /* Return the whitespace (and the empty comments) that separated the last token returned by
+     * next() from the one before it. Generators that do not keep track of it pretend
+     * that tokens are separated by a single space. */
+    virtual std::string get_last_spacing() const;
+    /* Return the file the last token returned by next() was read from, together with
+     * the range of bytes it occupies in it; the file is nullptr if this is not known. */
+    virtual std::tuple< const boost::filesystem::path*, size_t, size_t > get_last_token_location() const;
     virtual ~TokenGenerator();
 };
 
 class FileTokenizer : public TokenGenerator {
 public:
     //FileTokenizer(const std::string &filename);
-    FileTokenizer(const boost::filesystem::path &filename, Reportable *reportable = NULL);
+    FileTokenizer(const boost::filesystem::path &filename, Reportable *reportable = NULL, bool keep_spacing = false);
     std::pair< bool, std::string > next();
+    std::string get_last_spacing() const;
+    std::tuple< const boost::filesystem::path*, size_t, size_t > get_last_token_location() const;
     ~FileTokenizer();
 private:
-    FileTokenizer(std::string filename, boost::filesystem::path base_path);
+    FileTokenizer(std::string filename, boost::filesystem::path base_path, bool keep_spacing);
     void set_file_size();
     char get_char();
 
     boost::filesystem::ifstream fin;
+    boost::filesystem::path filename;
     boost::filesystem::path base_path;
     FileTokenizer *cascade;
     bool white;
@@ -42,4 +55,23 @@ private:
     boost::filesystem::ifstream::pos_type filesize;
     size_t pos = 0;
     Reportable *reportable;
+    bool keep_spacing;
+    std::string spacing;
+    std::string last_spacing;
+    size_t token_begin = 0;
+    size_t last_token_begin = 0;
+    size_t last_token_end = 0;
+    bool last_from_cascade = false;
+};
+
+// A read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile(const boost::filesystem::path &filename);
+    const char *get_data() const;
+    size_t get_size() const;
+
+private:
+    boost::interprocess::file_mapping mapping;
+    boost::interprocess::mapped_region region;
 };
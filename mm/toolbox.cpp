@@ -1,13 +1,21 @@
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+
 #include <boost/filesystem/fstream.hpp>
 
 #include "toolbox.h"
 #include "utils/utils.h"
+#include "utils/parallel.h"
 #include "old/unification.h"
 #include "parsing/unif.h"
 #include "parsing/earley.h"
 #include "reader.h"
 #include "mm/proof.h"
+#include "mm/ptengine.h"
 
 std::ostream &operator<<(std::ostream &os, const SentencePrinter &sp)
 {
@@ -25,7 +33,7 @@ std::ostream &operator<<(std::ostream &os, const SentencePrinter &sp)
         sent2 = sp.tb.reconstruct_sentence(*sp.pt);
         sentp = &sent2;
     } else if (sp.pt2 != nullptr) {
-        sent2 = sp.tb.reconstruct_sentence(pt2_to_pt(*sp.pt2));
+        sent2 = sp.tb.reconstruct_sentence(*sp.pt2);
         sentp = &sent2;
     } else {
         assert("Should never arrive here" == nullptr);
@@ -103,10 +111,23 @@ std::ostream &operator<<(std::ostream &os, const ProofPrinter &sp)
     return os;
 }
 
-LibraryToolbox::LibraryToolbox(const ExtendedLibrary &lib, std::string turnstile, std::shared_ptr<ToolboxCache> cache) :
-    cache(cache),
+LibraryToolbox::LibraryToolbox(const ExtendedLibrary &lib, std::string turnstile, std::shared_ptr<ToolboxCache> cache, bool parse_from_proofs) :
+    cache(cache), parse_from_proofs(parse_from_proofs),
     lib(lib),
     turnstile(lib.get_symbol(turnstile)), turnstile_alias(lib.get_parsing_addendum().get_syntax().at(this->turnstile)),
+    unification_cache(16 * 1024 * 1024, [](const std::vector< uint32_t > &key, const std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > > &results) {
+        size_t size = sizeof(key) + key.size() * sizeof(uint32_t) + sizeof(results);
+        for (const auto &res : results) {
+            size += sizeof(res) + std::get<1>(res).size() * sizeof(size_t);
+            for (const auto &x : std::get<2>(res)) {
+                size += sizeof(x) + x.second.size() * sizeof(SymTok);
+            }
+        }
+        return size;
+    }),
+    parse_cache(64 * 1024 * 1024, [](const Sentence &key, const CompactParsingTree< SymTok, LabTok > &pt) {
+        return sizeof(key) + key.size() * sizeof(SymTok) + sizeof(pt) + pt.get_nodes_len() * sizeof(CompactParsingTreeNode< LabTok >);
+    }),
     temp_generator(std::make_unique< TempGenerator >(lib))
     //type_labels(lib.get_final_stack_frame().types), type_labels_set(lib.get_final_stack_frame().types_set)
 {
@@ -131,7 +152,7 @@ LibraryToolbox::LibraryToolbox(const ExtendedLibrary &lib, std::string turnstile
     this->validation_rule = [this](LabTok x) {
         auto rule = this->get_derivation_rule(x);
         std::vector< SymTok > fixed_rule;
-        for (const auto r : rule.second) {
+        for (const auto &r : rule.second) {
             if (this->get_derivations().find(r) != this->get_derivations().end()) {
                 fixed_rule.push_back(r);
             }
@@ -141,6 +162,13 @@ LibraryToolbox::LibraryToolbox(const ExtendedLibrary &lib, std::string turnstile
     this->compute_everything();
 }
 
+LibraryToolbox::~LibraryToolbox()
+{
+    for (const auto &pt : this->parsed_sents) {
+        delete pt.load();
+    }
+}
+
 const ExtendedLibrary &LibraryToolbox::get_library() const {
     return this->lib;
 }
@@ -153,6 +181,20 @@ const std::unordered_map<SymTok, std::vector<std::pair<LabTok, std::vector<SymTo
 void LibraryToolbox::compute_ders_by_label()
 {
     this->ders_by_label = compute_derivations_by_label(this->get_derivations());
+    this->label_types.clear();
+    this->label_types.resize(this->lib.get_labels_num() + 1);
+    for (const auto &der : this->ders_by_label) {
+        this->label_types[der.first.val()] = der.second.first;
+    }
+}
+
+SymTok LibraryToolbox::get_label_type(LabTok lab) const
+{
+    if (lab.val() <= this->lib.get_labels_num()) {
+        return this->label_types[lab.val()];
+    } else {
+        return this->temp_generator->get_derivation_rule(lab).first;
+    }
 }
 
 /* We reimplement, instead of use, the function ::recostuct_sentence(),
@@ -184,6 +226,32 @@ void LibraryToolbox::reconstruct_sentence_internal(const ParsingTree<SymTok, Lab
     assert(pt_it == pt.children.end());
 }
 
+Sentence LibraryToolbox::reconstruct_sentence(const ParsingTree2<SymTok, LabTok> &pt, SymTok first_sym) const
+{
+    std::vector< SymTok > res;
+    if (first_sym != SymTok{}) {
+        res.push_back(first_sym);
+    }
+    this->reconstruct_sentence_internal(pt.get_root(), back_inserter(res));
+    return res;
+}
+
+void LibraryToolbox::reconstruct_sentence_internal(ParsingTreeIterator<SymTok, LabTok> pt, std::back_insert_iterator<std::vector<SymTok> > it) const
+{
+    const auto &rule = this->get_derivation_rule(pt.get_node().label);
+    auto pt_it = pt.begin();
+    for (const auto &sym : rule.second) {
+        if (this->derivations.find(sym) == this->derivations.end()) {
+            it = sym;
+        } else {
+            assert(pt_it != pt.end());
+            this->reconstruct_sentence_internal(pt_it, it);
+            ++pt_it;
+        }
+    }
+    assert(pt_it == pt.end());
+}
+
 void LibraryToolbox::compute_vars()
 {
     this->sentence_vars.emplace_back();
@@ -200,7 +268,7 @@ void LibraryToolbox::compute_vars()
         }
         const auto &thesis_vars = this->sentence_vars[ass.get_thesis().val()];
         std::set< LabTok > hyps_vars;
-        for (const auto hyp_tok : ass.get_ess_hyps()) {
+        for (const auto &hyp_tok : ass.get_ess_hyps()) {
             const auto &hyp_vars = this->sentence_vars[hyp_tok.val()];
             hyps_vars.insert(hyp_vars.begin(), hyp_vars.end());
         }
@@ -234,15 +302,20 @@ void LibraryToolbox::compute_labels_to_theses()
         if (!ass.is_valid() || this->get_sentence(ass.get_thesis()).at(0) != this->get_turnstile()) {
             continue;
         }
-        const auto &pt = this->get_parsed_sent(ass.get_thesis());
-        LabTok root_label = pt.label;
+        // Only the root and its children are needed, so there is no need to build the full ParsingTree
+        const auto &pt = this->get_parsed_sent2(ass.get_thesis());
+        LabTok root_label = pt.get_nodes_len() == 0 ? LabTok{} : pt.get_root().get_node().label;
         if (this->get_standard_is_var()(root_label)) {
             root_label = {};
         }
         // FIXME The following is set.mm specific
         if (imp_found && root_label == imp_label) {
-            LabTok ant_label = pt.children.at(0).label;
-            LabTok con_label = pt.children.at(1).label;
+            auto child = pt.get_root().begin();
+            assert_or_throw< MMPPException >(child != pt.get_root().end(), "Implication without antecedent");
+            LabTok ant_label = child.get_node().label;
+            ++child;
+            assert_or_throw< MMPPException >(child != pt.get_root().end(), "Implication without consequent");
+            LabTok con_label = child.get_node().label;
             if (this->get_standard_is_var()(ant_label)) {
                 ant_label = 0;
             }
@@ -257,6 +330,41 @@ void LibraryToolbox::compute_labels_to_theses()
     }
 }
 
+void LibraryToolbox::compute_theses_index()
+{
+    for (const Assertion &ass : this->gen_assertions()) {
+        const auto &pt = this->get_parsed_sent2(ass.get_thesis());
+        if (pt.get_nodes_len() == 0) {
+            continue;
+        }
+        this->theses_index.insert(pt, this->get_standard_is_var(), ass.get_thesis());
+    }
+}
+
+const DiscriminationTree<SymTok, LabTok, LabTok> &LibraryToolbox::get_theses_index() const
+{
+    return this->theses_index;
+}
+
+void LibraryToolbox::compute_fingerprints()
+{
+    this->fingerprints.resize(this->lib.get_labels_num() + 1);
+    for (const Assertion &ass : this->gen_assertions()) {
+        for (const auto &hyp : ass.get_ess_hyps()) {
+            this->fingerprints[hyp.val()] = make_fingerprint(this->get_parsed_sent2(hyp), this->get_standard_is_var());
+        }
+    }
+}
+
+const TreeFingerprint<LabTok> &LibraryToolbox::get_fingerprint(LabTok label) const
+{
+    static const TreeFingerprint< LabTok > wildcards;
+    if (label.val() >= this->fingerprints.size()) {
+        return wildcards;
+    }
+    return this->fingerprints[label.val()];
+}
+
 const std::unordered_map<LabTok, std::vector<LabTok> > &LibraryToolbox::get_root_labels_to_theses() const
 {
     return this->root_labels_to_theses;
@@ -275,27 +383,16 @@ const std::unordered_map<LabTok, std::vector<LabTok> > &LibraryToolbox::get_imp_
 // FIXME Deduplicate with refresh_parsing_tree()
 std::pair<std::vector<ParsingTree<SymTok, LabTok> >, ParsingTree<SymTok, LabTok> > LibraryToolbox::refresh_assertion(const Assertion &ass) const
 {
-    // Collect all variables
-    std::set< LabTok > var_labs;
-    const auto &is_var = this->get_standard_is_var();
-    const ParsingTree< SymTok, LabTok > &thesis_pt = this->get_parsed_sent(ass.get_thesis());
-    collect_variables(thesis_pt, is_var, var_labs);
-    for (const auto hyp : ass.get_ess_hyps()) {
-        const ParsingTree< SymTok, LabTok > &hyp_pt = this->get_parsed_sent(hyp);
-        collect_variables(hyp_pt, is_var, var_labs);
-    }
-
-    // Build a substitution map
-    SubstMap< SymTok, LabTok > subst = this->build_refreshing_subst_map(var_labs).first;
-
-    // Substitute and return
-    ParsingTree< SymTok, LabTok > thesis_new_pt = ::substitute(thesis_pt, is_var, subst);
+    // Refresh the compact trees and convert only the result, so that get_parsed_sent() does not build and keep a tree for each assertion
+    auto to_pt = [](const ParsingTree2< SymTok, LabTok > &pt2) {
+        return pt2.get_nodes_len() == 0 ? ParsingTree< SymTok, LabTok >() : pt2_to_pt(pt2);
+    };
+    auto refreshed = this->refresh_assertion2(ass);
     std::vector< ParsingTree< SymTok, LabTok > > hyps_new_pts;
-    for (const auto hyp : ass.get_ess_hyps()) {
-        const ParsingTree< SymTok, LabTok > &hyp_pt = this->get_parsed_sent(hyp);
-        hyps_new_pts.push_back(::substitute(hyp_pt, is_var, subst));
+    for (const auto &hyp_pt : refreshed.first) {
+        hyps_new_pts.push_back(to_pt(hyp_pt));
     }
-    return std::make_pair(hyps_new_pts, thesis_new_pt);
+    return std::make_pair(hyps_new_pts, to_pt(refreshed.second));
 }
 
 std::pair<std::vector<ParsingTree2<SymTok, LabTok> >, ParsingTree2<SymTok, LabTok> > LibraryToolbox::refresh_assertion2(const Assertion &ass) const
@@ -305,7 +402,7 @@ std::pair<std::vector<ParsingTree2<SymTok, LabTok> >, ParsingTree2<SymTok, LabTo
     const auto &is_var = this->get_standard_is_var();
     const ParsingTree2< SymTok, LabTok > &thesis_pt = this->get_parsed_sent2(ass.get_thesis());
     collect_variables2(thesis_pt, is_var, var_labs);
-    for (const auto hyp : ass.get_ess_hyps()) {
+    for (const auto &hyp : ass.get_ess_hyps()) {
         const ParsingTree2< SymTok, LabTok > &hyp_pt = this->get_parsed_sent2(hyp);
         collect_variables2(hyp_pt, is_var, var_labs);
     }
@@ -316,7 +413,7 @@ std::pair<std::vector<ParsingTree2<SymTok, LabTok> >, ParsingTree2<SymTok, LabTo
     // Substitute and return
     ParsingTree2< SymTok, LabTok > thesis_new_pt = ::substitute2_simple(thesis_pt, is_var, subst);
     std::vector< ParsingTree2< SymTok, LabTok > > hyps_new_pts;
-    for (const auto hyp : ass.get_ess_hyps()) {
+    for (const auto &hyp : ass.get_ess_hyps()) {
         const ParsingTree2< SymTok, LabTok > &hyp_pt = this->get_parsed_sent2(hyp);
         hyps_new_pts.push_back(::substitute2_simple(hyp_pt, is_var, subst));
     }
@@ -600,103 +697,258 @@ static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<Sy
 }
 #endif
 
-static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > unify_assertion_internal(const LibraryToolbox *self, const std::vector< std::pair< SymTok, ParsingTree<SymTok, LabTok > > > &pt_hyps, const std::pair< SymTok, ParsingTree< SymTok, LabTok > > &pt_thesis,
-                                                                                                                             bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists) {
-    std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, std::vector<SymTok> > > > ret;
-    const auto &is_var = self->get_standard_is_var();
-    for (const Assertion &ass : self->gen_assertions()) {
-        if (ass.is_usage_disc()) {
+static bool find_augmenting_path(const std::vector< std::vector< bool > > &compat, size_t i, std::vector< bool > &visited, std::vector< size_t > &match) {
+    for (size_t j = 0; j < compat.size(); j++) {
+        if (!compat[i][j] || visited[j]) {
             continue;
         }
-        if (ass.get_ess_hyps().size() != pt_hyps.size()) {
-            continue;
+        visited[j] = true;
+        if (match[j] == compat.size() || find_augmenting_path(compat, match[j], visited, match)) {
+            match[j] = i;
+            return true;
         }
-        if (pt_thesis.first != self->get_sentence(ass.get_thesis())[0]) {
-            continue;
+    }
+    return false;
+}
+
+// Kuhn's algorithm on a square compatibility matrix
+static bool has_perfect_matching(const std::vector< std::vector< bool > > &compat) {
+    std::vector< size_t > match(compat.size(), compat.size());
+    for (size_t i = 0; i < compat.size(); i++) {
+        std::vector< bool > visited(compat.size(), false);
+        if (!find_augmenting_path(compat, i, visited, match)) {
+            return false;
         }
-        UnilateralUnificator< SymTok, LabTok > unif(is_var);
-        auto &templ_pt = self->get_parsed_sent(ass.get_thesis());
-        unif.add_parsing_trees(templ_pt, pt_thesis.second);
-        if (!unif.is_unifiable()) {
-            continue;
+    }
+    return true;
+}
+
+// Whether each specified hypothesis from first on still has a compatible assertion hypothesis left
+static bool remaining_hyps_viable(const std::vector< std::vector< bool > > &compat, const std::vector< bool > &used, size_t first) {
+    for (size_t k = first; k < compat.size(); k++) {
+        bool viable = false;
+        for (size_t l = 0; l < compat.size(); l++) {
+            if (!used[l] && compat[k][l]) {
+                viable = true;
+                break;
+            }
         }
-        // We have to generate all the hypotheses' permutations; fortunately usually hypotheses are not many
-        // TODO Is there a better algorithm?
-        // The i-th specified hypothesis is matched with the perm[i]-th assertion hypothesis
-        std::vector< size_t > perm;
-        for (size_t i = 0; i < pt_hyps.size(); i++) {
-            perm.push_back(i);
+        if (!viable) {
+            return false;
         }
-        do {
-            auto unif2 = unif;
-            bool res = true;
-            for (size_t i = 0; i < pt_hyps.size(); i++) {
-                res = (pt_hyps[i].first == self->get_sentence(ass.get_ess_hyps()[perm[i]])[0]);
-                if (!res) {
-                    break;
-                }
-                auto &templ_pt = self->get_parsed_sent(ass.get_ess_hyps()[perm[i]]);
-                unif2.add_parsing_trees(templ_pt, pt_hyps[i].second);
-                res = unif2.is_unifiable();
-                if (!res) {
-                    break;
-                }
-            }
-            if (!res) {
+    }
+    return true;
+}
+
+// Check the distinct variable constraints of a complete assignment and record it if they are satisfied
+static bool emit_unification_result(const LibraryToolbox *self, const Assertion &ass, const FlatSubstMap2< SymTok, LabTok > &subst, const std::vector< size_t > &perm,
+                                    const std::set< std::pair< SymTok, SymTok > > &antidists, std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, std::vector<SymTok> > > > &ret) {
+    const auto &slots = subst.get_slots();
+    std::unordered_map< SymTok, std::vector< SymTok > > subst2;
+    for (size_t slot = 0; slot < slots.get_slots_num(); slot++) {
+        if (subst.is_bound(slot)) {
+            subst2.insert(make_pair(self->get_sentence(slots.get_var(slot)).at(1), self->reconstruct_sentence(subst.get(slot))));
+        }
+    }
+    VectorMap< SymTok, Sentence > subst3(subst2.begin(), subst2.end());
+    auto dists = propagate_dists< Sentence >(ass, subst3, *self);
+    if (!has_no_diagonal(dists.begin(), dists.end())) {
+        return false;
+    }
+    if (!is_disjoint(dists.begin(), dists.end(), antidists.begin(), antidists.end())) {
+        return false;
+    }
+    ret.emplace_back(ass.get_thesis(), perm, subst2);
+    return true;
+}
+
+/* Try to match the specified hypotheses and thesis with a single assertion, appending the
+ * results to ret; return true if the search can stop, because just_first is set and a result
+ * was found */
+static bool unify_assertion_candidate(const LibraryToolbox *self, LabTok label, const std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > &pt_hyps, const std::pair< SymTok, ParsingTree2< SymTok, LabTok > > &pt_thesis,
+                                      const std::vector< TreeFingerprint< LabTok > > &hyps_fps,
+                                      bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists, std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, std::vector<SymTok> > > > &ret) {
+    const auto is_var = self->get_standard_is_var_fast();
+    const Assertion &ass = self->get_assertion(label);
+    if (ass.is_usage_disc()) {
+        return false;
+    }
+    if (ass.get_ess_hyps().size() != pt_hyps.size()) {
+        return false;
+    }
+    if (pt_thesis.first != self->get_sentence(ass.get_thesis())[0]) {
+        return false;
+    }
+    const auto &ess_hyps = ass.get_ess_hyps();
+    const size_t hyps_num = pt_hyps.size();
+    /* The i-th specified hypothesis can be matched with the j-th assertion hypothesis only if they
+     * unify together with the thesis. If the resulting bipartite graph has no perfect matching there
+     * is nothing to try. The graph is first built comparing fingerprints, which rejects most
+     * candidates before any unificator is built, and then refined with actual unification. */
+    std::vector< std::vector< bool > > compat(hyps_num, std::vector< bool >(hyps_num, false));
+    for (size_t i = 0; i < hyps_num; i++) {
+        for (size_t j = 0; j < hyps_num; j++) {
+            if (pt_hyps[i].first != self->get_sentence(ess_hyps[j])[0]) {
                 continue;
             }
-            SubstMap< SymTok, LabTok > subst;
-            tie(res, subst) = unif2.unify();
-            if (!res) {
+            compat[i][j] = fingerprints_compatible(self->get_fingerprint(ess_hyps[j]), hyps_fps[i]);
+        }
+    }
+    if (!has_perfect_matching(compat)) {
+        return false;
+    }
+    // The variables of the assertion are given dense slots, and alternatives are explored rolling back to marks
+    const VarSlots< LabTok > slots(ass.get_float_hyps());
+    SlotUnilateralUnificator< SymTok, LabTok, StandardIsVar > unif(is_var, slots);
+    auto &templ_pt = self->get_parsed_sent2(ass.get_thesis());
+    unif.add_parsing_trees2(templ_pt, pt_thesis.second);
+    if (!unif.is_unifiable()) {
+        return false;
+    }
+    for (size_t i = 0; i < hyps_num; i++) {
+        for (size_t j = 0; j < hyps_num; j++) {
+            if (!compat[i][j]) {
                 continue;
             }
-            std::unordered_map< SymTok, std::vector< SymTok > > subst2;
-            for (auto &s : subst) {
-                subst2.insert(make_pair(self->get_sentence(s.first).at(1), self->reconstruct_sentence(s.second)));
+            auto mark = unif.mark();
+            unif.add_parsing_trees2(self->get_parsed_sent2(ess_hyps[j]), pt_hyps[i].second);
+            compat[i][j] = unif.is_unifiable();
+            unif.undo_to(mark);
+        }
+    }
+    if (!has_perfect_matching(compat)) {
+        return false;
+    }
+
+    /* Build the permutations by backtracking, in the same lexicographic order std::next_permutation
+     * would use: the i-th specified hypothesis is matched with the perm[i]-th assertion hypothesis.
+     * A partial assignment is abandoned as soon as it fails or leaves some of the remaining specified
+     * hypotheses without a compatible assertion hypothesis. When permutations are not requested, the
+     * search for this assertion stops at the first one that works. */
+    std::vector< size_t > perm(hyps_num);
+    std::vector< bool > used(hyps_num, false);
+    std::vector< size_t > next_j(hyps_num + 1, 0);
+    std::vector< SlotUnilateralUnificator< SymTok, LabTok, StandardIsVar >::Mark > marks(hyps_num);
+    size_t i = 0;
+    while (true) {
+        if (i == hyps_num) {
+            if (emit_unification_result(self, ass, unif.get_subst(), perm, antidists, ret) && (just_first || !up_to_hyps_perms)) {
+                return just_first;
             }
-            VectorMap< SymTok, Sentence > subst3(subst2.begin(), subst2.end());
-            auto dists = propagate_dists< Sentence >(ass, subst3, *self);
-            if (!has_no_diagonal(dists.begin(), dists.end())) {
-                continue;
+        } else {
+            bool advanced = false;
+            for (size_t j = next_j[i]; j < hyps_num; j++) {
+                if (used[j] || !compat[i][j]) {
+                    continue;
+                }
+                used[j] = true;
+                if (remaining_hyps_viable(compat, used, i + 1)) {
+                    marks[i] = unif.mark();
+                    unif.add_parsing_trees2(self->get_parsed_sent2(ess_hyps[j]), pt_hyps[i].second);
+                    if (unif.is_unifiable()) {
+                        perm[i] = j;
+                        next_j[i] = j + 1;
+                        advanced = true;
+                        break;
+                    }
+                    unif.undo_to(marks[i]);
+                }
+                used[j] = false;
             }
-            if (!is_disjoint(dists.begin(), dists.end(), antidists.begin(), antidists.end())) {
+            if (advanced) {
+                i++;
+                next_j[i] = 0;
                 continue;
             }
-            ret.emplace_back(ass.get_thesis(), perm, subst2);
-            if (just_first) {
-                return ret;
-            }
-            if (!up_to_hyps_perms) {
+        }
+        // Either a complete assignment was examined or position i has no more options: go back one position
+        if (i == 0) {
+            return false;
+        }
+        i--;
+        unif.undo_to(marks[i]);
+        used[perm[i]] = false;
+    }
+}
+
+// Below this number of candidates, spawning threads is not worth it
+static const size_t PARALLEL_UNIFICATION_MIN_CANDIDATES = 256;
+static const size_t PARALLEL_UNIFICATION_CHUNK = 16;
+
+static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > unify_assertion_internal(const LibraryToolbox *self, const std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > &pt_hyps, const std::pair< SymTok, ParsingTree2< SymTok, LabTok > > &pt_thesis,
+                                                                                                                             bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists, size_t threads_num) {
+    std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, std::vector<SymTok> > > > ret;
+    // Candidates are visited in label order, as a linear scan of the assertions would do
+    auto candidates = self->get_theses_index().retrieve(pt_thesis.second);
+    std::sort(candidates.begin(), candidates.end());
+    std::vector< TreeFingerprint< LabTok > > hyps_fps;
+    for (const auto &hyp : pt_hyps) {
+        hyps_fps.push_back(make_target_fingerprint(hyp.second));
+    }
+    if (threads_num == 0) {
+        threads_num = default_threads_num();
+    }
+    const size_t chunks_num = (candidates.size() + PARALLEL_UNIFICATION_CHUNK - 1) / PARALLEL_UNIFICATION_CHUNK;
+    threads_num = std::min(threads_num, chunks_num);
+    if (threads_num <= 1 || candidates.size() < PARALLEL_UNIFICATION_MIN_CANDIDATES) {
+        for (const auto &label : candidates) {
+            if (unify_assertion_candidate(self, label, pt_hyps, pt_thesis, hyps_fps, just_first, up_to_hyps_perms, antidists, ret)) {
                 break;
             }
-        } while (std::next_permutation(perm.begin(), perm.end()));
+        }
+        return ret;
     }
 
+    /* Workers take chunks of candidates in increasing order and store the results of each one in its
+     * own slot, so that merging them gives the same order as the serial scan. When just_first is set,
+     * first_found is the lowest candidate that produced a result: candidates after it cannot contribute
+     * and are skipped, while all those before it are still processed by someone. */
+    std::vector< std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, std::vector<SymTok> > > > > results(candidates.size());
+    std::atomic< size_t > first_found(candidates.size());
+    parallel_for(chunks_num, threads_num, [&](size_t chunk) {
+        size_t begin = chunk * PARALLEL_UNIFICATION_CHUNK;
+        size_t end = std::min(begin + PARALLEL_UNIFICATION_CHUNK, candidates.size());
+        for (size_t idx = begin; idx < end && idx < first_found.load(); idx++) {
+            if (unify_assertion_candidate(self, candidates[idx], pt_hyps, pt_thesis, hyps_fps, just_first, up_to_hyps_perms, antidists, results[idx])) {
+                size_t cur = first_found.load();
+                while (idx < cur && !first_found.compare_exchange_weak(cur, idx)) {}
+                break;
+            }
+        }
+    });
+    for (auto &res : results) {
+        for (auto &x : res) {
+            ret.push_back(std::move(x));
+            if (just_first) {
+                return ret;
+            }
+        }
+    }
     return ret;
 }
 
-static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > unify_assertion_internal(const LibraryToolbox *self, const std::vector<Sentence> &hypotheses, const Sentence &thesis, bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists)
+static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > unify_assertion_internal(const LibraryToolbox *self, const std::vector<Sentence> &hypotheses, const Sentence &thesis, bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists, size_t threads_num)
 {
     // Parse inputs
-    std::vector< std::pair< SymTok, ParsingTree< SymTok, LabTok > > > pt_hyps;
+    std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > pt_hyps;
     for (auto &hyp : hypotheses) {
-        auto pt = self->parse_sentence(hyp.begin()+1, hyp.end(), self->get_turnstile_alias());
-        if (pt.label == LabTok{}) {
+        auto pt = self->parse_sentence2(hyp.begin()+1, hyp.end(), self->get_turnstile_alias());
+        if (pt.get_nodes_len() == 0) {
             return {};
         }
         pt_hyps.push_back(std::make_pair(hyp[0], pt));
     }
-    auto pt_thesis = std::make_pair(thesis[0], self->parse_sentence(thesis.begin()+1, thesis.end(), self->get_turnstile_alias()));
-    if (pt_thesis.second.label == LabTok{}) {
+    auto pt_thesis = std::make_pair(thesis[0], self->parse_sentence2(thesis.begin()+1, thesis.end(), self->get_turnstile_alias()));
+    if (pt_thesis.second.get_nodes_len() == 0) {
         return {};
     }
 
-    return unify_assertion_internal(self, pt_hyps, pt_thesis, just_first, up_to_hyps_perms, antidists);
+    return self->unify_assertion(pt_hyps, pt_thesis, just_first, up_to_hyps_perms, antidists, threads_num);
 }
 
-std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > LibraryToolbox::unify_assertion(const std::vector<Sentence> &hypotheses, const Sentence &thesis, bool just_first, bool up_to_hyps_perms, const std::set<std::pair<SymTok, SymTok> > &antidists) const
+std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > LibraryToolbox::unify_assertion(const std::vector<Sentence> &hypotheses, const Sentence &thesis, bool just_first, bool up_to_hyps_perms, const std::set<std::pair<SymTok, SymTok> > &antidists, size_t threads_num) const
 {
-    auto ret2 = unify_assertion_internal(this, hypotheses, thesis, just_first, up_to_hyps_perms, antidists);
+    auto ret2 = unify_assertion_internal(this, hypotheses, thesis, just_first, up_to_hyps_perms, antidists, threads_num);
 #ifdef TOOLBOX_SELF_TEST
     auto ret = unify_assertion_internal_old(this, hypotheses, thesis, just_first, up_to_hyps_perms);
     assert(ret == ret2);
@@ -704,15 +956,163 @@ std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, S
     return ret2;
 }
 
-std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > LibraryToolbox::unify_assertion(const std::vector<std::pair<SymTok, ParsingTree<SymTok, LabTok> > > &hypotheses, const std::pair<SymTok, ParsingTree<SymTok, LabTok> > &thesis, bool just_first, bool up_to_hyps_perms, const std::set<std::pair<SymTok, SymTok> > &antidists) const
+std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > LibraryToolbox::unify_assertion(const std::vector<std::pair<SymTok, ParsingTree<SymTok, LabTok> > > &hypotheses, const std::pair<SymTok, ParsingTree<SymTok, LabTok> > &thesis, bool just_first, bool up_to_hyps_perms, const std::set<std::pair<SymTok, SymTok> > &antidists, size_t threads_num) const
 {
-    return unify_assertion_internal(this, hypotheses, thesis, just_first, up_to_hyps_perms, antidists);
+    std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > pt_hyps;
+    for (const auto &hyp : hypotheses) {
+        pt_hyps.push_back(std::make_pair(hyp.first, pt_to_pt2(hyp.second)));
+    }
+    return this->unify_assertion(pt_hyps, std::make_pair(thesis.first, pt_to_pt2(thesis.second)), just_first, up_to_hyps_perms, antidists, threads_num);
+}
+
+bool LibraryToolbox::unify_assertion_stream(const std::vector<std::pair<SymTok, ParsingTree2<SymTok, LabTok> > > &hypotheses, const std::pair<SymTok, ParsingTree2<SymTok, LabTok> > &thesis,
+                                            const std::function<bool (const std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > &)> &callback,
+                                            bool up_to_hyps_perms, const std::set<std::pair<SymTok, SymTok> > &antidists, const std::function<bool ()> &should_stop) const
+{
+    // Candidates are sorted by the total number of symbols of the assertion, breaking ties by label
+    std::vector< std::pair< size_t, LabTok > > candidates;
+    for (const auto &label : this->get_theses_index().retrieve(thesis.second)) {
+        const Assertion &ass = this->get_assertion(label);
+        if (ass.get_ess_hyps().size() != hypotheses.size()) {
+            continue;
+        }
+        size_t size = this->get_sentence(ass.get_thesis()).size();
+        for (const auto &hyp : ass.get_ess_hyps()) {
+            size += this->get_sentence(hyp).size();
+        }
+        candidates.push_back(std::make_pair(size, label));
+    }
+    std::sort(candidates.begin(), candidates.end());
+    std::vector< TreeFingerprint< LabTok > > hyps_fps;
+    for (const auto &hyp : hypotheses) {
+        hyps_fps.push_back(make_target_fingerprint(hyp.second));
+    }
+
+    std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, std::vector<SymTok> > > > results;
+    for (const auto &candidate : candidates) {
+        if (should_stop && should_stop()) {
+            return false;
+        }
+        results.clear();
+        unify_assertion_candidate(this, candidate.second, hypotheses, thesis, hyps_fps, false, up_to_hyps_perms, antidists, results);
+        for (const auto &res : results) {
+            if (!callback(res)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Variables are marked in canonical keys and results by setting the highest bit, which
+ * is never set in actual symbols and labels */
+static const uint32_t CANONICAL_VAR_MARKER = 0x80000000;
+
+static void canonicalize_unification_tree(const LibraryToolbox *self, const std::pair< SymTok, ParsingTree2< SymTok, LabTok > > &pt, std::vector< uint32_t > &key,
+                                          std::unordered_map< LabTok, uint32_t > &var_idxs, std::vector< LabTok > &vars) {
+    const auto is_var = self->get_standard_is_var_fast();
+    key.push_back(pt.first.val());
+    key.push_back(static_cast< uint32_t >(pt.second.get_nodes_len()));
+    for (size_t i = 0; i < pt.second.get_nodes_len(); i++) {
+        const LabTok label = pt.second.get_nodes()[i].label;
+        if (is_var(label)) {
+            auto it = var_idxs.find(label);
+            if (it == var_idxs.end()) {
+                it = var_idxs.insert(std::make_pair(label, static_cast< uint32_t >(vars.size()))).first;
+                vars.push_back(label);
+            }
+            key.push_back(CANONICAL_VAR_MARKER | it->second);
+            key.push_back(self->get_var_lab_to_type_sym(label).val());
+        } else {
+            key.push_back(label.val());
+        }
+    }
+}
+
+static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > rename_unification_results(const std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > &results,
+                                                                                                                               const std::function< SymTok(SymTok) > &rename) {
+    auto ret = results;
+    for (auto &res : ret) {
+        for (auto &x : std::get<2>(res)) {
+            for (auto &sym : x.second) {
+                sym = rename(sym);
+            }
+        }
+    }
+    return ret;
+}
+
+std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > LibraryToolbox::unify_assertion(const std::vector<std::pair<SymTok, ParsingTree2<SymTok, LabTok> > > &hypotheses, const std::pair<SymTok, ParsingTree2<SymTok, LabTok> > &thesis, bool just_first, bool up_to_hyps_perms, const std::set<std::pair<SymTok, SymTok> > &antidists, size_t threads_num) const
+{
+    // Build the canonical key; the number of threads does not affect the results, so it is not part of it
+    std::vector< uint32_t > key;
+    std::unordered_map< LabTok, uint32_t > var_idxs;
+    std::vector< LabTok > vars;
+    key.push_back(just_first);
+    key.push_back(up_to_hyps_perms);
+    key.push_back(static_cast< uint32_t >(hypotheses.size()));
+    for (const auto &hyp : hypotheses) {
+        canonicalize_unification_tree(this, hyp, key, var_idxs, vars);
+    }
+    canonicalize_unification_tree(this, thesis, key, var_idxs, vars);
+    std::unordered_map< SymTok, uint32_t > sym_idxs;
+    for (size_t i = 0; i < vars.size(); i++) {
+        sym_idxs.insert(std::make_pair(this->get_var_lab_to_sym(vars[i]), static_cast< uint32_t >(i)));
+    }
+    // Antidistinct pairs involving variables that do not appear in the query cannot affect the result
+    std::vector< std::pair< uint32_t, uint32_t > > canonical_antidists;
+    for (const auto &antidist : antidists) {
+        auto it1 = sym_idxs.find(antidist.first);
+        auto it2 = sym_idxs.find(antidist.second);
+        if (it1 != sym_idxs.end() && it2 != sym_idxs.end()) {
+            canonical_antidists.push_back(std::make_pair(it1->second, it2->second));
+        }
+    }
+    std::sort(canonical_antidists.begin(), canonical_antidists.end());
+    key.push_back(static_cast< uint32_t >(canonical_antidists.size()));
+    for (const auto &antidist : canonical_antidists) {
+        key.push_back(antidist.first);
+        key.push_back(antidist.second);
+    }
+
+    std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > cached;
+    if (this->unification_cache.get(key, cached)) {
+        return rename_unification_results(cached, [&](SymTok sym) {
+            return (sym.val() & CANONICAL_VAR_MARKER) ? this->get_var_lab_to_sym(vars.at(sym.val() & ~CANONICAL_VAR_MARKER)) : sym;
+        });
+    }
+    auto ret = unify_assertion_internal(this, hypotheses, thesis, just_first, up_to_hyps_perms, antidists, threads_num);
+    this->unification_cache.put(key, rename_unification_results(ret, [&](SymTok sym) {
+        auto it = sym_idxs.find(sym);
+        return it != sym_idxs.end() ? SymTok(CANONICAL_VAR_MARKER | it->second) : sym;
+    }));
+    return ret;
+}
+
+LRUCacheStats LibraryToolbox::get_unification_cache_stats() const
+{
+    return this->unification_cache.get_stats();
+}
+
+void LibraryToolbox::set_unification_cache_capacity(size_t capacity) const
+{
+    this->unification_cache.set_capacity(capacity);
+}
+
+void LibraryToolbox::clear_unification_cache() const
+{
+    this->unification_cache.clear();
 }
 
 const std::function<bool (LabTok)> &LibraryToolbox::get_standard_is_var() const {
     return this->standard_is_var;
 }
 
+StandardIsVar LibraryToolbox::get_standard_is_var_fast() const
+{
+    return StandardIsVar{ this->is_var_words.data(), this->is_var_by_type.size() };
+}
+
 const std::function<bool (SymTok)> &LibraryToolbox::get_standard_is_var_sym() const
 {
     return this->standard_is_var_sym;
@@ -782,11 +1182,91 @@ void LibraryToolbox::compute_everything()
     this->compute_parser_initialization();
     this->compute_sentences_parsing();
     this->compute_labels_to_theses();
+    this->compute_theses_index();
+    this->compute_fingerprints();
     this->compute_registered_provers();
     this->compute_vars();
+    if (this->cache != nullptr && !this->cache_loaded) {
+        this->store_cache();
+    }
+    // Drop the cache so that memory can be recovered, unless we are using data that lives in it
+    if (!this->cache_loaded) {
+        this->cache = nullptr;
+    }
     //toc(t, 1);
 }
 
+/* The digest covers everything the cached data depends on: the grammar (and which parser
+ * it selects), the statements and hypotheses of all labels (which determine both the
+ * parsing trees and the resolution of registered provers) and the registered provers'
+ * templates. */
+std::string LibraryToolbox::compute_cache_digest() const
+{
+    HashSink hasher;
+    auto write_u64 = [&hasher](uint64_t x) {
+        hasher.write(reinterpret_cast< const char* >(&x), sizeof(x));
+    };
+    auto write_string = [&hasher,&write_u64](const std::string &x) {
+        write_u64(x.size());
+        hasher.write(x.data(), x.size());
+    };
+    auto write_labels = [&hasher,&write_u64](const std::vector< LabTok > &x) {
+        write_u64(x.size());
+        hasher.write(reinterpret_cast< const char* >(x.data()), x.size() * sizeof(LabTok));
+    };
+    write_string(hash_object(this->get_derivations()));
+    write_u64(this->parse_from_proofs);
+    write_string(this->get_parsing_addendum().get_unambiguous());
+    write_u64(this->get_symbols_num());
+    write_u64(this->get_labels_num());
+    for (LabTok label : this->gen_labels()) {
+        const Sentence &sent = this->get_sentence(label);
+        write_u64(sent.size());
+        hasher.write(reinterpret_cast< const char* >(sent.data()), sent.size() * sizeof(SymTok));
+        const Assertion *ass = this->lib.get_assertion_ptr(label);
+        bool valid = ass != nullptr && ass->is_valid();
+        write_u64(valid);
+        if (valid) {
+            write_labels(ass->get_float_hyps());
+            write_labels(ass->get_ess_hyps());
+        }
+    }
+    write_u64(LibraryToolbox::registered_provers().size());
+    for (const auto &data : LibraryToolbox::registered_provers()) {
+        write_u64(data.templ_hyps.size());
+        for (const auto &hyp : data.templ_hyps) {
+            write_string(hyp);
+        }
+        write_string(data.templ_thesis);
+    }
+    return hasher.get_digest();
+}
+
+void LibraryToolbox::store_cache()
+{
+    const size_t labels_num = this->get_labels_num();
+    std::vector< uint64_t > ranges(2 * (labels_num + 1));
+    for (size_t idx = 1; idx <= labels_num; idx++) {
+        const auto &pt2 = this->parsed_sents2[idx];
+        ranges[2*idx] = pt2.get_nodes_len() == 0 ? 0 : pt2.get_nodes() - this->parsed_nodes.data();
+        ranges[2*idx+1] = pt2.get_nodes_len();
+    }
+    ToolboxCacheData data;
+    if (this->lr_parser != nullptr) {
+        data.automaton = this->lr_parser->get_automaton_view();
+    }
+    data.parsed_nodes = this->parsed_nodes.data();
+    data.parsed_nodes_num = this->parsed_nodes.size();
+    data.parsed_ranges = ranges.data();
+    data.parsed_ranges_num = ranges.size();
+    data.registered_provers = this->instance_registered_provers;
+    this->cache->set_digest(this->compute_cache_digest());
+    this->cache->set_data(data);
+    if (!this->cache->store()) {
+        std::cerr << "Could not store the toolbox cache" << std::endl;
+    }
+}
+
 /*const std::vector<LabTok> &LibraryToolbox::get_type_labels() const
 {
     return this->type_labels;
@@ -850,10 +1330,15 @@ SymTok LibraryToolbox::get_var_lab_to_type_sym(LabTok lab) const
 void LibraryToolbox::compute_is_var_by_type()
 {
     const auto &types_set = this->get_final_stack_frame().types_set;
-    this->is_var_by_type.resize(this->lib.get_labels_num());
+    // Labels start from 1
+    this->is_var_by_type.resize(this->lib.get_labels_num() + 1);
     for (LabTok label : this->gen_labels()) {
         this->is_var_by_type[label.val()] = (types_set.find(label) != types_set.end() && !this->is_constant(this->get_sentence(label).at(1)));
     }
+    this->is_var_words.assign((this->is_var_by_type.size() + 63) / 64, 0);
+    for (size_t i = 0; i < this->is_var_by_type.size(); i++) {
+        this->is_var_words[i / 64] |= static_cast< uint64_t >(this->is_var_by_type[i]) << (i % 64);
+    }
 }
 
 const std::vector<bool> &LibraryToolbox::get_is_var_by_type() const
@@ -944,54 +1429,210 @@ RegisteredProver LibraryToolbox::register_prover(const std::vector<std::string>
 
 void LibraryToolbox::compute_registered_provers()
 {
+    if (this->cache_loaded) {
+        this->instance_registered_provers = this->cache->get_data().registered_provers;
+        for (auto &inst_data : this->instance_registered_provers) {
+            if (inst_data.valid) {
+                inst_data.label_str = this->resolve_label(inst_data.label);
+            }
+        }
+        return;
+    }
     for (size_t index = 0; index < LibraryToolbox::registered_provers().size(); index++) {
         this->compute_registered_prover(index, false);
     }
     //cerr << "Computed " << LibraryToolbox::registered_provers().size() << " registered provers" << endl;
 }
 
+/* Check that the parsing trees in the cache are well formed, so that walking them never
+ * gets out of the nodes array: each range must lie in the array, the root of each tree must
+ * span exactly its range and the subtree of each node must lie in the subtree of its parent. */
+static bool check_cached_parsed_trees(const ToolboxCacheData &data) {
+    if (data.parsed_ranges_num % 2 != 0) {
+        return false;
+    }
+    std::vector< uint64_t > ends;
+    for (size_t i = 0; i < data.parsed_ranges_num; i += 2) {
+        uint64_t offset = data.parsed_ranges[i];
+        uint64_t len = data.parsed_ranges[i+1];
+        if (offset > data.parsed_nodes_num || len > data.parsed_nodes_num - offset) {
+            return false;
+        }
+        if (len == 0) {
+            continue;
+        }
+        const ParsingTreeNode< SymTok, LabTok > *nodes = data.parsed_nodes + offset;
+        if (static_cast< uint64_t >(nodes[0].descendants_num) + 1 != len) {
+            return false;
+        }
+        ends.clear();
+        ends.push_back(len);
+        for (uint64_t j = 0; j < len; j++) {
+            while (ends.back() <= j) {
+                ends.pop_back();
+            }
+            uint64_t end = j + 1 + nodes[j].descendants_num;
+            if (end > ends.back()) {
+                return false;
+            }
+            ends.push_back(end);
+        }
+    }
+    return true;
+}
+
 void LibraryToolbox::compute_parser_initialization()
 {
     std::function< std::ostream&(std::ostream&, SymTok) > sym_printer = [&](std::ostream &os, SymTok sym)->std::ostream& { return os << this->resolve_symbol(sym); };
     std::function< std::ostream&(std::ostream&, LabTok) > lab_printer = [&](std::ostream &os, LabTok lab)->std::ostream& { return os << this->resolve_label(lab); };
     const auto &ders = this->get_derivations();
-    std::string ders_digest = hash_object(ders);
-    this->parser = std::make_unique< LRParser< SymTok, LabTok > >(ders, sym_printer, lab_printer);
-    bool loaded = false;
-    if (this->cache != nullptr) {
-        if (this->cache->load()) {
-            if (ders_digest == this->cache->get_digest()) {
-                this->parser->set_cached_data(this->cache->get_lr_parser_data());
-                loaded = true;
+    const std::string &unambiguous = this->get_parsing_addendum().get_unambiguous();
+    if (unambiguous.compare(0, 3, "klr") == 0) {
+        auto lr_parser = std::make_unique< LRParser< SymTok, LabTok > >(ders, sym_printer, lab_printer);
+        this->lr_parser = lr_parser.get();
+        this->parser = std::move(lr_parser);
+    } else {
+        this->lr_parser = nullptr;
+        this->parser = std::make_unique< EarleyParser< SymTok, LabTok > >(ders);
+    }
+    this->cache_loaded = false;
+    if (this->cache != nullptr && this->cache->load() && this->cache->get_digest() == this->compute_cache_digest()) {
+        const auto &data = this->cache->get_data();
+        if (data.parsed_ranges_num == 2 * (this->get_labels_num() + 1) &&
+                data.registered_provers.size() == LibraryToolbox::registered_provers().size() &&
+                check_cached_parsed_trees(data)) {
+            // The parser works directly on the tables in the cache, without copying them
+            if (this->lr_parser != nullptr) {
+                this->lr_parser->set_automaton_view(data.automaton);
             }
+            this->cache_loaded = true;
         }
     }
-    if (!loaded) {
-        std::cerr << "No or invalide parser cache found; re-initializing parser..." << std::endl;
-        this->parser->initialize();
-        if (this->cache != nullptr) {
-            this->cache->set_digest(ders_digest);
-            this->cache->set_lr_parser_data(this->parser->get_cached_data());
-            this->cache->store();
-        }
+    if (!this->cache_loaded && this->lr_parser != nullptr) {
+        std::cerr << "No or invalide toolbox cache found; re-initializing parser..." << std::endl;
+        auto t = tic();
+        this->lr_parser->initialize();
+        toc(t, 1);
     }
-    // Drop the cache so that memory can be recovered
-    this->cache = nullptr;
 }
 
-const LRParser<SymTok, LabTok> &LibraryToolbox::get_parser() const
+const Parser<SymTok, LabTok> &LibraryToolbox::get_parser() const
 {
     return *this->parser;
 }
 
+bool LibraryToolbox::is_lr_parser() const
+{
+    return this->lr_parser != nullptr;
+}
+
 ParsingTree< SymTok, LabTok > LibraryToolbox::parse_sentence(typename Sentence::const_iterator sent_begin, typename Sentence::const_iterator sent_end, SymTok type) const
 {
-    return this->get_parser().parse(sent_begin, sent_end, type);
+    auto pt2 = this->parse_sentence2(sent_begin, sent_end, type);
+    if (pt2.get_nodes_len() == 0) {
+        return {};
+    }
+    return pt2_to_pt(pt2);
 }
 
 ParsingTree< SymTok, LabTok > LibraryToolbox::parse_sentence(const Sentence &sent, SymTok type) const
 {
-    return this->get_parser().parse(sent, type);
+    return this->parse_sentence(sent.begin(), sent.end(), type);
+}
+
+/* Sentences coming from the outside (for example from the steps of the web UI) are often
+ * parsed many times, so results are kept in the parse cache, whose key is the sentence
+ * with the type prepended; failures are cached as well, as empty trees. Trees are kept in
+ * their compact form, which makes room for about a third more of them. */
+ParsingTree2< SymTok, LabTok > LibraryToolbox::parse_sentence2(typename Sentence::const_iterator sent_begin, typename Sentence::const_iterator sent_end, SymTok type) const
+{
+    Sentence key;
+    key.reserve(sent_end - sent_begin + 1);
+    key.push_back(type);
+    key.insert(key.end(), sent_begin, sent_end);
+    CompactParsingTree< SymTok, LabTok > cached;
+    if (this->parse_cache.get(key, cached)) {
+        return cached.expand([this](LabTok lab) { return this->get_label_type(lab); });
+    }
+    ParsingTree2< SymTok, LabTok > ret;
+    auto pt = this->get_parser().parse(sent_begin, sent_end, type);
+    if (pt.label != LabTok{}) {
+        ret = pt_to_pt2(pt);
+    }
+    this->parse_cache.put(key, CompactParsingTree< SymTok, LabTok >(ret));
+    return ret;
+}
+
+void LibraryToolbox::parse_sentences(const std::vector< std::pair< Sentence, SymTok > > &sents, const std::function< void(size_t, const ParsingTree2< SymTok, LabTok >&) > &callback, size_t threads_num) const
+{
+    if (threads_num == 0) {
+        threads_num = default_threads_num();
+    }
+    threads_num = std::min(threads_num, sents.size());
+    std::vector< ParsingTree2< SymTok, LabTok > > results(sents.size());
+    std::vector< bool > ready(sents.size());
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::atomic< size_t > next_idx(0);
+    std::atomic< bool > stop(false);
+    // The calling thread (number zero) delivers the results in order, while the other ones parse
+    run_on_threads(threads_num + 1, [&](size_t thread_idx) {
+        if (thread_idx == 0) {
+            try {
+                for (size_t idx = 0; idx < sents.size(); idx++) {
+                    ParsingTree2< SymTok, LabTok > pt2;
+                    {
+                        std::unique_lock< std::mutex > lock(mutex);
+                        cond.wait(lock, [&]() { return ready[idx] || stop; });
+                        if (!ready[idx]) {
+                            break;
+                        }
+                        pt2 = results[idx];
+                        results[idx] = ParsingTree2< SymTok, LabTok >();
+                    }
+                    callback(idx, pt2);
+                }
+            } catch (...) {
+                stop = true;
+                throw;
+            }
+            return;
+        }
+        try {
+            size_t idx;
+            while (!stop && (idx = next_idx++) < sents.size()) {
+                auto pt2 = this->parse_sentence2(sents[idx].first.begin(), sents[idx].first.end(), sents[idx].second);
+                std::unique_lock< std::mutex > lock(mutex);
+                results[idx] = pt2;
+                ready[idx] = true;
+                cond.notify_all();
+            }
+        } catch (...) {
+            std::unique_lock< std::mutex > lock(mutex);
+            stop = true;
+            cond.notify_all();
+            throw;
+        }
+    });
+}
+
+std::vector< ParsingTree2< SymTok, LabTok > > LibraryToolbox::parse_sentences(const std::vector< std::pair< Sentence, SymTok > > &sents, size_t threads_num) const
+{
+    std::vector< ParsingTree2< SymTok, LabTok > > ret(sents.size());
+    this->parse_sentences(sents, [&ret](size_t idx, const ParsingTree2< SymTok, LabTok > &pt2) {
+        ret[idx] = pt2;
+    }, threads_num);
+    return ret;
+}
+
+LRUCacheStats LibraryToolbox::get_parse_cache_stats() const
+{
+    return this->parse_cache.get_stats();
+}
+
+void LibraryToolbox::set_parse_cache_capacity(size_t capacity) const
+{
+    this->parse_cache.set_capacity(capacity);
 }
 
 ParsingTree<SymTok, LabTok> LibraryToolbox::parse_sentence(const Sentence &sent) const
@@ -1004,26 +1645,214 @@ void LibraryToolbox::compute_sentences_parsing()
     /*if (!this->parser_initialization_computed) {
         this->compute_parser_initialization();
     }*/
+    const size_t labels_num = this->get_labels_num();
+
+    // If the cache was loaded the trees are already available in it, and were checked when the cache was accepted
+    if (this->cache_loaded) {
+        const auto &data = this->cache->get_data();
+        this->parsed_nodes.clear();
+        this->parsed_sents2.clear();
+        this->parsed_sents2.resize(labels_num + 1);
+        for (size_t idx = 1; idx <= labels_num; idx++) {
+            uint64_t offset = data.parsed_ranges[2*idx];
+            uint64_t len = data.parsed_ranges[2*idx+1];
+            this->parsed_sents2[idx] = ParsingTree2< SymTok, LabTok >(data.parsed_nodes + offset, len);
+        }
+        this->parsed_sents = std::vector< std::atomic< const ParsingTree< SymTok, LabTok >* > >(labels_num + 1);
+        return;
+    }
+
+    // Identical sentences are parsed only once, the first time they appear
+    auto sent_hash = [](const Sentence *sent) { return boost::hash_range(sent->begin(), sent->end()); };
+    auto sent_eq = [](const Sentence *x, const Sentence *y) { return *x == *y; };
+    std::unordered_map< const Sentence*, LabTok, decltype(sent_hash), decltype(sent_eq) > sents_idx(labels_num, sent_hash, sent_eq);
+    std::vector< LabTok > first_occurrence(labels_num + 1);
     for (LabTok label : this->gen_labels()) {
-        const Sentence &sent = this->get_sentence(label);
-        auto pt = this->parse_sentence(sent.begin()+1, sent.end(), this->get_parsing_addendum().get_syntax().at(sent[0]));
-        if (pt.label == LabTok{}) {
-            throw MMPPException("Failed to parse a sentence in the library");
-        }
-        this->parsed_sents.resize(label.val()+1);
-        this->parsed_sents[label.val()] = pt;
-        this->parsed_sents2.resize(label.val()+1);
-        this->parsed_sents2[label.val()] = pt_to_pt2(pt);
-        this->parsed_iters.resize(label.val()+1);
-        ParsingTreeMultiIterator< SymTok, LabTok > it = this->parsed_sents2[label.val()].get_multi_iterator();
-        while (true) {
-            auto x = it.next();
-            this->parsed_iters[label.val()].push_back(x);
-            if (x.first == it.Finished) {
-                break;
+        first_occurrence[label.val()] = sents_idx.insert(std::make_pair(&this->get_sentence(label), label)).first->second;
+    }
+    sents_idx.clear();
+
+    /* Labels are distributed to the threads in order; when a proof is executed, the
+     * sentences it refers to come before its thesis, so they have already been taken
+     * by some thread and we just have to wait for them to be ready (see parallel_for()
+     * for why waiting only for earlier labels cannot deadlock). */
+    this->parsed_sents2.clear();
+    this->parsed_sents2.resize(labels_num + 1);
+    std::mutex ready_mutex;
+    std::condition_variable ready_cond;
+    std::vector< bool > ready(labels_num + 1);
+    bool failed = false;
+    auto wait_parsed = [&](LabTok label, size_t waiting_idx) {
+        if (label.val() > labels_num) {
+            return;
+        }
+        assert_or_throw< MMPPException >(label.val() < waiting_idx, "A sentence depends on a later one");
+        std::unique_lock< std::mutex > lock(ready_mutex);
+        ready_cond.wait(lock, [&]() { return ready[label.val()] || failed; });
+        assert_or_throw< MMPPException >(ready[label.val()], "Parsing the library was interrupted");
+    };
+    parallel_for(labels_num, 0, [&](size_t i) {
+        size_t idx = i + 1;
+        try {
+            LabTok label(static_cast< LabTok::val_type >(idx));
+            LabTok first = first_occurrence[idx];
+            auto &pt2 = this->parsed_sents2[idx];
+            if (first != label) {
+                wait_parsed(first, idx);
+                const auto &first_pt2 = this->parsed_sents2[first.val()];
+                pt2 = ParsingTree2< SymTok, LabTok >(first_pt2.get_nodes(), first_pt2.get_nodes_len());
+            } else {
+                bool from_proof = false;
+                if (this->parse_from_proofs) {
+                    const Assertion &ass = this->get_assertion(label);
+                    if (ass.is_valid() && ass.is_theorem() && ass.has_proof()) {
+                        from_proof = this->parse_sentence_from_proof(ass, pt2, [&](LabTok dep) { wait_parsed(dep, idx); });
+                    }
+                }
+                if (!from_proof) {
+                    const Sentence &sent = this->get_sentence(label);
+                    // Library sentences do not go through the parse cache, which is meant for new sentences
+                    auto pt = this->get_parser().parse(sent.begin()+1, sent.end(), this->get_parsing_addendum().get_syntax().at(sent[0]));
+                    assert_or_throw< MMPPException >(pt.label != LabTok{}, "Failed to parse a sentence in the library");
+                    pt2 = pt_to_pt2(pt);
+                }
+            }
+            {
+                std::unique_lock< std::mutex > lock(ready_mutex);
+                ready[idx] = true;
+            }
+            ready_cond.notify_all();
+        } catch (...) {
+            // Threads waiting for this sentence must not wait forever
+            {
+                std::unique_lock< std::mutex > lock(ready_mutex);
+                failed = true;
             }
+            ready_cond.notify_all();
+            throw;
+        }
+    });
+
+    /* Move all the trees to the arena, replacing them with views; the trees of duplicate
+     * sentences were already views on the first occurrence, so they are only re-pointed. */
+    size_t nodes_num = 0;
+    for (size_t idx = 1; idx <= labels_num; idx++) {
+        if (first_occurrence[idx].val() == idx) {
+            nodes_num += this->parsed_sents2[idx].get_nodes_len();
+        }
+    }
+    this->parsed_nodes = std::vector< ParsingTreeNode< SymTok, LabTok > >();
+    this->parsed_nodes.reserve(nodes_num);
+    for (size_t idx = 1; idx <= labels_num; idx++) {
+        size_t first = first_occurrence[idx].val();
+        if (first == idx) {
+            auto &pt2 = this->parsed_sents2[idx];
+            size_t offset = this->parsed_nodes.size();
+            this->parsed_nodes.insert(this->parsed_nodes.end(), pt2.get_nodes(), pt2.get_nodes() + pt2.get_nodes_len());
+            pt2 = ParsingTree2< SymTok, LabTok >(this->parsed_nodes.data() + offset, this->parsed_nodes.size() - offset);
+        } else {
+            this->parsed_sents2[idx] = this->parsed_sents2[first];
+        }
+    }
+    this->parsed_sents = std::vector< std::atomic< const ParsingTree< SymTok, LabTok >* > >(labels_num + 1);
+
+    // Teach the parser which reductions are more likely, so that later parses backtrack less
+    if (this->lr_parser == nullptr) {
+        return;
+    }
+    std::unordered_map< LabTok, size_t > label_freqs;
+    for (const auto &pt2 : this->parsed_sents2) {
+        for (size_t i = 0; i < pt2.get_nodes_len(); i++) {
+            label_freqs[pt2.get_nodes()[i].label]++;
         }
     }
+    this->lr_parser->sort_reductions(label_freqs);
+}
+
+/* Execute the proof of a theorem on parsing trees: since the floating hypotheses of each
+ * step are filled with the syntax subproofs of its terms, the tree that ends up on the
+ * stack is the parsing tree of the thesis, and there is no need to run the parser on it.
+ * The result is accepted only if it actually reconstructs the thesis; otherwise (for
+ * example for incomplete or broken proofs) false is returned and the caller falls back
+ * to the parser.
+ */
+bool LibraryToolbox::parse_sentence_from_proof(const Assertion &ass, ParsingTree2<SymTok, LabTok> &pt2, const std::function< void(LabTok) > &wait_parsed) const
+{
+    // Lazy proofs are not kept after parsing, so that they do not all stay in memory
+    auto proof = ass.decode_proof();
+    if (proof == nullptr) {
+        return false;
+    }
+    // Only sentences that come before the thesis can be used
+    auto is_earlier = [&ass](LabTok label) { return label.val() < ass.get_thesis().val(); };
+    ProofEngineImpl< ParsingTree2< SymTok, LabTok > > engine(*this);
+    // Wait for the sentences that the proof engine will look at when processing a label
+    auto process_label = [&](LabTok label) {
+        wait_parsed(label);
+        try {
+            const Assertion &child_ass = this->get_assertion(label);
+            if (child_ass.is_valid()) {
+                for (const auto &hyp : child_ass.get_float_hyps()) {
+                    wait_parsed(hyp);
+                }
+                for (const auto &hyp : child_ass.get_ess_hyps()) {
+                    wait_parsed(hyp);
+                }
+            }
+        } catch (std::out_of_range&) {
+        }
+        engine.process_label(label);
+    };
+    try {
+        if (auto comp_proof = dynamic_cast< const CompressedProof* >(proof.get())) {
+            const auto &refs = comp_proof->get_refs();
+            if (!std::all_of(refs.begin(), refs.end(), is_earlier)) {
+                return false;
+            }
+            for (const auto &code : comp_proof->get_codes()) {
+                if (code == CodeTok{}) {
+                    if (engine.get_stack().empty()) {
+                        return false;
+                    }
+                    engine.save_step();
+                } else if (code.val() <= ass.get_mand_hyps_num()) {
+                    process_label(ass.get_mand_hyp(code.val()-1));
+                } else if (code.val() <= ass.get_mand_hyps_num() + refs.size()) {
+                    process_label(refs[code.val()-ass.get_mand_hyps_num()-1]);
+                } else {
+                    engine.process_saved_step(code.val()-ass.get_mand_hyps_num()-refs.size()-1);
+                }
+            }
+        } else if (auto uncomp_proof = dynamic_cast< const UncompressedProof* >(proof.get())) {
+            for (const auto &label : uncomp_proof->get_labels()) {
+                if (!is_earlier(label)) {
+                    return false;
+                }
+                process_label(label);
+            }
+        } else {
+            return false;
+        }
+    } catch (ProofException< ParsingTree2< SymTok, LabTok > >&) {
+        return false;
+    } catch (MMPPException&) {
+        return false;
+    } catch (std::out_of_range&) {
+        return false;
+    }
+    if (engine.get_stack().size() != 1) {
+        return false;
+    }
+    const auto &res = engine.get_stack().front();
+    const Sentence &sent = this->get_sentence(ass.get_thesis());
+    if (res.get_root().get_node().type != this->get_parsing_addendum().get_syntax().at(sent[0])) {
+        return false;
+    }
+    if (this->reconstruct_sentence(res, sent[0]) != sent) {
+        return false;
+    }
+    pt2 = res;
+    return true;
 }
 
 LabTok LibraryToolbox::get_registered_prover_label(const RegisteredProver &prover) const
@@ -1038,7 +1867,17 @@ LabTok LibraryToolbox::get_registered_prover_label(const RegisteredProver &prove
 
 const ParsingTree<SymTok, LabTok> &LibraryToolbox::get_parsed_sent(LabTok label) const
 {
-    return this->parsed_sents.at(label.val());
+    auto &slot = this->parsed_sents.at(label.val());
+    const ParsingTree< SymTok, LabTok > *pt = slot.load(std::memory_order_acquire);
+    if (pt == nullptr) {
+        // If two threads race to build the same tree, the loser throws away its copy
+        const auto &pt2 = this->parsed_sents2[label.val()];
+        auto new_pt = pt2.get_nodes_len() == 0 ? std::make_unique< const ParsingTree< SymTok, LabTok > >() : std::make_unique< const ParsingTree< SymTok, LabTok > >(pt2_to_pt(pt2));
+        if (slot.compare_exchange_strong(pt, new_pt.get(), std::memory_order_acq_rel)) {
+            pt = new_pt.release();
+        }
+    }
+    return *pt;
 }
 
 const ParsingTree2<SymTok, LabTok> &LibraryToolbox::get_parsed_sent2(LabTok label) const
@@ -1046,16 +1885,25 @@ const ParsingTree2<SymTok, LabTok> &LibraryToolbox::get_parsed_sent2(LabTok labe
     return this->parsed_sents2.at(label.val());
 }
 
-const std::vector<std::pair<ParsingTreeMultiIterator< SymTok, LabTok >::Status, ParsingTreeNode<SymTok, LabTok> > > &LibraryToolbox::get_parsed_iter(LabTok label) const
+std::vector<std::pair<ParsingTreeMultiIterator< SymTok, LabTok >::Status, ParsingTreeNode<SymTok, LabTok> > > LibraryToolbox::get_parsed_iter(LabTok label) const
 {
-    return this->parsed_iters.at(label.val());
+    std::vector<std::pair<ParsingTreeMultiIterator< SymTok, LabTok >::Status, ParsingTreeNode<SymTok, LabTok> > > ret;
+    ParsingTreeMultiIterator< SymTok, LabTok > it = this->parsed_sents2.at(label.val()).get_multi_iterator();
+    while (true) {
+        auto x = it.next();
+        ret.push_back(x);
+        if (x.first == it.Finished) {
+            break;
+        }
+    }
+    return ret;
 }
 
 Generator<std::reference_wrapper<const ParsingTree<SymTok, LabTok> > > LibraryToolbox::gen_parsed_sents() const
 {
     return Generator<std::reference_wrapper< const ParsingTree<SymTok, LabTok> > >([this](auto &sink) {
             for (LabTok::val_type i = 1; i < this->parsed_sents.size(); i++) {
-                sink(std::cref(this->parsed_sents[i]));
+                sink(std::cref(this->get_parsed_sent(LabTok(i))));
             }
         }
     );
@@ -1075,7 +1923,7 @@ Generator<std::pair<LabTok, std::reference_wrapper<const ParsingTree<SymTok, Lab
 {
     return Generator<std::pair<LabTok, std::reference_wrapper< const ParsingTree<SymTok, LabTok> > > >([this](auto &sink) {
             for (LabTok::val_type i = 1; i < this->parsed_sents.size(); i++) {
-                sink(std::make_pair(LabTok(i), std::cref(this->parsed_sents[i])));
+                sink(std::make_pair(LabTok(i), std::cref(this->get_parsed_sent(LabTok(i)))));
             }
         }
     );
@@ -1153,29 +2001,223 @@ ToolboxCache::~ToolboxCache()
 {
 }
 
+namespace {
+
+const char TOOLBOX_CACHE_MAGIC[8] = "MMPPTBC";
+const uint64_t TOOLBOX_CACHE_ENDIANNESS = 0x0102030405060708;
+
+/* All the items in the file are 64 bits words or arrays padded to a multiple of 8
+ * bytes, so that every array is suitably aligned when the file is mapped at a page
+ * boundary. */
+class CacheWriter {
+public:
+    CacheWriter(std::ostream &out) : out(out) {}
+
+    void write_raw(const void *data, size_t size) {
+        this->out.write(reinterpret_cast< const char* >(data), static_cast< std::streamsize >(size));
+        this->pos += size;
+        while (this->pos % 8 != 0) {
+            this->out.put(0);
+            this->pos++;
+        }
+    }
+
+    void write_u64(uint64_t x) {
+        this->write_raw(&x, sizeof(x));
+    }
+
+    template< typename T >
+    void write_array(const T *data, size_t num) {
+        this->write_u64(num);
+        this->write_raw(data, num * sizeof(T));
+    }
+
+private:
+    std::ostream &out;
+    size_t pos = 0;
+};
+
+class CacheReader {
+public:
+    CacheReader(const char *data, size_t size) : data(data), size(size) {}
+
+    const char *read_raw(size_t size) {
+        size_t padded = (size + 7) / 8 * 8;
+        if (padded < size || padded > this->size - this->pos) {
+            throw std::out_of_range("Truncated toolbox cache");
+        }
+        const char *ret = this->data + this->pos;
+        this->pos += padded;
+        return ret;
+    }
+
+    uint64_t read_u64() {
+        uint64_t ret;
+        std::memcpy(&ret, this->read_raw(sizeof(ret)), sizeof(ret));
+        return ret;
+    }
+
+    template< typename T >
+    const T *read_array(size_t &num) {
+        uint64_t num64 = this->read_u64();
+        if (num64 > (this->size - this->pos) / sizeof(T)) {
+            throw std::out_of_range("Truncated toolbox cache");
+        }
+        num = num64;
+        return reinterpret_cast< const T* >(this->read_raw(num * sizeof(T)));
+    }
+
+private:
+    const char *data;
+    size_t size;
+    size_t pos = 0;
+};
+
+}
+
+const uint64_t FileToolboxCache::VERSION;
+
 FileToolboxCache::FileToolboxCache(const boost::filesystem::path &filename) : filename(filename) {
 }
 
 bool FileToolboxCache::load() {
-    boost::filesystem::ifstream lr_fin(this->filename);
-    if (lr_fin.fail()) {
+    this->data = ToolboxCacheData();
+    this->mapped = nullptr;
+    try {
+        if (!boost::filesystem::exists(this->filename) || boost::filesystem::file_size(this->filename) == 0) {
+            return false;
+        }
+        this->mapped = std::make_unique< MappedFile >(this->filename);
+        CacheReader reader(this->mapped->get_data(), this->mapped->get_size());
+
+        // Header
+        if (std::memcmp(reader.read_raw(sizeof(TOOLBOX_CACHE_MAGIC)), TOOLBOX_CACHE_MAGIC, sizeof(TOOLBOX_CACHE_MAGIC)) != 0 ||
+                reader.read_u64() != VERSION ||
+                reader.read_u64() != TOOLBOX_CACHE_ENDIANNESS ||
+                reader.read_u64() != sizeof(SymTok) ||
+                reader.read_u64() != sizeof(LabTok) ||
+                reader.read_u64() != sizeof(ParsingTreeNode< SymTok, LabTok >)) {
+            this->mapped = nullptr;
+            return false;
+        }
+        size_t digest_len;
+        const char *digest = reader.read_array< char >(digest_len);
+        this->digest = std::string(digest, digest + digest_len);
+
+        // LR automaton
+        auto &aut = this->data.automaton;
+        size_t states_num1, red_states_num1, shifts_num2, reds_num2, reds_num3, reds_num4;
+        aut.shift_begin = reader.read_array< uint32_t >(states_num1);
+        aut.shift_syms = reader.read_array< SymTok >(aut.shifts_num);
+        aut.shift_states = reader.read_array< uint32_t >(shifts_num2);
+        aut.red_begin = reader.read_array< uint32_t >(red_states_num1);
+        aut.red_types = reader.read_array< SymTok >(aut.reds_num);
+        aut.red_labels = reader.read_array< LabTok >(reds_num2);
+        aut.red_sym_nums = reader.read_array< uint32_t >(reds_num3);
+        aut.red_var_nums = reader.read_array< uint32_t >(reds_num4);
+        aut.states_num = states_num1 == 0 ? 0 : states_num1 - 1;
+        if (states_num1 != red_states_num1 || shifts_num2 != aut.shifts_num ||
+                reds_num2 != aut.reds_num || reds_num3 != aut.reds_num || reds_num4 != aut.reds_num ||
+                !aut.is_consistent()) {
+            throw std::out_of_range("Inconsistent LR automaton in toolbox cache");
+        }
+
+        // Parsing trees
+        this->data.parsed_nodes = reader.read_array< ParsingTreeNode< SymTok, LabTok > >(this->data.parsed_nodes_num);
+        this->data.parsed_ranges = reader.read_array< uint64_t >(this->data.parsed_ranges_num);
+
+        // Registered provers
+        size_t provers_num = reader.read_u64();
+        for (size_t i = 0; i < provers_num; i++) {
+            RegisteredProverInstanceData inst_data;
+            inst_data.valid = reader.read_u64() != 0;
+            inst_data.label = LabTok(static_cast< LabTok::val_type >(reader.read_u64()));
+            size_t perm_len = reader.read_u64();
+            for (size_t j = 0; j < perm_len; j++) {
+                inst_data.perm_inv.push_back(reader.read_u64());
+            }
+            size_t map_len = reader.read_u64();
+            for (size_t j = 0; j < map_len; j++) {
+                SymTok var(static_cast< SymTok::val_type >(reader.read_u64()));
+                size_t sent_len;
+                const SymTok *sent = reader.read_array< SymTok >(sent_len);
+                inst_data.ass_map[var] = Sentence(sent, sent + sent_len);
+            }
+            this->data.registered_provers.push_back(inst_data);
+        }
+    } catch (std::out_of_range&) {
+        this->data = ToolboxCacheData();
+        this->mapped = nullptr;
+        return false;
+    } catch (boost::interprocess::interprocess_exception&) {
+        this->data = ToolboxCacheData();
+        this->mapped = nullptr;
         return false;
     }
-    boost::archive::text_iarchive archive(lr_fin);
-    archive >> this->digest;
-    archive >> this->lr_parser_data;
     return true;
 }
 
 bool FileToolboxCache::store() {
-    boost::filesystem::ofstream lr_fout(this->filename);
-    if (lr_fout.fail()) {
-        return false;
+    /* Write to a temporary file and then rename it over the old one, so that other
+     * processes that have the old one mapped are not disturbed. */
+    boost::filesystem::path tmp_filename = this->filename;
+    tmp_filename += ".tmp";
+    {
+        boost::filesystem::ofstream fout(tmp_filename, std::ios::binary);
+        if (fout.fail()) {
+            return false;
+        }
+        CacheWriter writer(fout);
+
+        // Header
+        writer.write_raw(TOOLBOX_CACHE_MAGIC, sizeof(TOOLBOX_CACHE_MAGIC));
+        writer.write_u64(VERSION);
+        writer.write_u64(TOOLBOX_CACHE_ENDIANNESS);
+        writer.write_u64(sizeof(SymTok));
+        writer.write_u64(sizeof(LabTok));
+        writer.write_u64(sizeof(ParsingTreeNode< SymTok, LabTok >));
+        writer.write_array(this->digest.data(), this->digest.size());
+
+        // LR automaton
+        const auto &aut = this->data.automaton;
+        size_t states_num1 = aut.states_num == 0 ? 0 : aut.states_num + 1;
+        writer.write_array(aut.shift_begin, states_num1);
+        writer.write_array(aut.shift_syms, aut.shifts_num);
+        writer.write_array(aut.shift_states, aut.shifts_num);
+        writer.write_array(aut.red_begin, states_num1);
+        writer.write_array(aut.red_types, aut.reds_num);
+        writer.write_array(aut.red_labels, aut.reds_num);
+        writer.write_array(aut.red_sym_nums, aut.reds_num);
+        writer.write_array(aut.red_var_nums, aut.reds_num);
+
+        // Parsing trees
+        writer.write_array(this->data.parsed_nodes, this->data.parsed_nodes_num);
+        writer.write_array(this->data.parsed_ranges, this->data.parsed_ranges_num);
+
+        // Registered provers
+        writer.write_u64(this->data.registered_provers.size());
+        for (const auto &inst_data : this->data.registered_provers) {
+            writer.write_u64(inst_data.valid);
+            writer.write_u64(inst_data.label.val());
+            writer.write_u64(inst_data.perm_inv.size());
+            for (const auto x : inst_data.perm_inv) {
+                writer.write_u64(x);
+            }
+            writer.write_u64(inst_data.ass_map.size());
+            for (const auto &x : inst_data.ass_map) {
+                writer.write_u64(x.first.val());
+                writer.write_array(x.second.data(), x.second.size());
+            }
+        }
+
+        fout.flush();
+        if (fout.fail()) {
+            return false;
+        }
     }
-    boost::archive::text_oarchive archive(lr_fout);
-    archive << this->digest;
-    archive << this->lr_parser_data;
-    return true;
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp_filename, this->filename, ec);
+    return !ec;
 }
 
 std::string FileToolboxCache::get_digest() {
@@ -1186,12 +2228,13 @@ void FileToolboxCache::set_digest(std::string digest) {
     this->digest = digest;
 }
 
-LRParser< SymTok, LabTok >::CachedData FileToolboxCache::get_lr_parser_data() {
-    return this->lr_parser_data;
+const ToolboxCacheData &FileToolboxCache::get_data() {
+    return this->data;
 }
 
-void FileToolboxCache::set_lr_parser_data(const LRParser< SymTok, LabTok >::CachedData &cached_data) {
-    this->lr_parser_data = cached_data;
+void FileToolboxCache::set_data(const ToolboxCacheData &data) {
+    this->mapped = nullptr;
+    this->data = data;
 }
 
 std::string ProofPrinter::to_string() const
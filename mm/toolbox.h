@@ -6,6 +6,7 @@
 #include <fstream>
 #include <string>
 #include <memory>
+#include <atomic>
 
 #include <boost/filesystem.hpp>
 
@@ -13,13 +14,32 @@ class LibraryToolbox;
 
 #include "library.h"
 #include "parsing/lr.h"
+#include "parsing/earley.h"
 #include "parsing/unif.h"
+#include "parsing/discrtree.h"
+#include "parsing/fingerprint.h"
 #include "sentengine.h"
 #include "mmtemplates.h"
 #include "tempgen.h"
+#include "tokenizer.h"
+#include "utils/lrucache.h"
 
 class LibraryToolbox;
 
+/* The same predicate as LibraryToolbox::get_standard_is_var(), as a plain functor reading a
+ * bitmap of the labels that are variables: passing it to the templates of unif.h lets the
+ * compiler inline the check, which is not possible through a std::function. Labels beyond
+ * the bitmap are temporary variables. It points into the toolbox, so it must not outlive it. */
+struct StandardIsVar {
+    const uint64_t *words;
+    size_t labels_num;
+
+    bool operator()(LabTok x) const {
+        const size_t idx = x.val();
+        return idx >= this->labels_num || ((this->words[idx / 64] >> (idx % 64)) & 1);
+    }
+};
+
 struct SentenceTree {
     LabTok label;
     std::vector< SentenceTree > children;
@@ -96,6 +116,21 @@ struct RegisteredProverInstanceData {
     }
 };
 
+/* Everything the toolbox can retrieve from a cache instead of computing it. Arrays are
+ * not owned by this structure: when they come from ToolboxCache::get_data() they live in
+ * the cache (possibly directly in a memory mapped file), so the cache must outlive their
+ * users; when they are passed to ToolboxCache::set_data() they must stay alive until
+ * ToolboxCache::store() is called. */
+struct ToolboxCacheData {
+    LRAutomatonView< SymTok, LabTok > automaton;
+    const ParsingTreeNode< SymTok, LabTok > *parsed_nodes = nullptr;
+    size_t parsed_nodes_num = 0;
+    // Offset and length in parsed_nodes of the parsing tree of each label (so two items for each label)
+    const uint64_t *parsed_ranges = nullptr;
+    size_t parsed_ranges_num = 0;
+    std::vector< RegisteredProverInstanceData > registered_provers;
+};
+
 class ToolboxCache {
 public:
     virtual ~ToolboxCache();
@@ -103,39 +138,51 @@ public:
     virtual bool store() = 0;
     virtual std::string get_digest() = 0;
     virtual void set_digest(std::string digest) = 0;
-    virtual LRParser< SymTok, LabTok >::CachedData get_lr_parser_data() = 0;
-    virtual void set_lr_parser_data(const LRParser< SymTok, LabTok >::CachedData &cached_data) = 0;
+    virtual const ToolboxCacheData &get_data() = 0;
+    virtual void set_data(const ToolboxCacheData &data) = 0;
 };
 
+/* The cache is stored in a versioned binary file, whose arrays are laid out so that
+ * they can be used in place after the file is memory mapped: loading it does not
+ * require any deserialization except for the (few) registered provers. */
 class FileToolboxCache : public ToolboxCache {
 public:
+    static const uint64_t VERSION = 2;
+
     FileToolboxCache(const boost::filesystem::path &filename);
     bool load() override;
     bool store() override;
     std::string get_digest() override;
     void set_digest(std::string digest) override;
-    LRParser< SymTok, LabTok >::CachedData get_lr_parser_data() override;
-    void set_lr_parser_data(const LRParser< SymTok, LabTok >::CachedData &cached_data) override;
+    const ToolboxCacheData &get_data() override;
+    void set_data(const ToolboxCacheData &data) override;
 
 private:
     boost::filesystem::path filename;
     std::string digest;
-    LRParser< SymTok, LabTok >::CachedData lr_parser_data;
+    ToolboxCacheData data;
+    std::unique_ptr< MappedFile > mapped;
 };
 
 class LibraryToolbox : public Library
 {
 public:
-    explicit LibraryToolbox(const ExtendedLibrary &lib, std::string turnstile, std::shared_ptr< ToolboxCache > cache = NULL);
+    explicit LibraryToolbox(const ExtendedLibrary &lib, std::string turnstile, std::shared_ptr< ToolboxCache > cache = NULL, bool parse_from_proofs = false);
+    ~LibraryToolbox();
 private:
     void compute_everything();
+    std::string compute_cache_digest() const;
+    void store_cache();
     std::shared_ptr< ToolboxCache > cache;
+    bool cache_loaded = false;
+    bool parse_from_proofs;
 
     // Essentials
 public:
     const ExtendedLibrary &get_library() const;
     const std::function<bool (LabTok)> &get_standard_is_var() const;
     const std::function<bool (SymTok)> &get_standard_is_var_sym() const;
+    StandardIsVar get_standard_is_var_fast() const;
     const std::function< std::pair< SymTok, std::vector< SymTok > >(LabTok) > &get_validation_rule() const;
     SymTok get_turnstile() const;
     SymTok get_turnstile_alias() const;
@@ -238,10 +285,34 @@ public:
         return true;
     }
 
-    // Assertion unification
+    /* Assertion unification: candidates are searched on threads_num threads (or as many as the
+     * hardware supports when it is zero), but results are always reported in label order. Threads
+     * are spawned at each call, so the default is to search serially: callers that run many
+     * queries concurrently (like the web interface) should keep it, offline tools can opt in.
+     * Hypotheses can always be matched in any order; with up_to_hyps_perms each assertion is
+     * reported with all the working permutations, otherwise only with the first one. */
 public:
-    std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > > unify_assertion(const std::vector< Sentence > &hypotheses, const Sentence &thesis, bool just_first=true, bool up_to_hyps_perms=true, const std::set< std::pair< SymTok, SymTok > > &antidists = {}) const;
-    std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > > unify_assertion(const std::vector< std::pair< SymTok, ParsingTree< SymTok, LabTok > > > &hypotheses, const std::pair< SymTok, ParsingTree< SymTok, LabTok > > &thesis, bool just_first=true, bool up_to_hyps_perms=true, const std::set< std::pair< SymTok, SymTok > > &antidists = {}) const;
+    std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > > unify_assertion(const std::vector< Sentence > &hypotheses, const Sentence &thesis, bool just_first=true, bool up_to_hyps_perms=true, const std::set< std::pair< SymTok, SymTok > > &antidists = {}, size_t threads_num = 1) const;
+    std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > > unify_assertion(const std::vector< std::pair< SymTok, ParsingTree< SymTok, LabTok > > > &hypotheses, const std::pair< SymTok, ParsingTree< SymTok, LabTok > > &thesis, bool just_first=true, bool up_to_hyps_perms=true, const std::set< std::pair< SymTok, SymTok > > &antidists = {}, size_t threads_num = 1) const;
+    std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > > unify_assertion(const std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > &hypotheses, const std::pair< SymTok, ParsingTree2< SymTok, LabTok > > &thesis, bool just_first=true, bool up_to_hyps_perms=true, const std::set< std::pair< SymTok, SymTok > > &antidists = {}, size_t threads_num = 1) const;
+    /* Streaming assertion unification: each result is passed to callback as soon as it is found,
+     * trying first the assertions with fewer symbols, which are usually the most useful matches.
+     * The search stops when callback returns false or when should_stop returns true (it is polled
+     * before each candidate, so it can be used to cancel the search, to enforce a time budget or
+     * to yield). Return true if all the candidates were examined. Results are not cached. */
+    bool unify_assertion_stream(const std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > &hypotheses, const std::pair< SymTok, ParsingTree2< SymTok, LabTok > > &thesis,
+                                const std::function< bool(const std::tuple< LabTok, std::vector< size_t >, std::unordered_map< SymTok, Sentence > >&) > &callback,
+                                bool up_to_hyps_perms=true, const std::set< std::pair< SymTok, SymTok > > &antidists = {}, const std::function< bool() > &should_stop = nullptr) const;
+    LRUCacheStats get_unification_cache_stats() const;
+    // The capacity is measured in (approximate) bytes
+    void set_unification_cache_capacity(size_t capacity) const;
+    // Must be called whenever something unification depends on (i.e., the library) changes
+    void clear_unification_cache() const;
+private:
+    /* Results are cached under a canonical form of the query, in which variables are
+     * numbered in order of first occurrence; the stored substitutions refer to variables
+     * through the same numbering, so that they can be renamed back on retrieval */
+    mutable LRUCache< std::vector< uint32_t >, std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > >, boost::hash< std::vector< uint32_t > > > unification_cache;
 
     // Reading and printing
 public:
@@ -253,8 +324,10 @@ public:
     ProofPrinter print_proof(const CompressedProof &proof, bool only_assertions = false) const;
     ProofPrinter print_proof(const UncompressedProof &proof, bool only_assertions = false) const;
     Sentence reconstruct_sentence(const ParsingTree< SymTok, LabTok > &pt, SymTok first_sym = {}) const;
+    Sentence reconstruct_sentence(const ParsingTree2< SymTok, LabTok > &pt, SymTok first_sym = {}) const;
 private:
     void reconstruct_sentence_internal(const ParsingTree< SymTok, LabTok > &pt, std::back_insert_iterator< std::vector< SymTok > > it) const;
+    void reconstruct_sentence_internal(ParsingTreeIterator< SymTok, LabTok > pt, std::back_insert_iterator< std::vector< SymTok > > it) const;
 
     // Type correspondance
 public:
@@ -275,6 +348,7 @@ public:
 private:
     void compute_is_var_by_type();
     std::vector< bool > is_var_by_type;
+    std::vector< uint64_t > is_var_words;
 
     // Assertions sorted according to the type of their thesis
 public:
@@ -293,9 +367,12 @@ private:
     // Derivations sorted according to their label
 public:
     const std::pair< SymTok, Sentence > &get_derivation_rule(LabTok lab) const;
+    // The type of the parsing tree nodes with this label (useful to expand CompactParsingTree's)
+    SymTok get_label_type(LabTok lab) const;
 private:
     void compute_ders_by_label();
     std::unordered_map< LabTok, std::pair< SymTok, std::vector< SymTok > > > ders_by_label;
+    std::vector< SymTok > label_types;
 
     // Variables in sentences and assertions
 public:
@@ -319,30 +396,69 @@ private:
     std::unordered_map< LabTok, std::vector< LabTok > > imp_ant_labels_to_theses;
     std::unordered_map< LabTok, std::vector< LabTok > > imp_con_labels_to_theses;
 
-    // LR parsing
+    /* Discrimination tree on the theses of all the assertions, so that unification only
+     * considers those which can possibly match */
+public:
+    const DiscriminationTree< SymTok, LabTok, LabTok > &get_theses_index() const;
+private:
+    void compute_theses_index();
+    DiscriminationTree< SymTok, LabTok, LabTok > theses_index;
+
+    /* Fingerprints of the essential hypotheses of all the assertions, used to reject unification
+     * candidates before building a unificator; theses need none, because candidates come from the
+     * discrimination tree, which already checks all the labels a fingerprint would */
+public:
+    // Labels without a fingerprint get one made only of wildcards, which is compatible with anything
+    const TreeFingerprint< LabTok > &get_fingerprint(LabTok label) const;
+private:
+    void compute_fingerprints();
+    std::vector< TreeFingerprint< LabTok > > fingerprints;
+
+    /* Parsing: the LR parser is used when the database certifies that its grammar is
+     * unambiguous with a KLR check (as set.mm does with "$j unambiguous 'klr 5';"), since
+     * then it is the fastest option; otherwise the grammar might be ambiguous or in some
+     * other way unsuitable for LR backtracking, and the Earley parser is used. */
 public:
-    const LRParser< SymTok, LabTok > &get_parser() const;
+    const Parser< SymTok, LabTok > &get_parser() const;
+    bool is_lr_parser() const;
     ParsingTree< SymTok, LabTok > parse_sentence(typename Sentence::const_iterator sent_begin, typename Sentence::const_iterator sent_end, SymTok type) const;
     ParsingTree< SymTok, LabTok > parse_sentence(const Sentence &sent, SymTok type) const;
     ParsingTree< SymTok, LabTok > parse_sentence(const Sentence &sent) const;
+    ParsingTree2< SymTok, LabTok > parse_sentence2(typename Sentence::const_iterator sent_begin, typename Sentence::const_iterator sent_end, SymTok type) const;
+    /* Parse many sentences in parallel, each given as a token sequence (without the typecode)
+     * and the type it must be parsed as; the callback is called on the calling thread with
+     * the index and the tree of each sentence (empty if it did not parse), in the same order
+     * as the input, as soon as the results are available. */
+    void parse_sentences(const std::vector< std::pair< Sentence, SymTok > > &sents, const std::function< void(size_t, const ParsingTree2< SymTok, LabTok >&) > &callback, size_t threads_num = 0) const;
+    std::vector< ParsingTree2< SymTok, LabTok > > parse_sentences(const std::vector< std::pair< Sentence, SymTok > > &sents, size_t threads_num = 0) const;
+    LRUCacheStats get_parse_cache_stats() const;
+    // The capacity is measured in (approximate) bytes
+    void set_parse_cache_capacity(size_t capacity) const;
 private:
     void compute_parser_initialization();
-    std::unique_ptr< LRParser< SymTok, LabTok > > parser;
+    std::unique_ptr< Parser< SymTok, LabTok > > parser;
+    // Same object as parser, if it is an LR parser
+    LRParser< SymTok, LabTok > *lr_parser = nullptr;
+    mutable LRUCache< Sentence, CompactParsingTree< SymTok, LabTok >, boost::hash< Sentence > > parse_cache;
 
     // Preparsed sentences
 public:
     const ParsingTree< SymTok, LabTok > &get_parsed_sent(LabTok label) const;
     const ParsingTree2<SymTok, LabTok> &get_parsed_sent2(LabTok label) const;
-    const std::vector<std::pair< ParsingTreeMultiIterator< SymTok, LabTok >::Status, ParsingTreeNode< SymTok, LabTok > > > &get_parsed_iter(LabTok label) const;
+    std::vector<std::pair< ParsingTreeMultiIterator< SymTok, LabTok >::Status, ParsingTreeNode< SymTok, LabTok > > > get_parsed_iter(LabTok label) const;
     Generator<std::reference_wrapper<const ParsingTree<SymTok, LabTok> > > gen_parsed_sents() const;
     Generator<std::reference_wrapper<const ParsingTree2<SymTok, LabTok> > > gen_parsed_sents2() const;
     Generator<std::pair<LabTok, std::reference_wrapper<const ParsingTree<SymTok, LabTok> > > > enum_parsed_sents() const;
     Generator<std::pair<LabTok, std::reference_wrapper<const ParsingTree2<SymTok, LabTok> > > > enum_parsed_sents2() const;
 private:
     void compute_sentences_parsing();
-    std::vector< ParsingTree< SymTok, LabTok > > parsed_sents;
+    bool parse_sentence_from_proof(const Assertion &ass, ParsingTree2< SymTok, LabTok > &pt2, const std::function< void(LabTok) > &wait_parsed) const;
+    /* All the parsing trees live in a single arena of nodes, and parsed_sents2 is the table
+     * of the views on it (identical sentences share their nodes); recursive trees are only
+     * built when they are first requested, and then kept. */
+    std::vector< ParsingTreeNode< SymTok, LabTok > > parsed_nodes;
     std::vector< ParsingTree2< SymTok, LabTok > > parsed_sents2;
-    std::vector< std::vector< std::pair< ParsingTreeMultiIterator< SymTok, LabTok >::Status, ParsingTreeNode< SymTok, LabTok > > > > parsed_iters;
+    mutable std::vector< std::atomic< const ParsingTree< SymTok, LabTok >* > > parsed_sents;
 
     // Provers utilities
 public:
@@ -0,0 +1,276 @@
+
+#include "treeverifier.h"
+
+#include <algorithm>
+
+#include "proof.h"
+#include "utils/utils.h"
+#include "utils/parallel.h"
+
+typedef ParsingTree2< SymTok, LabTok > Tree;
+typedef ParsingTreeNode< SymTok, LabTok > Node;
+typedef ProofException< Tree > TreeProofException;
+
+const size_t TreeVerifier::NO_SLOT;
+
+TreeVerifier::TreeVerifier(const LibraryToolbox &tb) : tb(tb)
+{
+    this->compiled.resize(tb.get_labels_num() + 1);
+    for (LabTok label : tb.gen_labels()) {
+        const Assertion *ass = nullptr;
+        try {
+            ass = &tb.get_assertion(label);
+        } catch (std::out_of_range&) {
+        }
+        if (ass == nullptr || !ass->is_valid()) {
+            continue;
+        }
+        auto &comp = this->compiled[label.val()];
+        comp.valid = true;
+        std::vector< LabTok > float_vars;
+        std::vector< SymTok > float_syms;
+        for (const auto &hyp : ass->get_float_hyps()) {
+            const auto &sent = tb.get_sentence(hyp);
+            comp.float_types.push_back(sent.at(0));
+            float_vars.push_back(tb.get_var_sym_to_lab(sent.at(1)));
+            float_syms.push_back(sent.at(1));
+        }
+        for (const auto &hyp : ass->get_ess_hyps()) {
+            comp.ess_hyps.push_back(this->compile_template(hyp, float_vars));
+        }
+        comp.thesis = this->compile_template(label, float_vars);
+        for (size_t i = 0; i < float_syms.size(); i++) {
+            for (size_t j = 0; j < i; j++) {
+                if (ass->get_mand_dists().find(std::minmax(float_syms[i], float_syms[j])) != ass->get_mand_dists().end()) {
+                    comp.dists.push_back(std::make_pair(i, j));
+                }
+            }
+        }
+    }
+}
+
+TreeVerifier::Template TreeVerifier::compile_template(LabTok label, const std::vector< LabTok > &float_vars) const
+{
+    Template templ;
+    const auto &pt = this->tb.get_parsed_sent2(label);
+    templ.typecode = this->tb.get_sentence(label).at(0);
+    templ.nodes.assign(pt.get_nodes(), pt.get_nodes() + pt.get_nodes_len());
+    templ.slots.resize(templ.nodes.size(), NO_SLOT);
+    const auto is_var = this->tb.get_standard_is_var_fast();
+    for (size_t i = 0; i < templ.nodes.size(); i++) {
+        if (is_var(templ.nodes[i].label)) {
+            auto it = std::find(float_vars.begin(), float_vars.end(), templ.nodes[i].label);
+            if (it != float_vars.end()) {
+                templ.slots[i] = it - float_vars.begin();
+            }
+        }
+    }
+    return templ;
+}
+
+namespace {
+
+struct StackEntry {
+    SymTok typecode;
+    std::shared_ptr< const Tree > tree;
+};
+
+}
+
+// Check that the tree at nodes is the template with the slots substituted, without actually building it
+template< typename Template >
+static bool match_template(const Template &templ, const Node *nodes, size_t nodes_len, const std::vector< const Tree* > &slots, size_t no_slot)
+{
+    size_t j = 0;
+    for (size_t i = 0; i < templ.nodes.size(); i++) {
+        if (j >= nodes_len) {
+            return false;
+        }
+        size_t slot = templ.slots[i];
+        if (slot != no_slot) {
+            const Tree &subst = *slots[slot];
+            size_t subtree_len = nodes[j].descendants_num + 1;
+            if (subtree_len != subst.get_nodes_len() || !std::equal(nodes + j, nodes + j + subtree_len, subst.get_nodes())) {
+                return false;
+            }
+            j += subtree_len;
+        } else {
+            if (nodes[j].label != templ.nodes[i].label) {
+                return false;
+            }
+            j++;
+        }
+    }
+    return j == nodes_len;
+}
+
+// Copy the template subtree beginning at position i in out, splicing the slots' trees in place of variables
+template< typename Template >
+static void splice_template(const Template &templ, size_t &i, const std::vector< const Tree* > &slots, size_t no_slot, std::vector< Node > &out)
+{
+    size_t slot = templ.slots[i];
+    if (slot != no_slot) {
+        const Tree &subst = *slots[slot];
+        out.insert(out.end(), subst.get_nodes(), subst.get_nodes() + subst.get_nodes_len());
+        i++;
+        return;
+    }
+    size_t pos = out.size();
+    size_t end = i + templ.nodes[i].descendants_num + 1;
+    out.push_back(templ.nodes[i]);
+    i++;
+    while (i < end) {
+        splice_template(templ, i, slots, no_slot, out);
+    }
+    out[pos].descendants_num = out.size() - pos - 1;
+}
+
+void TreeVerifier::verify(const Assertion &ass) const
+{
+    auto proof = ass.get_proof();
+    assert_or_throw< TreeProofException >(proof != nullptr, "Proof is incomplete");
+    this->verify(ass, *proof);
+}
+
+void TreeVerifier::verify(const Assertion &ass, const Proof &proof) const
+{
+    const auto is_var = this->tb.get_standard_is_var_fast();
+    const auto &dists = ass.get_dists();
+    std::vector< StackEntry > stack;
+    std::vector< StackEntry > saved;
+    std::vector< const Tree* > slots;
+    std::vector< LabTok > vars1;
+    std::vector< LabTok > vars2;
+
+    auto collect_vars = [&is_var](const Tree &tree, std::vector< LabTok > &vars) {
+        vars.clear();
+        for (size_t i = 0; i < tree.get_nodes_len(); i++) {
+            if (is_var(tree.get_nodes()[i].label)) {
+                vars.push_back(tree.get_nodes()[i].label);
+            }
+        }
+    };
+
+    auto process_label = [&](LabTok label) {
+        const CompiledAssertion *child = label.val() < this->compiled.size() ? &this->compiled[label.val()] : nullptr;
+        if (child == nullptr || !child->valid) {
+            assert_or_throw< TreeProofException >(find(ass.get_float_hyps().begin(), ass.get_float_hyps().end(), label) != ass.get_float_hyps().end() ||
+                    find(ass.get_ess_hyps().begin(), ass.get_ess_hyps().end(), label) != ass.get_ess_hyps().end() ||
+                    ass.get_opt_hyps().find(label) != ass.get_opt_hyps().end(),
+                    "Requested label cannot be used by this theorem");
+            // The tree is owned by the toolbox, so we do not need to copy it
+            stack.push_back({ this->tb.get_sentence(label).at(0), std::shared_ptr< const Tree >(std::shared_ptr< const Tree >(), &this->tb.get_parsed_sent2(label)) });
+            return;
+        }
+        assert_or_throw< TreeProofException >(label.val() < ass.get_thesis().val(), "Requested label cannot be used by this theorem");
+
+        size_t float_num = child->float_types.size();
+        size_t hyps_num = float_num + child->ess_hyps.size();
+        assert_or_throw< TreeProofException >(stack.size() >= hyps_num, "Stack too small to pop hypotheses");
+        size_t stack_base = stack.size() - hyps_num;
+
+        // Fill the slots with the floating hypotheses
+        slots.resize(float_num);
+        for (size_t i = 0; i < float_num; i++) {
+            const auto &entry = stack[stack_base + i];
+            assert_or_throw< TreeProofException >(entry.typecode == child->float_types[i], "Floating hypothesis does not match stack");
+            slots[i] = entry.tree.get();
+        }
+
+        // Match the essential hypotheses
+        for (size_t i = 0; i < child->ess_hyps.size(); i++) {
+            const auto &entry = stack[stack_base + float_num + i];
+            const auto &templ = child->ess_hyps[i];
+            assert_or_throw< TreeProofException >(entry.typecode == templ.typecode &&
+                                                  match_template(templ, entry.tree->get_nodes(), entry.tree->get_nodes_len(), slots, NO_SLOT),
+                                                  "Essential hypothesis does not match stack");
+        }
+
+        // Check distinct variables constraints
+        for (const auto &dist : child->dists) {
+            collect_vars(*slots[dist.first], vars1);
+            collect_vars(*slots[dist.second], vars2);
+            for (const auto &var1 : vars1) {
+                for (const auto &var2 : vars2) {
+                    assert_or_throw< TreeProofException >(var1 != var2, "Distinct variable constraint violated");
+                    assert_or_throw< TreeProofException >(dists.find(std::minmax(this->tb.get_var_lab_to_sym(var1), this->tb.get_var_lab_to_sym(var2))) != dists.end(),
+                                                          "Distinct variables constraints are too wide");
+                }
+            }
+        }
+
+        // Build the thesis
+        const auto &templ = child->thesis;
+        size_t thesis_len = 0;
+        for (size_t i = 0; i < templ.nodes.size(); i++) {
+            thesis_len += templ.slots[i] == NO_SLOT ? 1 : slots[templ.slots[i]]->get_nodes_len();
+        }
+        std::vector< Node > nodes;
+        nodes.reserve(thesis_len);
+        size_t pos = 0;
+        splice_template(templ, pos, slots, NO_SLOT, nodes);
+        assert(nodes.size() == thesis_len);
+        auto thesis = std::make_shared< const Tree >(std::move(nodes), nullptr, 0);
+        stack.resize(stack_base);
+        stack.push_back({ templ.typecode, thesis });
+    };
+
+    if (auto comp_proof = dynamic_cast< const CompressedProof* >(&proof)) {
+        const auto &refs = comp_proof->get_refs();
+        size_t mand_hyps_num = ass.get_mand_hyps_num();
+        for (const auto &code : comp_proof->get_codes()) {
+            if (code == CodeTok{}) {
+                assert_or_throw< TreeProofException >(!stack.empty(), "Saving a step with empty stack");
+                saved.push_back(stack.back());
+            } else if (code.val() <= mand_hyps_num) {
+                process_label(ass.get_mand_hyp(code.val()-1));
+            } else if (code.val() <= mand_hyps_num + refs.size()) {
+                process_label(refs[code.val()-mand_hyps_num-1]);
+            } else {
+                size_t idx = code.val()-mand_hyps_num-refs.size()-1;
+                assert_or_throw< TreeProofException >(idx < saved.size(), "Code too big in compressed proof");
+                stack.push_back(saved[idx]);
+            }
+        }
+    } else if (auto uncomp_proof = dynamic_cast< const UncompressedProof* >(&proof)) {
+        for (const auto &label : uncomp_proof->get_labels()) {
+            process_label(label);
+        }
+    } else {
+        throw std::bad_cast();
+    }
+
+    assert_or_throw< TreeProofException >(stack.size() == 1, "Proof execution did not end with a single element on the stack");
+    assert_or_throw< TreeProofException >(stack[0].typecode == this->tb.get_sentence(ass.get_thesis()).at(0) &&
+                                          *stack[0].tree == this->tb.get_parsed_sent2(ass.get_thesis()),
+                                          "Proof does not prove the thesis");
+}
+
+std::vector< std::pair< LabTok, std::string > > TreeVerifier::verify_all(size_t threads_num) const
+{
+    std::vector< LabTok > theorems;
+    for (const auto &ass : this->tb.get_library().get_assertions()) {
+        if (ass.is_valid() && ass.is_theorem() && ass.get_proof() != nullptr) {
+            theorems.push_back(ass.get_thesis());
+        }
+    }
+
+    std::vector< std::string > errors(theorems.size());
+    parallel_for(theorems.size(), threads_num, [&](size_t idx) {
+        try {
+            this->verify(this->tb.get_assertion(theorems[idx]));
+        } catch (const TreeProofException &e) {
+            errors[idx] = e.get_reason();
+        } catch (const MMPPException &e) {
+            errors[idx] = e.get_reason();
+        }
+    });
+
+    std::vector< std::pair< LabTok, std::string > > ret;
+    for (size_t i = 0; i < theorems.size(); i++) {
+        if (!errors[i].empty()) {
+            ret.push_back(std::make_pair(theorems[i], errors[i]));
+        }
+    }
+    return ret;
+}
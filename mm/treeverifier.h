@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+#include <limits>
+
+#include "toolbox.h"
+#include "ptengine.h"
+
+/* A proof verifier that works on parsing trees instead of sentences, meant as an
+ * independent (and faster) second opinion with respect to the verification done by
+ * the Reader. The statements of all the assertions are compiled once in templates
+ * where each variable is replaced by the index of the floating hypothesis that
+ * defines it; applying an assertion then only requires filling a flat vector of
+ * slots with the trees on the stack and splicing them in the template, while
+ * essential hypotheses are matched in place without building their substitution.
+ */
+class TreeVerifier {
+public:
+    TreeVerifier(const LibraryToolbox &tb);
+
+    // Throw ProofException< ParsingTree2< SymTok, LabTok > > if the proof is not valid
+    void verify(const Assertion &ass) const;
+    void verify(const Assertion &ass, const Proof &proof) const;
+
+    // Return the label and the error message of each theorem that failed verification
+    std::vector< std::pair< LabTok, std::string > > verify_all(size_t threads_num = 0) const;
+
+private:
+    static const size_t NO_SLOT = std::numeric_limits< size_t >::max();
+
+    struct Template {
+        SymTok typecode;
+        std::vector< ParsingTreeNode< SymTok, LabTok > > nodes;
+        std::vector< size_t > slots;
+    };
+
+    struct CompiledAssertion {
+        bool valid = false;
+        std::vector< SymTok > float_types;
+        std::vector< Template > ess_hyps;
+        Template thesis;
+        std::vector< std::pair< size_t, size_t > > dists;
+    };
+
+    Template compile_template(LabTok label, const std::vector< LabTok > &float_vars) const;
+
+    const LibraryToolbox &tb;
+    std::vector< CompiledAssertion > compiled;
+};
@@ -0,0 +1,263 @@
+
+#include "writer.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include <boost/filesystem/fstream.hpp>
+
+#include "proof.h"
+#include "utils/utils.h"
+#include "utils/parallel.h"
+
+// Parameters used when a piece of proof has to be formatted from scratch
+static const size_t LINE_WIDTH = 79;
+static const size_t PROOF_INDENT = 2;
+
+// Number of layout items that are formatted together by a single thread
+static const size_t CHUNK_SIZE = 1024;
+
+namespace {
+
+class TokenEmitter {
+public:
+    TokenEmitter(std::string &out, const LayoutItem &item) : out(out), item(item), spacing_it(item.spacing.begin()) {
+    }
+
+    // Emit the next token using the spacing recorded in the layout
+    void emit_recorded(const std::string &tok) {
+        while (this->spacing_it != this->item.spacing.end() && this->spacing_it->first < this->idx) {
+            this->spacing_it++;
+        }
+        if (this->spacing_it != this->item.spacing.end() && this->spacing_it->first == this->idx) {
+            this->emit(this->spacing_it->second, tok);
+        } else {
+            this->emit(" ", tok);
+        }
+    }
+
+    // Emit the next token choosing spacing on our own
+    void emit_wrapped(const std::string &tok, bool newline=false) {
+        if (newline || this->col + 1 + tok.size() > LINE_WIDTH) {
+            this->emit(this->new_line(), tok);
+        } else {
+            this->emit(" ", tok);
+        }
+    }
+
+    // Emit the next token on a new line, preceded by the comments found in the layout from the next token on
+    void emit_with_recorded_comments(const std::string &tok) {
+        std::string spacing;
+        for (auto it = this->spacing_it; it != this->item.spacing.end(); it++) {
+            if (it->first >= this->idx && it->second.find("$(") != std::string::npos) {
+                spacing += it->second.substr(0, it->second.rfind("$)") + 2);
+            }
+        }
+        this->emit(spacing + this->new_line(), tok);
+    }
+
+    // Emit a long string broken in pieces that fill the lines
+    void emit_filling(const std::string &str) {
+        size_t pos = 0;
+        while (pos < str.size()) {
+            std::string spacing = " ";
+            if (this->col + 2 > LINE_WIDTH) {
+                spacing = this->new_line();
+            }
+            size_t avail = LINE_WIDTH - (spacing == " " ? this->col + 1 : spacing.size() - 1);
+            size_t len = std::min(str.size() - pos, avail);
+            this->emit(spacing, str.substr(pos, len));
+            pos += len;
+        }
+    }
+
+    size_t get_idx() const {
+        return this->idx;
+    }
+
+private:
+    std::string new_line() const {
+        return "\n" + std::string(this->indent + PROOF_INDENT, ' ');
+    }
+
+    void emit(const std::string &spacing, const std::string &tok) {
+        this->out += spacing;
+        size_t newline_pos = spacing.rfind('\n');
+        if (newline_pos == std::string::npos) {
+            this->col += spacing.size();
+        } else {
+            this->col = spacing.size() - newline_pos - 1;
+        }
+        if (this->idx == 0) {
+            this->indent = this->col;
+        }
+        this->out += tok;
+        this->col += tok.size();
+        this->idx++;
+    }
+
+    std::string &out;
+    const LayoutItem &item;
+    std::vector< std::pair< uint32_t, std::string > >::const_iterator spacing_it;
+    uint32_t idx = 0;
+    size_t col = 0;
+    size_t indent = 0;
+};
+
+}
+
+Writer::Writer(const LibraryImpl &lib, size_t threads_num) : lib(lib), threads_num(threads_num)
+{
+    if (this->threads_num == 0) {
+        this->threads_num = default_threads_num();
+    }
+}
+
+void Writer::write(std::ostream &os) const
+{
+    const auto &layout = this->lib.get_layout();
+    assert_or_throw< MMPPException >(!layout.empty(), "The library was read without storing its layout");
+    size_t chunks_num = (layout.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    // Chunks are processed in waves, so that memory usage stays bounded
+    std::vector< std::string > bufs(4 * this->threads_num);
+    for (size_t wave_begin = 0; wave_begin < chunks_num; wave_begin += bufs.size()) {
+        size_t wave_end = std::min(chunks_num, wave_begin + bufs.size());
+        parallel_for(wave_end - wave_begin, this->threads_num, [&](size_t i) {
+            size_t chunk = wave_begin + i;
+            auto &buf = bufs[i];
+            buf.clear();
+            this->format_items(buf, chunk * CHUNK_SIZE, std::min(layout.size(), (chunk+1) * CHUNK_SIZE));
+        });
+        for (size_t chunk = wave_begin; chunk < wave_end; chunk++) {
+            const auto &buf = bufs[chunk - wave_begin];
+            os.write(buf.data(), static_cast< std::streamsize >(buf.size()));
+        }
+    }
+    os.flush();
+}
+
+void Writer::write(const boost::filesystem::path &filename) const
+{
+    std::vector< char > buffer(1 << 20);
+    boost::filesystem::ofstream fout;
+    fout.rdbuf()->pubsetbuf(buffer.data(), static_cast< std::streamsize >(buffer.size()));
+    fout.open(filename, std::ios_base::out | std::ios_base::binary);
+    assert_or_throw< MMPPException >(fout.good(), "Could not open output file");
+    this->write(fout);
+    assert_or_throw< MMPPException >(fout.good(), "Error while writing output file");
+}
+
+void Writer::format_items(std::string &out, size_t begin, size_t end) const
+{
+    const auto &layout = this->lib.get_layout();
+    for (size_t i = begin; i < end; i++) {
+        this->format_item(out, layout[i]);
+    }
+}
+
+void Writer::format_item(std::string &out, const LayoutItem &item) const
+{
+    if (item.type == LayoutItem::STATEMENT) {
+        this->format_statement(out, item);
+        return;
+    }
+    TokenEmitter emitter(out, item);
+    switch (item.type) {
+    case LayoutItem::COMMENT:
+        emitter.emit_recorded("$(" + item.text + "$)");
+        break;
+    case LayoutItem::OPEN_BLOCK:
+        emitter.emit_recorded("${");
+        break;
+    case LayoutItem::CLOSE_BLOCK:
+        emitter.emit_recorded("$}");
+        break;
+    case LayoutItem::END_OF_FILE:
+        emitter.emit_recorded("");
+        break;
+    default:
+        throw MMPPException("Invalid layout item");
+    }
+}
+
+void Writer::format_statement(std::string &out, const LayoutItem &item) const
+{
+    TokenEmitter emitter(out, item);
+
+    // The statement head (up to $= for $p statements) always uses the recorded spacing
+    if (item.label != LabTok{}) {
+        emitter.emit_recorded(this->lib.resolve_label(item.label));
+    }
+    emitter.emit_recorded(std::string("$") + item.keyword);
+    if (item.keyword == 'c' || item.keyword == 'v' || item.keyword == 'd') {
+        for (const auto &sym : item.symbols) {
+            emitter.emit_recorded(this->lib.resolve_symbol(sym));
+        }
+    } else {
+        for (const auto &sym : this->lib.get_sentence(item.label)) {
+            emitter.emit_recorded(this->lib.resolve_symbol(sym));
+        }
+    }
+    if (item.keyword != 'p') {
+        emitter.emit_recorded("$.");
+        return;
+    }
+    emitter.emit_recorded("$=");
+
+    /* Then the proof tokens are generated; if they are as many as they were in the
+     * original file, they are placed with the recorded spacing, otherwise they
+     * are wrapped in the same style as metamath.exe. */
+    std::vector< std::string > toks;
+    std::string code_string;
+    bool recorded_chunks = true;
+    auto proof = this->lib.get_assertion(item.label).get_proof();
+    if (proof == nullptr) {
+        toks.push_back("?");
+    } else if (auto compressed = dynamic_cast< const CompressedProof* >(proof.get())) {
+        toks.push_back("(");
+        for (const auto &ref : compressed->get_refs()) {
+            toks.push_back(this->lib.resolve_label(ref));
+        }
+        toks.push_back(")");
+        CompressedEncoder ce;
+        for (const auto &code : compressed->get_codes()) {
+            code_string += ce.push_code(code);
+        }
+        size_t recorded_len = std::accumulate(item.proof_chunks.begin(), item.proof_chunks.end(), size_t(0));
+        if (recorded_len == code_string.size()) {
+            size_t pos = 0;
+            for (const auto len : item.proof_chunks) {
+                toks.push_back(code_string.substr(pos, len));
+                pos += len;
+            }
+        } else {
+            recorded_chunks = false;
+        }
+    } else if (auto uncompressed = dynamic_cast< const UncompressedProof* >(proof.get())) {
+        for (const auto &label : uncompressed->get_labels()) {
+            toks.push_back(this->lib.resolve_label(label));
+        }
+    } else {
+        throw MMPPException("Unknown proof type");
+    }
+
+    if (recorded_chunks && emitter.get_idx() + toks.size() + 1 == item.tokens_num) {
+        for (const auto &tok : toks) {
+            emitter.emit_recorded(tok);
+        }
+        emitter.emit_recorded("$.");
+    } else {
+        bool first = true;
+        for (const auto &tok : toks) {
+            if (first) {
+                emitter.emit_with_recorded_comments(tok);
+            } else {
+                emitter.emit_wrapped(tok);
+            }
+            first = false;
+        }
+        emitter.emit_filling(code_string);
+        emitter.emit_wrapped("$.");
+    }
+}
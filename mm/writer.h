@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+
+#include <boost/filesystem/path.hpp>
+
+#include "library.h"
+
+/* Write a library back to the Metamath format. The library must have been
+ * read with a Reader configured to store the database layout: statements
+ * are generated from the library content (so labels, symbols and proofs can
+ * be changed in between), while comments, scoping blocks and whitespace are
+ * taken from the layout. If nothing has been changed, the original file is
+ * reproduced byte by byte (except for file inclusions, which are flattened).
+ *
+ * Items are formatted in parallel in independent chunks, which are then
+ * streamed in order to the output.
+ */
+class Writer {
+public:
+    Writer(const LibraryImpl &lib, size_t threads_num = 0);
+    void write(std::ostream &os) const;
+    void write(const boost::filesystem::path &filename) const;
+
+private:
+    void format_items(std::string &out, size_t begin, size_t end) const;
+    void format_item(std::string &out, const LayoutItem &item) const;
+    void format_statement(std::string &out, const LayoutItem &item) const;
+
+    const LibraryImpl &lib;
+    size_t threads_num;
+};
@@ -143,8 +143,13 @@ SOURCES += \
     apps/resolver.cpp \
     provers/subst.cpp \
     apps/verify.cpp \
+    apps/benchmarks.cpp \
     mm/setmm.cpp \
-    test/test_wff.cpp
+    test/test_wff.cpp \
+    mm/writer.cpp \
+    apps/rewrite.cpp \
+    mm/proofstats.cpp \
+    mm/treeverifier.cpp
 
 HEADERS += \
     pch.h \
@@ -198,7 +203,15 @@ HEADERS += \
     provers/subst.h \
     mm/setmm.h \
     test/test.h \
-    libs/backward.h
+    libs/backward.h \
+    mm/writer.h \
+    mm/proofstats.h \
+    mm/treeverifier.h \
+    utils/lrucache.h \
+    parsing/discrtree.h \
+    parsing/termstore.h \
+    parsing/fingerprint.h \
+    utils/parallel.h
 
 DISTFILES += \
     README.md \
@@ -4,20 +4,27 @@
 #include <unordered_map>
 #include <set>
 #include <vector>
+#include <tuple>
+#include <cassert>
 
 // Implementation from https://en.wikipedia.org/wiki/Disjoint-set_data_structure
+// Once mark() has been called, all changes are logged, so that undo_to() can roll them back
 template< typename LabType >
 class DisjointSet {
 public:
     void make_set(LabType lab) {
         // Only insert if the node does not exists yet
-        this->parent.insert(std::make_pair(lab, lab));
+        bool inserted;
+        std::tie(std::ignore, inserted) = this->parent.insert(std::make_pair(lab, lab));
         this->rank.insert(std::make_pair(lab, 0));
+        if (inserted && this->logging) {
+            this->log.push_back({ LogEntry::Created, lab, lab, 0 });
+        }
     }
 
     LabType find_set(LabType lab) {
         if (this->parent[lab] != lab) {
-            this->parent[lab] = this->find_set(parent[lab]);
+            this->set_parent(lab, this->find_set(parent[lab]));
         }
         return parent[lab];
     }
@@ -29,13 +36,16 @@ public:
             return std::make_pair(false, l1);
         }
         if (this->rank[l1] < this->rank[l2]) {
-            this->parent[l1] = l2;
+            this->set_parent(l1, l2);
             return std::make_pair(true, l2);
         } else if (this->rank[l1] > this->rank[l2]) {
-            this->parent[l2] = l1;
+            this->set_parent(l2, l1);
             return std::make_pair(true, l1);
         } else {
-            this->parent[l2] = l1;
+            this->set_parent(l2, l1);
+            if (this->logging) {
+                this->log.push_back({ LogEntry::Rank, l1, l1, this->rank[l1] });
+            }
             this->rank[l1]++;
             return std::make_pair(true, l1);
         }
@@ -44,11 +54,53 @@ public:
     void clear() {
         this->parent.clear();
         this->rank.clear();
+        this->log.clear();
+    }
+
+    size_t mark() {
+        this->logging = true;
+        return this->log.size();
+    }
+
+    void undo_to(size_t mark) {
+        assert(mark <= this->log.size());
+        while (this->log.size() > mark) {
+            const auto &entry = this->log.back();
+            switch (entry.kind) {
+            case LogEntry::Created:
+                this->parent.erase(entry.lab);
+                this->rank.erase(entry.lab);
+                break;
+            case LogEntry::Parent:
+                this->parent[entry.lab] = entry.old_parent;
+                break;
+            case LogEntry::Rank:
+                this->rank[entry.lab] = entry.old_rank;
+                break;
+            }
+            this->log.pop_back();
+        }
     }
 
 private:
+    void set_parent(LabType lab, LabType new_parent) {
+        if (this->logging) {
+            this->log.push_back({ LogEntry::Parent, lab, this->parent[lab], 0 });
+        }
+        this->parent[lab] = new_parent;
+    }
+
+    struct LogEntry {
+        enum Kind { Created, Parent, Rank } kind;
+        LabType lab;
+        LabType old_parent;
+        size_t old_rank;
+    };
+
     std::unordered_map< LabType, LabType > parent;
     std::unordered_map< LabType, size_t > rank;
+    bool logging = false;
+    std::vector< LogEntry > log;
 };
 
 // Incremental cycle detector
@@ -62,7 +114,11 @@ public:
     }
 
     void make_node(LabType node) {
-        this->deps.insert(std::pair< LabType, std::set< LabType > >(node, {}));
+        bool res;
+        std::tie(std::ignore, res) = this->deps.insert(std::pair< LabType, std::set< LabType > >(node, {}));
+        if (res && this->logging) {
+            this->log.push_back({ true, node, node });
+        }
     }
 
     void make_edge(LabType from, LabType to) {
@@ -70,6 +126,9 @@ public:
         std::tie(std::ignore, res) = this->deps.at(from).insert(to);
         if (res) {
             this->edge_num++;
+            if (this->logging) {
+                this->log.push_back({ false, from, to });
+            }
         }
     }
 
@@ -91,6 +150,28 @@ public:
 
     void clear() {
         this->deps.clear();
+        this->edge_num = 0;
+        this->log.clear();
+    }
+
+    // Once mark() has been called, all changes are logged, so that undo_to() can roll them back
+    size_t mark() {
+        this->logging = true;
+        return this->log.size();
+    }
+
+    void undo_to(size_t mark) {
+        assert(mark <= this->log.size());
+        while (this->log.size() > mark) {
+            const auto &entry = this->log.back();
+            if (entry.is_node) {
+                this->deps.erase(entry.from);
+            } else {
+                this->deps.at(entry.from).erase(entry.to);
+                this->edge_num--;
+            }
+            this->log.pop_back();
+        }
     }
 
     enum Status { Unvisited = 0, Visiting, Visited };
@@ -147,4 +228,12 @@ public:
 private:
     std::unordered_map< LabType, std::set< LabType > > deps;
     size_t edge_num;
+    struct LogEntry {
+        bool is_node;
+        LabType from;
+        LabType to;
+    };
+
+    bool logging = false;
+    std::vector< LogEntry > log;
 };
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <tuple>
+#include <cstdint>
+
+#include "parser.h"
+
+/* A discrimination tree indexes a set of templates (parsing trees whose variables
+ * can be replaced by any subtree) so that, given a query tree, only the templates
+ * that can possibly be unilaterally unified with it are retrieved. Templates are
+ * inserted as the sequence of the labels of their nodes in preorder, with all the
+ * variables replaced by a wildcard; since the number of children of a node is
+ * determined by its label, the sequence identifies the shape of the tree. When the
+ * query is matched against the trie a wildcard skips a whole subtree of the query,
+ * which is cheap because ParsingTree2 stores the size of each subtree. The index is
+ * only a filter: repeated variables and variable types are not checked, so the
+ * candidates still have to go through a unificator. */
+template< typename SymType, typename LabType, typename ValueType >
+class DiscriminationTree {
+public:
+    DiscriminationTree() : nodes(1) {
+    }
+
+    void insert(const ParsingTree2< SymType, LabType > &pt, const std::function< bool(LabType) > &is_var, const ValueType &value) {
+        uint32_t cur = 0;
+        for (size_t i = 0; i < pt.get_nodes_len(); i++) {
+            const auto &node = pt.get_nodes()[i];
+            if (is_var(node.label)) {
+                assert(node.descendants_num == 0);
+                if (this->nodes[cur].wildcard == 0) {
+                    uint32_t next = this->nodes.size();
+                    this->nodes.emplace_back();
+                    this->nodes[cur].wildcard = next;
+                }
+                cur = this->nodes[cur].wildcard;
+            } else {
+                auto &children = this->nodes[cur].children;
+                auto it = std::lower_bound(children.begin(), children.end(), node.label, [](const auto &x, const auto &y) { return x.first < y; });
+                if (it != children.end() && it->first == node.label) {
+                    cur = it->second;
+                } else {
+                    uint32_t next = this->nodes.size();
+                    children.insert(it, std::make_pair(node.label, next));
+                    this->nodes.emplace_back();
+                    cur = next;
+                }
+            }
+        }
+        this->nodes[cur].values.push_back(value);
+        this->values_num++;
+    }
+
+    void retrieve(const ParsingTree2< SymType, LabType > &pt, const std::function< void(const ValueType&) > &callback) const {
+        const auto pt_nodes = pt.get_nodes();
+        const size_t pt_len = pt.get_nodes_len();
+        std::vector< std::pair< uint32_t, size_t > > stack;
+        stack.push_back(std::make_pair(0, 0));
+        while (!stack.empty()) {
+            uint32_t cur;
+            size_t pos;
+            std::tie(cur, pos) = stack.back();
+            stack.pop_back();
+            const auto &trie_node = this->nodes[cur];
+            if (pos == pt_len) {
+                for (const auto &value : trie_node.values) {
+                    callback(value);
+                }
+                continue;
+            }
+            const auto &node = pt_nodes[pos];
+            if (trie_node.wildcard != 0) {
+                stack.push_back(std::make_pair(trie_node.wildcard, pos + node.descendants_num + 1));
+            }
+            const auto &children = trie_node.children;
+            auto it = std::lower_bound(children.begin(), children.end(), node.label, [](const auto &x, const auto &y) { return x.first < y; });
+            if (it != children.end() && it->first == node.label) {
+                stack.push_back(std::make_pair(it->second, pos + 1));
+            }
+        }
+    }
+
+    std::vector< ValueType > retrieve(const ParsingTree2< SymType, LabType > &pt) const {
+        std::vector< ValueType > ret;
+        this->retrieve(pt, [&ret](const ValueType &value) { ret.push_back(value); });
+        return ret;
+    }
+
+    size_t get_nodes_num() const {
+        return this->nodes.size();
+    }
+
+    size_t get_values_num() const {
+        return this->values_num;
+    }
+
+private:
+    struct Node {
+        // Children are sorted by label; the wildcard child is zero when absent, since the root is never a child
+        std::vector< std::pair< LabType, uint32_t > > children;
+        uint32_t wildcard = 0;
+        std::vector< ValueType > values;
+    };
+
+    std::vector< Node > nodes;
+    size_t values_num = 0;
+};
@@ -2,139 +2,356 @@
 
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <iostream>
 #include <algorithm>
+#include <limits>
+#include <cstdint>
+
+#include <boost/functional/hash.hpp>
 
 #include "mm/library.h"
 #include "parser.h"
 
-template< typename SymType, typename LabType >
-struct EarleyState {
-    size_t initial;
-    size_t current;
-    SymType type;
-    LabType der_lab;
-    const std::vector< SymType > *der;
-    std::vector< std::pair< size_t, size_t > > children;
-
-    bool operator==(const EarleyState &x) const {
-        return this->initial == x.initial && this->current == x.current && this->type == x.type && this->der_lab == x.der_lab && this->der == x.der;
-    }
-
-    ParsingTree< SymType, LabType > get_tree(const std::vector< std::vector< EarleyState > > &state) const {
-        ParsingTree< SymType, LabType > ret;
-        ret.label = this->der_lab;
-        ret.type = this->type;
-        for (auto &child : this->children) {
-            ret.children.push_back(state[child.first][child.second].get_tree(state));
-        }
-        return ret;
-    }
-};
-
-// See http://loup-vaillant.fr/tutorials/earley-parsing/recogniser
-// FIXME This version does not support empty derivations
+/* An Earley parser (see http://loup-vaillant.fr/tutorials/earley-parsing/recogniser),
+ * which accepts any context free grammar, including ambiguous ones and ones with
+ * empty derivations; it is slower than the LR parser on the grammars the latter
+ * handles well, but its running time is polynomial in all cases.
+ *
+ * The items of each set are deduplicated with a hash table. Instead of copying the
+ * children in every item, each item keeps a list of links, every one of which
+ * records the item it was advanced from and the completed item (or the terminal)
+ * that advanced it: these links form a shared packed parse forest, from which a
+ * single tree is extracted at the end. Predictions are filtered with the FIRST
+ * sets of the nonterminals, and empty derivations are handled by remembering, in
+ * each set, the nonterminals that were completed without consuming any symbol.
+ */
 template< typename SymType, typename LabType >
 class EarleyParser : public Parser< SymType, LabType > {
 public:
     EarleyParser(const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector<SymType> > > > &derivations) :
         derivations(derivations) {
+        this->compile_grammar();
     }
 
     using Parser< SymType, LabType >::parse;
     ParsingTree< SymType, LabType > parse(typename std::vector<SymType>::const_iterator sent_begin, typename std::vector<SymType>::const_iterator sent_end, SymType type) const {
-        /* For every position (plus one end-of-string position) we maintain a list
-         * of tuples whose elements are the initial position of that item, the position
-         * of the current point and the associated derivation. */
-        std::vector< std::vector< EarleyState< SymType, LabType > > > state;
-        size_t sent_size = sent_end - sent_begin;
-        state.resize(sent_size + 1);
-
-        // The state is initialized with the derivations for the target type
-        for (auto &der : this->derivations.at(type)) {
-            state[0].push_back({ 0, 0, type, der.first, &der.second, {} });
+        auto type_it = this->nts_idx.find(type);
+        if (type_it == this->nts_idx.end()) {
+            return {};
+        }
+        EarleyParsingHelper helper(*this, sent_begin, sent_end);
+        return helper.parse(type_it->second);
+    }
+
+private:
+    static const uint32_t NO_NT = std::numeric_limits< uint32_t >::max();
+    static const uint32_t NONE = std::numeric_limits< uint32_t >::max();
+
+    struct Rule {
+        uint32_t nt;
+        LabType label;
+        const std::vector< SymType > *rhs;
+        // For each symbol of the right hand side, the index of its nonterminal or NO_NT if it is a terminal
+        std::vector< uint32_t > rhs_nts;
+    };
+
+    struct Nonterminal {
+        SymType sym;
+        bool nullable = false;
+        std::unordered_set< SymType > first;
+        // Rules that can begin with each terminal, and rules that can derive the empty sentence
+        std::unordered_map< SymType, std::vector< uint32_t > > predict;
+        std::vector< uint32_t > predict_empty;
+    };
+
+    void compile_grammar() {
+        for (const auto &der : this->derivations) {
+            this->nts_idx.insert(std::make_pair(der.first, static_cast< uint32_t >(this->nts.size())));
+            this->nts.emplace_back();
+            this->nts.back().sym = der.first;
+        }
+        for (const auto &der : this->derivations) {
+            uint32_t nt = this->nts_idx.at(der.first);
+            for (const auto &rule : der.second) {
+                Rule r;
+                r.nt = nt;
+                r.label = rule.first;
+                r.rhs = &rule.second;
+                for (const auto &sym : rule.second) {
+                    auto it = this->nts_idx.find(sym);
+                    r.rhs_nts.push_back(it == this->nts_idx.end() ? NO_NT : it->second);
+                }
+                this->rules.push_back(r);
+            }
         }
 
-        // We use vector indices instead of iterators to avoid problems with reallocation
-        for (size_t i = 0; i < state.size(); i++) {
-            for (size_t j = 0; j < state[i].size(); j++) {
-
-                if (state[i][j].current == state[i][j].der->size()) {
-                    // If the item is finished, do the completion
-                    for (size_t k = 0; k < state[state[i][j].initial].size(); k++) {
-                        EarleyState< SymType, LabType > &cur_state2 = state[state[i][j].initial][k];
-                        if (cur_state2.current < cur_state2.der->size() && (*cur_state2.der)[cur_state2.current] == state[i][j].type) {
-                            EarleyState< SymType, LabType > new_item = { cur_state2.initial, cur_state2.current+1, cur_state2.type, cur_state2.der_lab, cur_state2.der, cur_state2.children };
-                            new_item.children.push_back(std::make_pair(i, j));
-                            if (find(state[i].begin(), state[i].end(), new_item) == state[i].end()) {
-                                state[i].push_back(new_item);
-                            }
+        // Compute nullable nonterminals and FIRST sets with a fixpoint
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (const auto &rule : this->rules) {
+                auto &nt = this->nts[rule.nt];
+                bool all_nullable = true;
+                for (size_t i = 0; i < rule.rhs_nts.size() && all_nullable; i++) {
+                    if (rule.rhs_nts[i] == NO_NT) {
+                        changed |= nt.first.insert((*rule.rhs)[i]).second;
+                        all_nullable = false;
+                    } else {
+                        const auto &child = this->nts[rule.rhs_nts[i]];
+                        for (const auto &sym : child.first) {
+                            changed |= nt.first.insert(sym).second;
                         }
+                        all_nullable = child.nullable;
                     }
+                }
+                if (all_nullable && !nt.nullable) {
+                    nt.nullable = true;
+                    changed = true;
+                }
+            }
+        }
+
+        // Build the prediction tables
+        for (uint32_t r = 0; r < this->rules.size(); r++) {
+            const auto &rule = this->rules[r];
+            auto &nt = this->nts[rule.nt];
+            std::unordered_set< SymType > starts;
+            bool all_nullable = true;
+            for (size_t i = 0; i < rule.rhs_nts.size() && all_nullable; i++) {
+                if (rule.rhs_nts[i] == NO_NT) {
+                    starts.insert((*rule.rhs)[i]);
+                    all_nullable = false;
                 } else {
-                    // Else search current symbol in derivations
-                    EarleyState< SymType, LabType > &cur_state = state[i][j];
-                    SymType symbol = (*cur_state.der)[cur_state.current];
-                    auto it = this->derivations.find(symbol);
-                    if (it != this->derivations.end()) {
-                        // Current symbol is in the derivations, therefore non-terminal: prediction phase
-                        // Add one new item for every derivation, unless the same item is already present
-                        for (auto &new_der : it->second) {
-                            EarleyState< SymType, LabType > new_item = { i, 0, symbol, new_der.first, &new_der.second, {} };
-                            if (find(state[i].begin(), state[i].end(), new_item) == state[i].end()) {
-                                state[i].push_back(new_item);
-                            }
-                        }
-                    } else {
-                        // Current symbol it not in the derivations, therefore is terminal: scan phase
-                        // If the symbol matches the sentence, promote item to the new bucket
-                        if (i < sent_size && symbol == sent_begin[i]) {
-                            EarleyState< SymType, LabType > new_item = { cur_state.initial, cur_state.current+1, cur_state.type, cur_state.der_lab, cur_state.der, cur_state.children };
-                            if (find(state[i+1].begin(), state[i+1].end(), new_item) == state[i+1].end()) {
-                                state[i+1].push_back(new_item);
-                            }
-                        }
+                    const auto &child = this->nts[rule.rhs_nts[i]];
+                    starts.insert(child.first.begin(), child.first.end());
+                    all_nullable = child.nullable;
+                }
+            }
+            if (all_nullable) {
+                nt.predict_empty.push_back(r);
+            } else {
+                for (const auto &sym : starts) {
+                    nt.predict[sym].push_back(r);
+                }
+            }
+        }
+    }
+
+    // An item is identified by the set it lives in and its index in there
+    struct ItemRef {
+        uint32_t set;
+        uint32_t idx;
+    };
+
+    struct Item {
+        uint32_t rule;
+        uint32_t dot;
+        uint32_t origin;
+        uint32_t first_link;
+    };
+
+    struct Link {
+        ItemRef pred;
+        // If child.set is NONE, the item was advanced by scanning a terminal
+        ItemRef child;
+        uint32_t next;
+    };
+
+    struct ItemKey {
+        uint32_t rule;
+        uint32_t dot;
+        uint32_t origin;
+
+        bool operator==(const ItemKey &x) const {
+            return this->rule == x.rule && this->dot == x.dot && this->origin == x.origin;
+        }
+    };
+
+    struct ItemKeyHash {
+        size_t operator()(const ItemKey &x) const {
+            size_t ret = 0;
+            boost::hash_combine(ret, x.rule);
+            boost::hash_combine(ret, x.dot);
+            boost::hash_combine(ret, x.origin);
+            return ret;
+        }
+    };
+
+    struct ItemSet {
+        std::vector< Item > items;
+        std::unordered_map< ItemKey, uint32_t, ItemKeyHash > items_idx;
+        // For each nonterminal, the items waiting for it and the items that derived it from the empty sentence
+        std::unordered_map< uint32_t, std::vector< uint32_t > > waiting;
+        std::unordered_map< uint32_t, std::vector< uint32_t > > completed_empty;
+        std::unordered_set< uint32_t > predicted;
+    };
+
+    class EarleyParsingHelper {
+    public:
+        EarleyParsingHelper(const EarleyParser &parser, typename std::vector<SymType>::const_iterator sent_begin, typename std::vector<SymType>::const_iterator sent_end) :
+            parser(parser), sent_begin(sent_begin), sent_len(sent_end - sent_begin), sets(sent_len + 1) {
+        }
+
+        ParsingTree< SymType, LabType > parse(uint32_t type_nt) {
+            this->predict(0, type_nt);
+            for (uint32_t i = 0; i < this->sets.size(); i++) {
+                // Items are appended while the set is processed, so we use indices
+                for (uint32_t j = 0; j < this->sets[i].items.size(); j++) {
+                    this->process(i, j);
+                }
+            }
+
+            // Final phase: see if the sentence was accepted
+            const auto &last = this->sets[this->sent_len];
+            for (uint32_t j = 0; j < last.items.size(); j++) {
+                const Item &item = last.items[j];
+                const Rule &rule = this->parser.rules[item.rule];
+                if (item.origin == 0 && item.dot == rule.rhs->size() && rule.nt == type_nt) {
+                    ParsingTree< SymType, LabType > tree;
+                    this->in_progress.resize(this->sets.size());
+                    for (uint32_t k = 0; k < this->sets.size(); k++) {
+                        this->in_progress[k].resize(this->sets[k].items.size(), false);
+                    }
+                    if (this->build_tree({ static_cast< uint32_t >(this->sent_len), j }, tree)) {
+                        return tree;
+                    }
+                }
+            }
+            return {};
+        }
+
+    private:
+        Item &get_item(ItemRef ref) {
+            return this->sets[ref.set].items[ref.idx];
+        }
+
+        // Add an item to a set, unless it is already there, and record the link that produced it
+        void add_item(uint32_t set, uint32_t rule, uint32_t dot, uint32_t origin, ItemRef pred, ItemRef child) {
+            auto &item_set = this->sets[set];
+            auto res = item_set.items_idx.insert(std::make_pair(ItemKey{ rule, dot, origin }, static_cast< uint32_t >(item_set.items.size())));
+            if (res.second) {
+                item_set.items.push_back({ rule, dot, origin, NONE });
+            }
+            if (pred.set != NONE) {
+                Item &item = item_set.items[res.first->second];
+                this->links.push_back({ pred, child, item.first_link });
+                item.first_link = static_cast< uint32_t >(this->links.size() - 1);
+            }
+        }
+
+        void predict(uint32_t i, uint32_t nt_idx) {
+            if (!this->sets[i].predicted.insert(nt_idx).second) {
+                return;
+            }
+            const auto &nt = this->parser.nts[nt_idx];
+            if (i < this->sent_len) {
+                auto it = nt.predict.find(this->sent_begin[i]);
+                if (it != nt.predict.end()) {
+                    for (const auto rule : it->second) {
+                        this->add_item(i, rule, 0, i, { NONE, NONE }, { NONE, NONE });
                     }
                 }
             }
+            for (const auto rule : nt.predict_empty) {
+                this->add_item(i, rule, 0, i, { NONE, NONE }, { NONE, NONE });
+            }
         }
 
-    #if 0
-        // Dump final status for debug
-        std::cout << "Earley dump" << std::endl;
-        for (size_t i = 0; i < state.size(); i++) {
-            std::cout << "== " << i << " ==" << std::endl;
-            for (size_t j = 0; j < state[i].size(); j++) {
-                EarleyState< SymType, LabType > &cur_state = state[i][j];
-                std::cout << cur_state.der_lab << " (" << cur_state.initial << "): " << cur_state.type << " -->";
-                for (size_t k = 0; k < cur_state.der->size(); k++) {
-                    if (k == cur_state.current) {
-                        std::cout << " •";
+        void process(uint32_t i, uint32_t j) {
+            const Item item = this->sets[i].items[j];
+            const Rule &rule = this->parser.rules[item.rule];
+            if (item.dot == rule.rhs->size()) {
+                // Completion: advance all the items that were waiting for this nonterminal
+                if (item.origin == i) {
+                    this->sets[i].completed_empty[rule.nt].push_back(j);
+                }
+                auto it = this->sets[item.origin].waiting.find(rule.nt);
+                if (it == this->sets[item.origin].waiting.end()) {
+                    return;
+                }
+                for (const auto w : it->second) {
+                    // Copy the item, since adding to the same set can reallocate it
+                    const Item waiting = this->sets[item.origin].items[w];
+                    this->add_item(i, waiting.rule, waiting.dot + 1, waiting.origin, { item.origin, w }, { i, j });
+                }
+            } else if (rule.rhs_nts[item.dot] != NO_NT) {
+                // Prediction: the item waits for a nonterminal
+                uint32_t nt = rule.rhs_nts[item.dot];
+                this->sets[i].waiting[nt].push_back(j);
+                this->predict(i, nt);
+                // If the nonterminal was already derived from the empty sentence here, advance immediately
+                auto it = this->sets[i].completed_empty.find(nt);
+                if (it != this->sets[i].completed_empty.end()) {
+                    for (size_t k = 0; k < it->second.size(); k++) {
+                        this->add_item(i, item.rule, item.dot + 1, item.origin, { i, j }, { i, it->second[k] });
                     }
-                    std::cout << " " << (*cur_state.der)[k];
                 }
-                if (cur_state.der->size() == cur_state.current) {
-                    std::cout << " •";
+            } else {
+                // Scan: if the terminal matches the sentence, promote the item to the next set
+                if (i < this->sent_len && (*rule.rhs)[item.dot] == this->sent_begin[i]) {
+                    this->add_item(i + 1, item.rule, item.dot + 1, item.origin, { i, j }, { NONE, NONE });
+                }
+            }
+        }
+
+        /* Collect the children of the item, following the first link that leads to a finite
+         * tree; cycles (which can only happen in grammars with cyclic or empty derivations)
+         * are broken by refusing to enter a completed item that is already being built. */
+        bool collect_children(ItemRef ref, std::vector< ParsingTree< SymType, LabType > > &children) {
+            const Item &item = this->get_item(ref);
+            if (item.dot == 0) {
+                return true;
+            }
+            for (uint32_t l = item.first_link; l != NONE; l = this->links[l].next) {
+                const Link link = this->links[l];
+                size_t old_size = children.size();
+                if (!this->collect_children(link.pred, children)) {
+                    continue;
+                }
+                if (link.child.set == NONE) {
+                    return true;
+                }
+                ParsingTree< SymType, LabType > child;
+                if (this->build_tree(link.child, child)) {
+                    children.push_back(std::move(child));
+                    return true;
                 }
-                std::cout << std::endl;
+                children.resize(old_size);
             }
-            std::cout << std::endl;
+            return false;
         }
-    #endif
-
-        // Final phase: see if the sentence was accepted
-        for (size_t j = 0; j < state[sent_size].size(); j++) {
-            EarleyState< SymType, LabType > &cur_state = state[sent_size][j];
-            if (cur_state.initial == 0 && cur_state.current == cur_state.der->size() && cur_state.type == type) {
-                ParsingTree< SymType, LabType > tree = cur_state.get_tree(state);
-                return tree;
+
+        bool build_tree(ItemRef ref, ParsingTree< SymType, LabType > &tree) {
+            if (this->in_progress[ref.set][ref.idx]) {
+                return false;
             }
+            this->in_progress[ref.set][ref.idx] = true;
+            const Rule &rule = this->parser.rules[this->get_item(ref).rule];
+            tree.label = rule.label;
+            tree.type = this->parser.nts[rule.nt].sym;
+            tree.children.clear();
+            bool ret = this->collect_children(ref, tree.children);
+            this->in_progress[ref.set][ref.idx] = false;
+            return ret;
         }
-        ParsingTree< SymType, LabType > ret;
-        ret.label = {};
-        return ret;
-    }
 
-private:
+        const EarleyParser &parser;
+        typename std::vector<SymType>::const_iterator sent_begin;
+        size_t sent_len;
+        std::vector< ItemSet > sets;
+        std::vector< Link > links;
+        std::vector< std::vector< bool > > in_progress;
+    };
+
     const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector<SymType> > > > &derivations;
+    std::vector< Rule > rules;
+    std::vector< Nonterminal > nts;
+    std::unordered_map< SymType, uint32_t > nts_idx;
 };
+
+template< typename SymType, typename LabType >
+const uint32_t EarleyParser< SymType, LabType >::NO_NT;
+
+template< typename SymType, typename LabType >
+const uint32_t EarleyParser< SymType, LabType >::NONE;
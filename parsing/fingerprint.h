@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+#include "parser.h"
+
+/* A fingerprint is a fixed width summary of the top of a parsing tree: the labels found at
+ * a few fixed positions (the root, its first three children and the first two children of
+ * the first two children). In the fingerprint of a template the positions covered by a
+ * variable hold a wildcard (the null label); the same value is used for positions that do
+ * not exist in the tree, which is harmless, because the label of the parent already
+ * determines how many children there are. A template can be unilaterally unified with a
+ * target only if each label of its fingerprint is either a wildcard or equal to the
+ * corresponding label in the target, which is checked with a branchless loop that the
+ * compiler can vectorize, before building any unificator. */
+template< typename LabType >
+struct TreeFingerprint {
+    static const size_t WIDTH = 8;
+    std::array< LabType, WIDTH > labels{};
+
+    bool operator==(const TreeFingerprint< LabType > &other) const {
+        return this->labels == other.labels;
+    }
+
+    bool operator!=(const TreeFingerprint< LabType > &other) const {
+        return !this->operator==(other);
+    }
+};
+
+template< typename LabType >
+bool fingerprints_compatible(const TreeFingerprint< LabType > &templ, const TreeFingerprint< LabType > &target) {
+    bool ret = true;
+    for (size_t i = 0; i < TreeFingerprint< LabType >::WIDTH; i++) {
+        ret &= (templ.labels[i] == LabType{}) | (templ.labels[i] == target.labels[i]);
+    }
+    return ret;
+}
+
+/* When computing the fingerprint of a target, pass an is_var that always returns false,
+ * or use make_target_fingerprint() */
+template< typename SymType, typename LabType >
+TreeFingerprint< LabType > make_fingerprint(const ParsingTree2< SymType, LabType > &pt, const std::function< bool(LabType) > &is_var) {
+    static const std::array< std::vector< size_t >, TreeFingerprint< LabType >::WIDTH > paths = {{ {}, { 0 }, { 1 }, { 2 }, { 0, 0 }, { 0, 1 }, { 1, 0 }, { 1, 1 } }};
+    TreeFingerprint< LabType > ret;
+    if (pt.get_nodes_len() == 0) {
+        return ret;
+    }
+    for (size_t i = 0; i < TreeFingerprint< LabType >::WIDTH; i++) {
+        auto it = pt.get_root();
+        bool found = true;
+        for (const size_t step : paths[i]) {
+            if (is_var(it.get_node().label)) {
+                found = false;
+                break;
+            }
+            auto child = it.begin();
+            for (size_t j = 0; j < step && child != it.end(); j++) {
+                ++child;
+            }
+            if (child == it.end()) {
+                found = false;
+                break;
+            }
+            it.item_num = child.item_num;
+        }
+        if (found && !is_var(it.get_node().label)) {
+            ret.labels[i] = it.get_node().label;
+        }
+    }
+    return ret;
+}
+
+template< typename SymType, typename LabType >
+TreeFingerprint< LabType > make_target_fingerprint(const ParsingTree2< SymType, LabType > &pt) {
+    return make_fingerprint(pt, std::function< bool(LabType) >([](LabType) { return false; }));
+}
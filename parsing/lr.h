@@ -9,13 +9,19 @@
 #include <iostream>
 #include <functional>
 #include <memory>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
 
 #include <boost/serialization/unordered_map.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/utility.hpp>
+#include <boost/functional/hash.hpp>
 
 #include "parser.h"
 #include "libs/serialize_tuple.h"
+#include "utils/utils.h"
+#include "utils/parallel.h"
 
 // The state encodes (producting symbol, rule name, position, producted sentence)
 template< typename SymType, typename LabType >
@@ -31,63 +37,6 @@ std::ostream &default_lab_printer(std::ostream &os, LabType sym) {
     return os << sym;
 }
 
-template< typename SymType, typename LabType >
-static LRState< SymType, LabType > evolve_state(const LRState< SymType, LabType > &state, SymType sym, const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector< SymType > > > > &derivations) {
-    LRState< SymType, LabType > new_state;
-    std::queue< SymType > next_syms_queue;
-    std::set< SymType > next_syms;
-
-    // Read sym through each of the std::tuples
-    for (auto i : state) {
-        const auto &head_sym = std::get<0>(i);
-        const auto &rule = std::get<1>(i);
-        const size_t &pos = std::get<2>(i);
-        const std::vector< SymType > &sent = std::get<3>(i);
-        if (pos < sent.size() && sent[pos] == sym) {
-            new_state.insert(make_tuple(head_sym, rule, pos+1, sent));
-            if (pos+1 < sent.size()) {
-                next_syms_queue.push(sent[pos+1]);
-            }
-        }
-    }
-
-    // Saturate with fresh derivations
-    while (!next_syms_queue.empty()) {
-        auto next_sym = next_syms_queue.front();
-        next_syms_queue.pop();
-        bool res;
-        std::tie(std::ignore, res) = next_syms.insert(next_sym);
-        if (res) {
-            auto it = derivations.find(next_sym);
-            if (it != derivations.end()) {
-                for (auto j : it->second) {
-                    const auto &lab = j.first;
-                    const auto &sent = j.second;
-                    new_state.insert(make_tuple(next_sym, lab, 0, sent));
-                    if (sent.size() > 0) {
-                        next_syms_queue.push(sent[0]);
-                    }
-                }
-            }
-        }
-    }
-
-    return new_state;
-}
-
-template< typename SymType, typename LabType >
-static std::set< SymType > next_possible_symbols(const LRState< SymType, LabType > &state) {
-    std::set< SymType > res;
-    for (auto i : state) {
-        const size_t &pos = std::get<2>(i);
-        const std::vector< SymType > &sent = std::get<3>(i);
-        if (pos < sent.size()) {
-            res.insert(sent[pos]);
-        }
-    }
-    return res;
-}
-
 template< typename SymType, typename LabType >
 static void print_state(const LRState< SymType, LabType > &state,
                  const std::function< std::ostream&(std::ostream&, SymType) > &sym_printer = default_sym_printer< SymType >,
@@ -128,93 +77,289 @@ static std::pair< size_t, size_t > count_rules(const LRState< SymType, LabType >
     return std::make_pair(shift_num, reduce_num);
 }
 
+/* A read-only view on the arrays of an LRAutomaton (see below), which is what the
+ * parser actually uses; the arrays can be owned by an LRAutomaton or live somewhere
+ * else (for example in a memory mapped cache file). */
+template< typename SymType, typename LabType >
+struct LRAutomatonView {
+    size_t states_num = 0;
+    size_t shifts_num = 0;
+    size_t reds_num = 0;
+    const uint32_t *shift_begin = nullptr;
+    const SymType *shift_syms = nullptr;
+    const uint32_t *shift_states = nullptr;
+    const uint32_t *red_begin = nullptr;
+    const SymType *red_types = nullptr;
+    const LabType *red_labels = nullptr;
+    const uint32_t *red_sym_nums = nullptr;
+    const uint32_t *red_var_nums = nullptr;
+
+    size_t get_states_num() const {
+        return this->states_num;
+    }
+
+    uint32_t find_shift(uint32_t state, const SymType &sym) const {
+        auto begin = this->shift_syms + this->shift_begin[state];
+        auto end = this->shift_syms + this->shift_begin[state+1];
+        auto it = std::lower_bound(begin, end, sym);
+        if (it == end || !(*it == sym)) {
+            return std::numeric_limits< uint32_t >::max();
+        }
+        return this->shift_states[it - this->shift_syms];
+    }
+
+    // Check that the arrays describe a well formed automaton, so that parsing cannot read out of them
+    bool is_consistent() const {
+        if (this->states_num == 0) {
+            return true;
+        }
+        if (this->shift_begin[0] != 0 || this->shift_begin[this->states_num] != this->shifts_num ||
+                this->red_begin[0] != 0 || this->red_begin[this->states_num] != this->reds_num) {
+            return false;
+        }
+        for (size_t i = 0; i < this->states_num; i++) {
+            if (this->shift_begin[i] > this->shift_begin[i+1] || this->red_begin[i] > this->red_begin[i+1]) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < this->shifts_num; i++) {
+            if (this->shift_states[i] >= this->states_num) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/* The LR automaton compiled in dense arrays: shifts are stored in CSR format, i.e., the
+ * shifts of state i are at positions between shift_begin[i] and shift_begin[i+1] of
+ * shift_syms and shift_states, sorted by symbol so that they can be binary searched;
+ * reductions are stored in the same way, each described by its head symbol, its label,
+ * its number of symbols and its number of variables. */
+template< typename SymType, typename LabType >
+struct LRAutomaton {
+    typedef std::unordered_map< size_t, std::pair< std::unordered_map< SymType, size_t >, std::vector< std::tuple< SymType, LabType, size_t, size_t > > > > CachedData;
+    static const uint32_t NO_STATE = std::numeric_limits< uint32_t >::max();
+
+    std::vector< uint32_t > shift_begin;
+    std::vector< SymType > shift_syms;
+    std::vector< uint32_t > shift_states;
+    std::vector< uint32_t > red_begin;
+    std::vector< SymType > red_types;
+    std::vector< LabType > red_labels;
+    std::vector< uint32_t > red_sym_nums;
+    std::vector< uint32_t > red_var_nums;
+
+    size_t get_states_num() const {
+        return this->shift_begin.empty() ? 0 : this->shift_begin.size() - 1;
+    }
+
+    uint32_t find_shift(uint32_t state, const SymType &sym) const {
+        return this->get_view().find_shift(state, sym);
+    }
+
+    LRAutomatonView< SymType, LabType > get_view() const {
+        LRAutomatonView< SymType, LabType > view;
+        view.states_num = this->get_states_num();
+        view.shifts_num = this->shift_syms.size();
+        view.reds_num = this->red_types.size();
+        view.shift_begin = this->shift_begin.data();
+        view.shift_syms = this->shift_syms.data();
+        view.shift_states = this->shift_states.data();
+        view.red_begin = this->red_begin.data();
+        view.red_types = this->red_types.data();
+        view.red_labels = this->red_labels.data();
+        view.red_sym_nums = this->red_sym_nums.data();
+        view.red_var_nums = this->red_var_nums.data();
+        return view;
+    }
+
+    static LRAutomaton< SymType, LabType > from_view(const LRAutomatonView< SymType, LabType > &view) {
+        LRAutomaton< SymType, LabType > ret;
+        if (view.states_num == 0) {
+            return ret;
+        }
+        ret.shift_begin.assign(view.shift_begin, view.shift_begin + view.states_num + 1);
+        ret.shift_syms.assign(view.shift_syms, view.shift_syms + view.shifts_num);
+        ret.shift_states.assign(view.shift_states, view.shift_states + view.shifts_num);
+        ret.red_begin.assign(view.red_begin, view.red_begin + view.states_num + 1);
+        ret.red_types.assign(view.red_types, view.red_types + view.reds_num);
+        ret.red_labels.assign(view.red_labels, view.red_labels + view.reds_num);
+        ret.red_sym_nums.assign(view.red_sym_nums, view.red_sym_nums + view.reds_num);
+        ret.red_var_nums.assign(view.red_var_nums, view.red_var_nums + view.reds_num);
+        return ret;
+    }
+
+    static LRAutomaton< SymType, LabType > from_cached_data(const CachedData &data) {
+        LRAutomaton< SymType, LabType > ret;
+        size_t states_num = 0;
+        size_t shifts_num = 0;
+        size_t reds_num = 0;
+        for (const auto &row : data) {
+            states_num = std::max(states_num, row.first + 1);
+            shifts_num += row.second.first.size();
+            reds_num += row.second.second.size();
+        }
+        assert_or_throw< MMPPException >(states_num < NO_STATE && shifts_num < NO_STATE && reds_num < NO_STATE, "LR automaton is too big");
+        ret.shift_begin.reserve(states_num + 1);
+        ret.shift_syms.reserve(shifts_num);
+        ret.shift_states.reserve(shifts_num);
+        ret.red_begin.reserve(states_num + 1);
+        ret.red_types.reserve(reds_num);
+        ret.red_labels.reserve(reds_num);
+        ret.red_sym_nums.reserve(reds_num);
+        ret.red_var_nums.reserve(reds_num);
+        std::vector< std::pair< SymType, size_t > > shifts;
+        for (size_t state = 0; state < states_num; state++) {
+            ret.shift_begin.push_back(static_cast< uint32_t >(ret.shift_syms.size()));
+            ret.red_begin.push_back(static_cast< uint32_t >(ret.red_types.size()));
+            auto it = data.find(state);
+            if (it == data.end()) {
+                continue;
+            }
+            shifts.assign(it->second.first.begin(), it->second.first.end());
+            std::sort(shifts.begin(), shifts.end(), [](const auto &x, const auto &y) { return x.first < y.first; });
+            for (const auto &shift : shifts) {
+                assert_or_throw< MMPPException >(shift.second < states_num, "LR automaton shifts to a missing state");
+                ret.shift_syms.push_back(shift.first);
+                ret.shift_states.push_back(static_cast< uint32_t >(shift.second));
+            }
+            for (const auto &red : it->second.second) {
+                ret.red_types.push_back(std::get<0>(red));
+                ret.red_labels.push_back(std::get<1>(red));
+                ret.red_sym_nums.push_back(static_cast< uint32_t >(std::get<2>(red)));
+                ret.red_var_nums.push_back(static_cast< uint32_t >(std::get<3>(red)));
+            }
+        }
+        ret.shift_begin.push_back(static_cast< uint32_t >(ret.shift_syms.size()));
+        ret.red_begin.push_back(static_cast< uint32_t >(ret.red_types.size()));
+        return ret;
+    }
+
+    CachedData to_cached_data() const {
+        CachedData ret;
+        for (size_t state = 0; state < this->get_states_num(); state++) {
+            auto &row = ret[state];
+            for (size_t i = this->shift_begin[state]; i < this->shift_begin[state+1]; i++) {
+                row.first.insert(std::make_pair(this->shift_syms[i], this->shift_states[i]));
+            }
+            for (size_t i = this->red_begin[state]; i < this->red_begin[state+1]; i++) {
+                row.second.push_back(std::make_tuple(this->red_types[i], this->red_labels[i], this->red_sym_nums[i], this->red_var_nums[i]));
+            }
+        }
+        return ret;
+    }
+
+    /* Stably reorder the reductions of each state by decreasing weight of their label.
+     * The parser tries reductions in this order, so putting the most likely ones first
+     * makes it backtrack less; since the search is exhaustive, the result does not change
+     * for an unambiguous grammar (for an ambiguous one a different tree can be found). */
+    void sort_reductions(const std::function< size_t(LabType) > &weight) {
+        std::vector< std::pair< size_t, uint32_t > > order;
+        for (size_t state = 0; state < this->get_states_num(); state++) {
+            const uint32_t begin = this->red_begin[state];
+            const uint32_t end = this->red_begin[state+1];
+            order.clear();
+            for (uint32_t i = begin; i < end; i++) {
+                order.push_back(std::make_pair(weight(this->red_labels[i]), i));
+            }
+            std::stable_sort(order.begin(), order.end(), [](const auto &x, const auto &y) { return x.first > y.first; });
+            this->permute_range(this->red_types, begin, order);
+            this->permute_range(this->red_labels, begin, order);
+            this->permute_range(this->red_sym_nums, begin, order);
+            this->permute_range(this->red_var_nums, begin, order);
+        }
+    }
+
+private:
+    template< typename T >
+    static void permute_range(std::vector< T > &vect, uint32_t begin, const std::vector< std::pair< size_t, uint32_t > > &order) {
+        std::vector< T > tmp;
+        tmp.reserve(order.size());
+        for (const auto &x : order) {
+            tmp.push_back(vect[x.second]);
+        }
+        std::copy(tmp.begin(), tmp.end(), vect.begin() + begin);
+    }
+};
+
+template< typename SymType, typename LabType >
+const uint32_t LRAutomaton< SymType, LabType >::NO_STATE;
+
+/* Backtracking LR parser. The search is driven by an explicit stack of choice points,
+ * so its depth is not bounded by the call stack. State stacks are stored as a tree of
+ * frames, each with a hash of the whole stack it represents, so a configuration of the
+ * parser (state stack, number of parsed subtrees and position in the sentence) can be
+ * looked up cheaply; configurations from which the search has already failed are
+ * remembered and never explored again, which avoids redoing exponential work on
+ * ambiguous prefixes. Alternatives are explored in the same order as a plain recursive
+ * search (shift first, then each reduction in the automaton's order), so the first
+ * parsing tree found is the same. */
 template< typename SymType, typename LabType >
 class LRParsingHelper {
 public:
-    LRParsingHelper(const std::unordered_map< size_t, std::pair< std::unordered_map< SymType, size_t >, std::vector< std::tuple< SymType, LabType, size_t, size_t > > > > &automaton,
+    LRParsingHelper(const LRAutomatonView< SymType, LabType > &automaton,
                     typename std::vector<SymType>::const_iterator sent_begin, typename std::vector<SymType>::const_iterator sent_end, SymType target_type) :
-    automaton(automaton), sent_begin(sent_begin), sent_end(sent_end), target_type(target_type), parsing_tree_stack_size(0) {
-        this->state_stack.push_back(0);
-        this->sent_it = this->sent_begin;
+    automaton(automaton), sent_begin(sent_begin), sent_end(sent_end), target_type(target_type) {
+        this->frames.push_back({ NO_FRAME, 0, 1, 0, 0 });
     }
 
     std::tuple< bool, bool > do_parsing() {
-        const auto &row = this->automaton.at(this->state_stack.back());
-        const auto &shifts = row.first;
-        const auto &reductions = row.second;
-
-        // Try to perform a shift
-        if (this->sent_it != sent_end) {
-            auto shift = shifts.find(*this->sent_it);
-            if (shift != shifts.end()) {
-                this->state_stack.push_back(shift->second);
-                this->sent_it++;
-
-                bool res;
-                bool must_halt;
-                std::tie(res, must_halt) = this->do_parsing();
-                if (res || must_halt) {
-                    return std::make_tuple(res, must_halt);
+        const uint32_t sent_len = static_cast< uint32_t >(this->sent_end - this->sent_begin);
+        this->choices.push_back({ 0, 0, 0, 0 });
+        while (!this->choices.empty()) {
+            // Copy everything we need, because pushing new choices and frames invalidates references
+            const ChoicePoint cp = this->choices.back();
+            const Frame frame = this->frames[cp.frame];
+            this->choices.back().next_alt++;
+            this->labels_stack.resize(cp.labels_len);
+
+            // Try to perform a shift
+            if (cp.next_alt == 0) {
+                if (cp.pos != sent_len) {
+                    uint32_t shift = this->automaton.find_shift(frame.state, this->sent_begin[cp.pos]);
+                    if (shift != LRAutomaton< SymType, LabType >::NO_STATE) {
+                        this->push_choice(this->push_frame(cp.frame, shift, frame.trees), cp.pos + 1);
+                    }
                 }
-
-                this->sent_it--;
-                this->state_stack.pop_back();
+                continue;
             }
-        }
 
-        // Try to perform each reduction
-        for (const auto &reduction : reductions) {
-            SymType type;
-            LabType lab;
-            size_t sym_num;
-            size_t var_num;
-            std::tie(type, lab, sym_num, var_num) = reduction;
+            // Try to perform each reduction
+            const uint32_t red = this->automaton.red_begin[frame.state] + cp.next_alt - 1;
+            if (red >= this->automaton.red_begin[frame.state+1]) {
+                // All the alternatives failed
+                this->failed.insert(std::make_pair(this->config_hash(cp.frame, cp.pos), std::make_pair(cp.frame, cp.pos)));
+                this->choices.pop_back();
+                continue;
+            }
+            const SymType &type = this->automaton.red_types[red];
+            const LabType &lab = this->automaton.red_labels[red];
+            const uint32_t sym_num = this->automaton.red_sym_nums[red];
+            const uint32_t var_num = this->automaton.red_var_nums[red];
 
             this->labels_stack.push_back(std::make_tuple(type, lab, var_num));
-            assert(this->parsing_tree_stack_size >= var_num);
-            this->parsing_tree_stack_size += 1 - var_num;
-            /*ParsingTree< SymType, LabType > new_parsing_tree;
-            new_parsing_tree.label = lab;
-            new_parsing_tree.type = type;
-            std::copy(this->parsing_tree_stack.end() - var_num, this->parsing_tree_stack.end(), std::back_inserter(new_parsing_tree.children));
-            this->parsing_tree_stack.resize(this->parsing_tree_stack.size() - var_num);
-            this->parsing_tree_stack.push_back(new_parsing_tree);*/
+            assert(frame.trees >= var_num);
+            const uint32_t trees = frame.trees + 1 - var_num;
 
             // Detect if the search has terminated
-            if (this->sent_it == this->sent_end && this->parsing_tree_stack_size == 1 && this->state_stack.size() == 1 + sym_num && type == this->target_type) {
+            if (cp.pos == sent_len && trees == 1 && frame.depth == 1 + sym_num && type == this->target_type) {
                 return std::make_tuple(true, false);
             }
 
-            std::vector< size_t > temp_states;
-            std::copy(this->state_stack.end() - sym_num, this->state_stack.end(), std::back_inserter(temp_states));
-            this->state_stack.resize(this->state_stack.size() - sym_num);
-            auto new_row_it = this->automaton.find(this->state_stack.back());
-            // If the search had not terminated before and we do not have a new state to go, than the search has failed
-            if (new_row_it == this->automaton.end()) {
-                return std::make_tuple(false, true);
+            assert(frame.depth > sym_num);
+            uint32_t base = cp.frame;
+            for (uint32_t i = 0; i < sym_num; i++) {
+                base = this->frames[base].parent;
             }
-            const auto &new_row = new_row_it->second;
-            // As above
-            auto new_state_it = new_row.first.find(type);
-            if (new_state_it == new_row.first.end()) {
-                return std::make_tuple(false, true);
+            // If the search had not terminated before and we do not have a new state to go, then this reduction has failed,
+            // but the following ones still have to be tried: states are shared among all types, so a reduction can be
+            // available in a state even when the state below does not accept its type
+            uint32_t new_state = this->automaton.find_shift(this->frames[base].state, type);
+            if (new_state == LRAutomaton< SymType, LabType >::NO_STATE) {
+                continue;
             }
-            this->state_stack.push_back(new_state_it->second);
-
-            bool res;
-            bool must_halt;
-            std::tie(res, must_halt) = this->do_parsing();
-            if (res || must_halt) {
-                return std::make_tuple(res, must_halt);
-            }
-
-            this->state_stack.pop_back();
-            std::copy(temp_states.begin(), temp_states.end(), std::back_inserter(this->state_stack));
-
-            this->parsing_tree_stack_size -= 1 - var_num;
-            this->labels_stack.pop_back();
-            /*this->parsing_tree_stack.pop_back();
-            std::copy(new_parsing_tree.children.begin(), new_parsing_tree.children.end(), std::back_inserter(this->parsing_tree_stack));*/
+            this->push_choice(this->push_frame(base, new_state, trees), cp.pos);
         }
 
         return std::make_tuple(false, false);
@@ -236,18 +381,284 @@ public:
     }
 
 private:
-    const std::unordered_map< size_t, std::pair< std::unordered_map< SymType, size_t >, std::vector< std::tuple< SymType, LabType, size_t, size_t > > > > &automaton;
+    static const uint32_t NO_FRAME = std::numeric_limits< uint32_t >::max();
+
+    // A frame is a state stack, represented by its top state and the frame below it
+    struct Frame {
+        uint32_t parent;
+        uint32_t state;
+        uint32_t depth;
+        uint32_t trees;
+        size_t hash;
+    };
+
+    struct ChoicePoint {
+        uint32_t frame;
+        uint32_t pos;
+        uint32_t labels_len;
+        uint32_t next_alt;
+    };
+
+    uint32_t push_frame(uint32_t parent, uint32_t state, uint32_t trees) {
+        assert_or_throw< MMPPException >(this->frames.size() < NO_FRAME, "Too many LR parser configurations");
+        const Frame &parent_frame = this->frames[parent];
+        size_t hash = parent_frame.hash;
+        boost::hash_combine(hash, state);
+        boost::hash_combine(hash, trees);
+        this->frames.push_back({ parent, state, parent_frame.depth + 1, trees, hash });
+        return static_cast< uint32_t >(this->frames.size() - 1);
+    }
+
+    // Check whether two frames represent the same state stack (and number of subtrees)
+    bool same_stack(uint32_t frame1, uint32_t frame2) const {
+        while (frame1 != frame2) {
+            const Frame &f1 = this->frames[frame1];
+            const Frame &f2 = this->frames[frame2];
+            if (f1.hash != f2.hash || f1.state != f2.state || f1.trees != f2.trees || f1.depth != f2.depth) {
+                return false;
+            }
+            frame1 = f1.parent;
+            frame2 = f2.parent;
+        }
+        return true;
+    }
+
+    size_t config_hash(uint32_t frame, uint32_t pos) const {
+        size_t hash = this->frames[frame].hash;
+        boost::hash_combine(hash, pos);
+        return hash;
+    }
+
+    void push_choice(uint32_t frame, uint32_t pos) {
+        if (!this->failed.empty()) {
+            auto range = this->failed.equal_range(this->config_hash(frame, pos));
+            for (auto it = range.first; it != range.second; it++) {
+                if (it->second.second == pos && this->same_stack(it->second.first, frame)) {
+                    return;
+                }
+            }
+        }
+        this->choices.push_back({ frame, pos, static_cast< uint32_t >(this->labels_stack.size()), 0 });
+    }
+
+    const LRAutomatonView< SymType, LabType > automaton;
     typename std::vector<SymType>::const_iterator sent_begin;
     typename std::vector<SymType>::const_iterator sent_end;
     const SymType target_type;
 
-    typename std::vector<SymType>::const_iterator sent_it;
-    std::vector< size_t > state_stack;
-    //std::vector< ParsingTree< SymType, LabType > > parsing_tree_stack;
-    size_t parsing_tree_stack_size;
+    std::vector< Frame > frames;
+    std::unordered_multimap< size_t, std::pair< uint32_t, uint32_t > > failed;
+    std::vector< ChoicePoint > choices;
     std::vector< std::tuple< SymType, LabType, size_t > > labels_stack;
 };
 
+template< typename SymType, typename LabType >
+const uint32_t LRParsingHelper< SymType, LabType >::NO_FRAME;
+
+/* Build the LR automaton for a grammar. Items (i.e., a rule with a position in its body)
+ * are interned as integers, so that a state is just a sorted vector of item IDs, which is
+ * hashed to detect already known states. States are discovered in breadth first order:
+ * all the states of each frontier are expanded in parallel, then their successors are
+ * numbered serially in the order of the parent state and of the symbol, so that the
+ * numbering does not depend on the threads. */
+template< typename SymType, typename LabType >
+class LRAutomatonBuilder {
+public:
+    LRAutomatonBuilder(const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector<SymType> > > > &derivations, size_t threads_num = 0) :
+        derivations(derivations), threads_num(threads_num) {
+        if (this->threads_num == 0) {
+            this->threads_num = default_threads_num();
+        }
+    }
+
+    LRAutomaton< SymType, LabType > build() {
+        this->intern_grammar();
+
+        LRAutomaton< SymType, LabType > ret;
+        std::unordered_map< std::vector< uint32_t >, uint32_t, boost::hash< std::vector< uint32_t > > > states_idx;
+        std::vector< std::vector< uint32_t > > frontier;
+
+        // The initial state contains all the rules at their beginning
+        std::vector< uint32_t > initial;
+        for (uint32_t rule = 0; rule < this->rules.size(); rule++) {
+            initial.push_back(this->rule_begin[rule]);
+        }
+        states_idx.insert(std::make_pair(initial, 0));
+        frontier.push_back(initial);
+        size_t states_num = 1;
+
+        std::vector< Expansion > expansions;
+        while (!frontier.empty()) {
+            expansions.clear();
+            expansions.resize(frontier.size());
+            parallel_for(frontier.size(), this->threads_num, [&](size_t i) {
+                this->expand(frontier[i], expansions[i]);
+            });
+
+            std::vector< std::vector< uint32_t > > new_frontier;
+            for (size_t i = 0; i < frontier.size(); i++) {
+                auto &exp = expansions[i];
+                ret.shift_begin.push_back(static_cast< uint32_t >(ret.shift_syms.size()));
+                for (auto &succ : exp.successors) {
+                    auto res = states_idx.insert(std::make_pair(succ.second, static_cast< uint32_t >(states_num)));
+                    if (res.second) {
+                        assert_or_throw< MMPPException >(states_num < LRAutomaton< SymType, LabType >::NO_STATE, "LR automaton is too big");
+                        states_num++;
+                        new_frontier.push_back(std::move(succ.second));
+                    }
+                    ret.shift_syms.push_back(this->syms[succ.first]);
+                    ret.shift_states.push_back(res.first->second);
+                }
+                ret.red_begin.push_back(static_cast< uint32_t >(ret.red_types.size()));
+                for (const auto rule : exp.reductions) {
+                    const auto &r = this->rules[rule];
+                    ret.red_types.push_back(this->syms[r.head]);
+                    ret.red_labels.push_back(r.label);
+                    ret.red_sym_nums.push_back(r.len);
+                    ret.red_var_nums.push_back(r.vars_num);
+                }
+            }
+            frontier = std::move(new_frontier);
+        }
+        ret.shift_begin.push_back(static_cast< uint32_t >(ret.shift_syms.size()));
+        ret.red_begin.push_back(static_cast< uint32_t >(ret.red_types.size()));
+        return ret;
+    }
+
+private:
+    static const uint32_t NO_SYM = std::numeric_limits< uint32_t >::max();
+
+    struct Rule {
+        uint32_t head;
+        LabType label;
+        uint32_t len;
+        uint32_t vars_num;
+    };
+
+    struct Expansion {
+        // Successors are sorted by symbol
+        std::vector< std::pair< uint32_t, std::vector< uint32_t > > > successors;
+        std::vector< uint32_t > reductions;
+    };
+
+    void intern_grammar() {
+        // Symbols are numbered in their natural order, so that sorting by ID sorts by symbol
+        std::set< SymType > syms_set;
+        std::vector< std::tuple< SymType, LabType, const std::vector< SymType >* > > rules_data;
+        for (const auto &der : this->derivations) {
+            syms_set.insert(der.first);
+            for (const auto &rule : der.second) {
+                rules_data.push_back(std::make_tuple(der.first, rule.first, &rule.second));
+                syms_set.insert(rule.second.begin(), rule.second.end());
+            }
+        }
+        this->syms.assign(syms_set.begin(), syms_set.end());
+        std::unordered_map< SymType, uint32_t > syms_idx;
+        for (uint32_t i = 0; i < this->syms.size(); i++) {
+            syms_idx[this->syms[i]] = i;
+        }
+
+        /* Rules are sorted like the items of the original set based construction, so
+         * that reductions are tried in the same order as before. */
+        std::sort(rules_data.begin(), rules_data.end(), [](const auto &x, const auto &y) {
+            return std::tie(std::get<0>(x), std::get<1>(x), *std::get<2>(x)) < std::tie(std::get<0>(y), std::get<1>(y), *std::get<2>(y));
+        });
+        this->rules_by_sym.resize(this->syms.size());
+        for (const auto &rule_data : rules_data) {
+            const auto &body = *std::get<2>(rule_data);
+            Rule rule;
+            rule.head = syms_idx.at(std::get<0>(rule_data));
+            rule.label = std::get<1>(rule_data);
+            rule.len = static_cast< uint32_t >(body.size());
+            rule.vars_num = 0;
+            this->rules_by_sym[rule.head].push_back(static_cast< uint32_t >(this->rules.size()));
+            this->rule_begin.push_back(static_cast< uint32_t >(this->item_next_sym.size()));
+            for (const auto &sym : body) {
+                if (this->derivations.find(sym) != this->derivations.end()) {
+                    rule.vars_num++;
+                }
+                this->item_next_sym.push_back(syms_idx.at(sym));
+                this->item_rule.push_back(static_cast< uint32_t >(this->rules.size()));
+            }
+            // The item with the dot at the end
+            this->item_next_sym.push_back(NO_SYM);
+            this->item_rule.push_back(static_cast< uint32_t >(this->rules.size()));
+            this->rules.push_back(rule);
+        }
+
+        // For each symbol, the initial items that are added when it follows the dot
+        this->closures.resize(this->syms.size());
+        for (uint32_t sym = 0; sym < this->syms.size(); sym++) {
+            std::vector< bool > seen(this->syms.size());
+            std::vector< uint32_t > queue = { sym };
+            seen[sym] = true;
+            auto &closure = this->closures[sym];
+            while (!queue.empty()) {
+                uint32_t cur = queue.back();
+                queue.pop_back();
+                for (const auto rule : this->rules_by_sym[cur]) {
+                    uint32_t item = this->rule_begin[rule];
+                    closure.push_back(item);
+                    uint32_t first = this->item_next_sym[item];
+                    if (first != NO_SYM && !seen[first]) {
+                        seen[first] = true;
+                        queue.push_back(first);
+                    }
+                }
+            }
+            std::sort(closure.begin(), closure.end());
+        }
+    }
+
+    void expand(const std::vector< uint32_t > &state, Expansion &exp) const {
+        // Group items according to the symbol after the dot and advance them
+        std::vector< std::pair< uint32_t, uint32_t > > moves;
+        for (const auto item : state) {
+            uint32_t sym = this->item_next_sym[item];
+            if (sym == NO_SYM) {
+                exp.reductions.push_back(this->item_rule[item]);
+            } else {
+                moves.push_back(std::make_pair(sym, item + 1));
+            }
+        }
+        std::sort(moves.begin(), moves.end());
+        for (auto it = moves.begin(); it != moves.end(); ) {
+            auto end = std::find_if(it, moves.end(), [&](const auto &x) { return x.first != it->first; });
+            std::vector< uint32_t > new_state;
+            std::vector< uint32_t > closure_syms;
+            for (auto it2 = it; it2 != end; it2++) {
+                new_state.push_back(it2->second);
+                uint32_t next_sym = this->item_next_sym[it2->second];
+                if (next_sym != NO_SYM) {
+                    closure_syms.push_back(next_sym);
+                }
+            }
+            std::sort(closure_syms.begin(), closure_syms.end());
+            closure_syms.erase(std::unique(closure_syms.begin(), closure_syms.end()), closure_syms.end());
+            for (const auto sym : closure_syms) {
+                new_state.insert(new_state.end(), this->closures[sym].begin(), this->closures[sym].end());
+            }
+            std::sort(new_state.begin(), new_state.end());
+            new_state.erase(std::unique(new_state.begin(), new_state.end()), new_state.end());
+            exp.successors.push_back(std::make_pair(it->first, std::move(new_state)));
+            it = end;
+        }
+    }
+
+    const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector<SymType> > > > &derivations;
+    size_t threads_num;
+    std::vector< SymType > syms;
+    std::vector< Rule > rules;
+    std::vector< std::vector< uint32_t > > rules_by_sym;
+    std::vector< uint32_t > rule_begin;
+    std::vector< uint32_t > item_next_sym;
+    std::vector< uint32_t > item_rule;
+    std::vector< std::vector< uint32_t > > closures;
+};
+
+template< typename SymType, typename LabType >
+const uint32_t LRAutomatonBuilder< SymType, LabType >::NO_SYM;
+
 template< typename SymType, typename LabType >
 class LRParser : public Parser< SymType, LabType > {
 public:
@@ -261,19 +672,51 @@ public:
 #endif
     }
 
-    typedef std::unordered_map< size_t, std::pair< std::unordered_map< SymType, size_t >, std::vector< std::tuple< SymType, LabType, size_t, size_t > > > > CachedData;
+    typedef typename LRAutomaton< SymType, LabType >::CachedData CachedData;
 
-    const CachedData &get_cached_data() const {
-        return this->automaton;
+    CachedData get_cached_data() const {
+        if (this->external) {
+            return LRAutomaton< SymType, LabType >::from_view(this->view).to_cached_data();
+        }
+        return this->automaton.to_cached_data();
     }
 
     void set_cached_data(const CachedData &cached_data) {
-        this->automaton = cached_data;
+        this->automaton = LRAutomaton< SymType, LabType >::from_cached_data(cached_data);
+        this->external = false;
+        this->view = this->automaton.get_view();
+    }
+
+    // Parse directly on tables stored elsewhere (for example in a memory mapped file), which must outlive the parser
+    void set_automaton_view(const LRAutomatonView< SymType, LabType > &view) {
+        this->automaton = LRAutomaton< SymType, LabType >();
+        this->external = true;
+        this->view = view;
+    }
+
+    const LRAutomatonView< SymType, LabType > &get_automaton_view() const {
+        return this->view;
+    }
+
+    // Try first the reductions whose labels are more frequent; label_freqs is typically computed on the trees of a library
+    void sort_reductions(const std::unordered_map< LabType, size_t > &label_freqs) {
+        if (this->external) {
+            this->automaton = LRAutomaton< SymType, LabType >::from_view(this->view);
+            this->external = false;
+        }
+        this->automaton.sort_reductions([&label_freqs](LabType lab) {
+            auto it = label_freqs.find(lab);
+            return it == label_freqs.end() ? 0 : it->second;
+        });
+        this->view = this->automaton.get_view();
     }
 
     using Parser< SymType, LabType >::parse;
     ParsingTree< SymType, LabType > parse(typename std::vector<SymType>::const_iterator sent_begin, typename std::vector<SymType>::const_iterator sent_end, SymType type) const {
-        LRParsingHelper< SymType, LabType > helper(this->automaton, sent_begin, sent_end, type);
+        if (this->view.get_states_num() == 0) {
+            return {};
+        }
+        LRParsingHelper< SymType, LabType > helper(this->view, sent_begin, sent_end, type);
         bool res;
         std::tie(res, std::ignore) = helper.do_parsing();
         if (res) {
@@ -290,100 +733,18 @@ public:
         }
     }
 
-    void initialize() {
-        size_t num_states = 0;
-        std::map< LRState< SymType, LabType >, std::shared_ptr< std::pair< size_t, std::map< SymType, size_t > > > > states;
-        std::set< LRState< SymType, LabType > > processed_states;
-        std::queue< LRState< SymType, LabType > > new_states;
-
-        auto get_state_data = [&](const LRState< SymType, LabType > &state)->std::shared_ptr< std::pair< size_t, std::map< SymType, size_t > > > {
-            bool res;
-            typename std::map< LRState< SymType, LabType >, std::shared_ptr< std::pair< size_t, std::map< SymType, size_t > > > >::iterator it;
-            std::tie(it, res) = states.insert(std::make_pair(state, std::make_shared< std::pair< size_t, std::map< SymType, size_t > > >(num_states, std::map< SymType, size_t >())));
-            if (res) {
-                num_states++;
-            }
-            return it->second;
-        };
-
-        // Construct initial state and push it to the std::queue of new states
-        LRState< SymType, LabType > initial;
-        for (auto i : this->derivations) {
-            auto sym = i.first;
-            for (auto j : i.second) {
-                auto lab = j.first;
-                auto sent = j.second;
-                initial.insert(make_tuple(sym, lab, 0, sent));
-            }
-        }
-        new_states.push(initial);
-
-        // Iteratively consider each new state and all its possible evolutions
-        while (!new_states.empty()) {
-            LRState< SymType, LabType > state = new_states.front();
-            new_states.pop();
-            bool res;
-            std::tie(std::ignore, res) = processed_states.insert(state);
-            // Proceed only if new state is actually new
-            if (res) {
-                auto state_data = get_state_data(state);
-                const size_t state_idx = state_data->first;
-                //std::cout << state_idx << std::endl;
-                //print_state(state, sym_printer, lab_printer);
-
-                // Build the shift map and enqueue new states
-                std::unordered_map< SymType, size_t > shifts;
-                std::set< SymType > next_syms = next_possible_symbols(state);
-                for (const auto &sym : next_syms) {
-                    auto new_state = evolve_state(state, sym, derivations);
-                    const size_t new_state_idx = get_state_data(new_state)->first;
-                    shifts.insert(std::make_pair(sym, new_state_idx));
-                    new_states.push(new_state);
-                }
-
-                // Build the vector of reductions
-                std::vector< std::tuple< SymType, LabType, size_t, size_t > > reductions;
-                for (auto rule : state) {
-                    const SymType &head_sym = std::get<0>(rule);
-                    const LabType &lab = std::get<1>(rule);
-                    const size_t &pos = std::get<2>(rule);
-                    const std::vector< SymType > &sent = std::get<3>(rule);
-                    size_t sym_num = sent.size();
-                    size_t var_num = 0;
-                    for (const auto &sym : sent) {
-                        if (this->derivations.find(sym) != this->derivations.end()) {
-                            var_num++;
-                        }
-                    }
-                    if (pos == sent.size()) {
-                        reductions.push_back(std::make_tuple(head_sym, lab, sym_num, var_num));
-                    }
-                }
-
-                // Insert information in the automaton
-                this->automaton[state_idx] = make_pair(shifts, reductions);
-            }
-        }
-
-        // Look again at all states to list conflicts
-        /*for (const auto &it : states) {
-            const auto &state = it.first;
-            size_t shift_num;
-            size_t reduce_num;
-            std::tie(shift_num, reduce_num) = count_rules(state, this->derivations);
-            if (reduce_num > 1 || (reduce_num > 0 && shift_num > 0)) {
-                std::cout << "State " << it.second->first << " is conflicting!" << std::endl;
-                print_state(state, this->sym_printer, this->lab_printer);
-                std::cout << std::endl;
-            }
-        }*/
+    void initialize(size_t threads_num = 0) {
+        LRAutomatonBuilder< SymType, LabType > builder(this->derivations, threads_num);
+        this->automaton = builder.build();
+        this->external = false;
+        this->view = this->automaton.get_view();
     }
 
 private:
     const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector<SymType> > > > &derivations;
-    /* Every state is mapped to a pair containing the shift map and the vector of reductions;
-     * each reduction is described by its head symbol, its label, its number of symbols and its number of variables. */
-    CachedData automaton;
+    LRAutomaton< SymType, LabType > automaton;
+    bool external = false;
+    LRAutomatonView< SymType, LabType > view;
     const std::function< std::ostream&(std::ostream&, SymType) > sym_printer;
     const std::function< std::ostream&(std::ostream&, LabType) > lab_printer;
 
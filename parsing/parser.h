@@ -3,6 +3,8 @@
 #include <vector>
 #include <unordered_map>
 #include <cassert>
+#include <cstdint>
+#include <functional>
 
 #include <boost/functional/hash.hpp>
 
@@ -58,7 +60,8 @@ struct ParsingTreeNode {
     LabType label;
     SymType type;
     //size_t children_num;
-    size_t descendants_num;
+    // 32 bits are plenty for any sentence, and keep the node at 12 bytes with 32 bit tokens
+    uint32_t descendants_num;
 
     bool operator==(const ParsingTreeNode< SymType, LabType > &other) const {
         return this->label == other.label && this->descendants_num == other.descendants_num;
@@ -325,6 +328,63 @@ private:
     std::vector< size_t > stack;
 };
 
+/* A compact encoding of a ParsingTree2 meant for storage: each node only keeps its label and
+ * its descendants count, using 8 bytes instead of 12 with 32 bit tokens. The type is not
+ * stored, since it is a function of the label; it is recovered when the tree is expanded
+ * back to a ParsingTree2 (for example by LibraryToolbox::get_label_type(), which uses the
+ * derivation table), so that all the algorithms working on ParsingTree2 can be used as they
+ * are. */
+template< typename LabType >
+struct CompactParsingTreeNode {
+    LabType label;
+    uint32_t descendants_num;
+
+    bool operator==(const CompactParsingTreeNode< LabType > &other) const {
+        return this->label == other.label && this->descendants_num == other.descendants_num;
+    }
+
+    bool operator!=(const CompactParsingTreeNode< LabType > &other) const {
+        return !this->operator==(other);
+    }
+};
+
+template< typename SymType, typename LabType >
+struct CompactParsingTree {
+    std::vector< CompactParsingTreeNode< LabType > > nodes;
+
+    CompactParsingTree() {
+    }
+
+    explicit CompactParsingTree(const ParsingTree2< SymType, LabType > &pt) {
+        this->nodes.reserve(pt.get_nodes_len());
+        for (size_t i = 0; i < pt.get_nodes_len(); i++) {
+            const auto &node = pt.get_nodes()[i];
+            this->nodes.push_back({ node.label, node.descendants_num });
+        }
+    }
+
+    ParsingTree2< SymType, LabType > expand(const std::function< SymType(LabType) > &label_type) const {
+        std::vector< ParsingTreeNode< SymType, LabType > > nodes_storage;
+        nodes_storage.reserve(this->nodes.size());
+        for (const auto &node : this->nodes) {
+            nodes_storage.push_back({ node.label, label_type(node.label), node.descendants_num });
+        }
+        return ParsingTree2< SymType, LabType >(std::move(nodes_storage), NULL, 0);
+    }
+
+    size_t get_nodes_len() const {
+        return this->nodes.size();
+    }
+
+    bool operator==(const CompactParsingTree< SymType, LabType > &other) const {
+        return this->nodes == other.nodes;
+    }
+
+    bool operator!=(const CompactParsingTree< SymType, LabType > &other) const {
+        return !this->operator==(other);
+    }
+};
+
 /*template< typename SymType, typename LabType >
 ParsingTree2< SymType, LabType > var_parsing_tree(LabType label, SymType type) {
     ParsingTree2Generator< SymType, LabType > gen;
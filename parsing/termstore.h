@@ -0,0 +1,234 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <cstdint>
+#include <limits>
+#include <cassert>
+
+#include <boost/functional/hash.hpp>
+
+#include "parser.h"
+#include "unif.h"
+
+/* A hash-consed store of parsing trees: each distinct subtree is stored only once and
+ * identified by a TermId, so that two terms of the same store are equal if and only if
+ * their IDs are, and trees sharing many subterms take little space. Each term keeps its
+ * hash and its size (in nodes), and its arguments are themselves terms. Trees can be moved
+ * in and out of the store with intern() and extract(); the functions below adapt
+ * substitution and unilateral unification from unif.h so that they can run directly on
+ * term IDs. The store only grows, and it is not thread safe. */
+template< typename SymType, typename LabType >
+class TermStore {
+public:
+    typedef uint32_t TermId;
+
+    TermId make_term(LabType label, SymType type, const std::vector< TermId > &args) {
+        size_t hash = 0;
+        boost::hash_combine(hash, label);
+        boost::hash_combine(hash, type);
+        uint32_t size = 1;
+        for (const auto arg : args) {
+            boost::hash_combine(hash, this->terms[arg].hash);
+            size += this->terms[arg].size;
+        }
+        auto range = this->index.equal_range(hash);
+        for (auto it = range.first; it != range.second; it++) {
+            const auto &term = this->terms[it->second];
+            if (term.label == label && term.type == type && term.args_num == args.size() &&
+                    std::equal(args.begin(), args.end(), this->args.begin() + term.args_begin)) {
+                return it->second;
+            }
+        }
+        // Term IDs and argument offsets are stored on 32 bits
+        assert(this->terms.size() < std::numeric_limits< TermId >::max());
+        assert(this->args.size() + args.size() <= std::numeric_limits< uint32_t >::max());
+        TermId id = static_cast< TermId >(this->terms.size());
+        this->terms.push_back({ label, type, static_cast< uint32_t >(this->args.size()), static_cast< uint32_t >(args.size()), size, hash });
+        this->args.insert(this->args.end(), args.begin(), args.end());
+        this->index.insert(std::make_pair(hash, id));
+        return id;
+    }
+
+    TermId intern(const ParsingTree2< SymType, LabType > &pt) {
+        assert(pt.get_nodes_len() != 0);
+        return this->intern(pt.get_root());
+    }
+
+    TermId intern(const ParsingTreeIterator< SymType, LabType > &it) {
+        std::vector< TermId > args;
+        for (const auto &child : it) {
+            args.push_back(this->intern(child));
+        }
+        const auto &node = it.get_node();
+        return this->make_term(node.label, node.type, args);
+    }
+
+    ParsingTree2< SymType, LabType > extract(TermId id) const {
+        ParsingTree2Generator< SymType, LabType > gen;
+        gen.reserve(this->get_size(id));
+        this->extract_internal(id, gen);
+        return gen.get_parsing_tree();
+    }
+
+    LabType get_label(TermId id) const {
+        return this->terms[id].label;
+    }
+
+    SymType get_type(TermId id) const {
+        return this->terms[id].type;
+    }
+
+    size_t get_args_num(TermId id) const {
+        return this->terms[id].args_num;
+    }
+
+    TermId get_arg(TermId id, size_t i) const {
+        assert(i < this->terms[id].args_num);
+        return this->args[this->terms[id].args_begin + i];
+    }
+
+    size_t get_hash(TermId id) const {
+        return this->terms[id].hash;
+    }
+
+    // Number of nodes of the tree the term stands for
+    size_t get_size(TermId id) const {
+        return this->terms[id].size;
+    }
+
+    size_t get_terms_num() const {
+        return this->terms.size();
+    }
+
+private:
+    void extract_internal(TermId id, ParsingTree2Generator< SymType, LabType > &gen) const {
+        const auto &term = this->terms[id];
+        gen.open_node(term.label, term.type);
+        for (size_t i = 0; i < term.args_num; i++) {
+            this->extract_internal(this->args[term.args_begin + i], gen);
+        }
+        gen.close_node();
+    }
+
+    struct Term {
+        LabType label;
+        SymType type;
+        uint32_t args_begin;
+        uint32_t args_num;
+        uint32_t size;
+        size_t hash;
+    };
+
+    std::vector< Term > terms;
+    std::vector< TermId > args;
+    std::unordered_multimap< size_t, TermId > index;
+};
+
+template< typename LabType >
+using TermSubstMap = std::map< LabType, uint32_t >;
+
+template< typename SymType, typename LabType >
+TermSubstMap< LabType > subst2_to_term_subst(TermStore< SymType, LabType > &store, const SubstMap2< SymType, LabType > &subst) {
+    TermSubstMap< LabType > ret;
+    for (const auto &x : subst) {
+        ret.insert(ret.end(), std::make_pair(x.first, store.intern(x.second)));
+    }
+    return ret;
+}
+
+template< typename SymType, typename LabType >
+SubstMap2< SymType, LabType > term_subst_to_subst2(const TermStore< SymType, LabType > &store, const TermSubstMap< LabType > &subst) {
+    SubstMap2< SymType, LabType > ret;
+    for (const auto &x : subst) {
+        ret.insert(ret.end(), std::make_pair(x.first, store.extract(x.second)));
+    }
+    return ret;
+}
+
+/* Same as substitute2(), but on terms. Results are memoized in memo, which can be kept
+ * across calls as long as the substitution map does not change: since subterms are shared,
+ * each distinct subterm is only substituted once. */
+template< typename SymType, typename LabType, typename IsVar >
+uint32_t substitute_term(TermStore< SymType, LabType > &store, uint32_t id, const IsVar &is_var,
+                         const TermSubstMap< LabType > &subst, std::unordered_map< uint32_t, uint32_t > &memo) {
+    auto memo_it = memo.find(id);
+    if (memo_it != memo.end()) {
+        return memo_it->second;
+    }
+    uint32_t ret = id;
+    LabType label = store.get_label(id);
+    if (is_var(label)) {
+        assert(store.get_args_num(id) == 0);
+        auto it = subst.find(label);
+        if (it != subst.end()) {
+            ret = it->second;
+        }
+    } else {
+        std::vector< uint32_t > args;
+        bool changed = false;
+        for (size_t i = 0; i < store.get_args_num(id); i++) {
+            args.push_back(substitute_term(store, store.get_arg(id, i), is_var, subst, memo));
+            changed = changed || args.back() != store.get_arg(id, i);
+        }
+        if (changed) {
+            ret = store.make_term(label, store.get_type(id), args);
+        }
+    }
+    memo.insert(std::make_pair(id, ret));
+    return ret;
+}
+
+template< typename SymType, typename LabType, typename IsVar >
+uint32_t substitute_term(TermStore< SymType, LabType > &store, uint32_t id, const IsVar &is_var, const TermSubstMap< LabType > &subst) {
+    std::unordered_map< uint32_t, uint32_t > memo;
+    return substitute_term(store, id, is_var, subst, memo);
+}
+
+/* Same as UnilateralUnificator, but on terms: checking that the occurrences of a repeated
+ * variable are matched with the same subtree only takes a comparison of IDs. The
+ * substitution is extended only if unification succeeds: otherwise the variables bound
+ * by this call are removed again. */
+template< typename SymType, typename LabType, typename IsVar >
+bool unify_term(const TermStore< SymType, LabType > &store, uint32_t templ, uint32_t target, const IsVar &is_var, TermSubstMap< LabType > &subst) {
+    std::vector< typename TermSubstMap< LabType >::iterator > bound;
+    auto fail = [&]() {
+        for (const auto &it : bound) {
+            subst.erase(it);
+        }
+        return false;
+    };
+    std::vector< std::pair< uint32_t, uint32_t > > stack;
+    stack.push_back(std::make_pair(templ, target));
+    while (!stack.empty()) {
+        uint32_t t1, t2;
+        std::tie(t1, t2) = stack.back();
+        stack.pop_back();
+        LabType label = store.get_label(t1);
+        if (is_var(label)) {
+            assert(store.get_args_num(t1) == 0);
+            if (store.get_type(t1) != store.get_type(t2)) {
+                return fail();
+            }
+            bool inserted;
+            typename TermSubstMap< LabType >::iterator it;
+            std::tie(it, inserted) = subst.insert(std::make_pair(label, t2));
+            if (inserted) {
+                bound.push_back(it);
+            } else if (it->second != t2) {
+                return fail();
+            }
+        } else {
+            if (label != store.get_label(t2)) {
+                return fail();
+            }
+            assert(store.get_args_num(t1) == store.get_args_num(t2));
+            for (size_t i = store.get_args_num(t1); i > 0; i--) {
+                stack.push_back(std::make_pair(store.get_arg(t1, i-1), store.get_arg(t2, i-1)));
+            }
+        }
+    }
+    return true;
+}
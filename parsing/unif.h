@@ -3,6 +3,9 @@
 #include <functional>
 #include <unordered_map>
 #include <map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 
 #include "parsing/parser.h"
 #include "parsing/algos.h"
@@ -53,9 +56,116 @@ SubstMap< SymType, LabType > subst2_to_subst(const SubstMap2< SymType, LabType >
     return subst;
 }
 
+/* Variables can be given dense slots (for example, the variables of an assertion), so that a
+ * substitution over them can be stored as a flat array indexed by slot instead of a tree map.
+ * Slots follow the order of the labels, so visiting the slots in order gives the variables in
+ * the same order as iterating over a SubstMap2. */
+template< typename LabType >
+class VarSlots {
+public:
+    VarSlots() {
+    }
+
+    explicit VarSlots(const std::vector< LabType > &vars) : vars(vars) {
+        std::sort(this->vars.begin(), this->vars.end());
+        this->vars.erase(std::unique(this->vars.begin(), this->vars.end()), this->vars.end());
+    }
+
+    size_t get_slots_num() const {
+        return this->vars.size();
+    }
+
+    LabType get_var(size_t slot) const {
+        return this->vars[slot];
+    }
+
+    // Return get_slots_num() if the variable has no slot
+    size_t get_slot(LabType var) const {
+        auto it = std::lower_bound(this->vars.begin(), this->vars.end(), var);
+        if (it == this->vars.end() || *it != var) {
+            return this->vars.size();
+        }
+        return static_cast< size_t >(it - this->vars.begin());
+    }
+
+private:
+    std::vector< LabType > vars;
+};
+
+/* A substitution map whose keys are the slots of a VarSlots object (which must outlive it); the
+ * subtrees the variables are bound to are stored as spans of a single node buffer, so building
+ * and copying it takes a couple of allocations, instead of one per variable as with SubstMap2. */
 template< typename SymType, typename LabType >
+class FlatSubstMap2 {
+public:
+    explicit FlatSubstMap2(const VarSlots< LabType > &slots) : slots(&slots), spans(slots.get_slots_num(), std::make_pair(0, 0)) {
+    }
+
+    const VarSlots< LabType > &get_slots() const {
+        return *this->slots;
+    }
+
+    bool is_bound(size_t slot) const {
+        return this->spans[slot].second != 0;
+    }
+
+    // The returned tree is a view on the internal buffer, valid until the map is modified
+    ParsingTree2< SymType, LabType > get(size_t slot) const {
+        const auto &span = this->spans[slot];
+        return ParsingTree2< SymType, LabType >(this->nodes.data() + span.first, span.second);
+    }
+
+    void bind(size_t slot, const ParsingTree2< SymType, LabType > &pt) {
+        assert(!this->is_bound(slot));
+        assert(pt.get_nodes_len() != 0);
+        this->spans[slot] = std::make_pair(static_cast< uint32_t >(this->nodes.size()), static_cast< uint32_t >(pt.get_nodes_len()));
+        this->nodes.insert(this->nodes.end(), pt.get_nodes(), pt.get_nodes() + pt.get_nodes_len());
+        this->bound_slots.push_back(slot);
+    }
+
+    // Bindings are only appended, so the most recent ones can be removed going back to a previous count
+    size_t get_bound_num() const {
+        return this->bound_slots.size();
+    }
+
+    void unbind_to(size_t bound_num) {
+        assert(bound_num <= this->bound_slots.size());
+        while (this->bound_slots.size() > bound_num) {
+            auto &span = this->spans[this->bound_slots.back()];
+            this->nodes.resize(span.first);
+            span = std::make_pair(0, 0);
+            this->bound_slots.pop_back();
+        }
+    }
+
+    void clear() {
+        this->nodes.clear();
+        std::fill(this->spans.begin(), this->spans.end(), std::make_pair(0, 0));
+        this->bound_slots.clear();
+    }
+
+    SubstMap2< SymType, LabType > to_subst_map() const {
+        SubstMap2< SymType, LabType > ret;
+        for (size_t slot = 0; slot < this->spans.size(); slot++) {
+            if (this->is_bound(slot)) {
+                auto pt = this->get(slot);
+                pt.refresh();
+                ret.insert(ret.end(), std::make_pair(this->slots->get_var(slot), pt));
+            }
+        }
+        return ret;
+    }
+
+private:
+    const VarSlots< LabType > *slots;
+    std::vector< ParsingTreeNode< SymType, LabType > > nodes;
+    std::vector< std::pair< uint32_t, uint32_t > > spans;
+    std::vector< size_t > bound_slots;
+};
+
+template< typename SymType, typename LabType, typename IsVar >
 ParsingTree< SymType, LabType > substitute(const ParsingTree< SymType, LabType > &pt,
-                                           const std::function< bool(LabType) > &is_var,
+                                           const IsVar &is_var,
                                            const SubstMap< SymType, LabType > &subst) {
     if (is_var(pt.label)) {
         assert(pt.children.empty());
@@ -77,73 +187,115 @@ ParsingTree< SymType, LabType > substitute(const ParsingTree< SymType, LabType >
 }
 
 
-template< typename SymType, typename LabType >
-size_t substitute2_count(const ParsingTree2< SymType, LabType > &pt,
-                         const std::function< bool(LabType) > &is_var,
-                         const SubstMap2< SymType, LabType > &subst) {
+// The lookup function returns the tree a variable is replaced with, or an empty tree if it is left alone
+template< typename SymType, typename LabType, typename Lookup, typename IsVar >
+size_t substitute2_count_internal(const ParsingTree2< SymType, LabType > &pt,
+                                  const IsVar &is_var,
+                                  const Lookup &lookup) {
     auto nodes_len = pt.get_nodes_len();
     const auto &nodes = pt.get_nodes();
     size_t ret = nodes_len;
     for (size_t i = 0; i < nodes_len; i++) {
         auto lab = nodes[i].label;
         if (is_var(lab)) {
-            auto it = subst.find(lab);
-            if (it != subst.end()) {
-                ret += it->second.get_nodes_len() - 1;
+            auto repl = lookup(lab);
+            if (repl.get_nodes_len() != 0) {
+                ret += repl.get_nodes_len() - 1;
             }
         }
     }
     return ret;
 }
 
-template< typename SymType, typename LabType >
-ParsingTree2< SymType, LabType > substitute2(const ParsingTree2< SymType, LabType > &pt,
-                                             const std::function< bool(LabType) > &is_var,
-                                             const SubstMap2< SymType, LabType > &subst) {
-    size_t final_size = substitute2_count(pt, is_var, subst);
+template< typename SymType, typename LabType, typename Lookup, typename IsVar >
+ParsingTree2< SymType, LabType > substitute2_internal(const ParsingTree2< SymType, LabType > &pt,
+                                                      const IsVar &is_var,
+                                                      const Lookup &lookup) {
+    size_t final_size = substitute2_count_internal(pt, is_var, lookup);
     ParsingTree2Generator< SymType, LabType > gen;
     gen.reserve(final_size);
-    auto it = pt.get_multi_iterator();
-    bool discard_next_close = false;
-    //for (auto x = it.next(); x.first != it.Finished; x = it.next()) {
-    while (true) {
-        const auto x = it.next();
-        if (x.first == it.Finished) {
-            break;
-        }
-        if (x.first == it.Open) {
-            assert(!discard_next_close);
-            if (is_var(x.second.label)) {
-                auto it = subst.find(x.second.label);
-                if (it != subst.end()) {
-                    discard_next_close = true;
-                    gen.copy_tree(it->second);
-                } else {
-                    gen.open_node(x.second.label, x.second.type);
-                }
-            } else {
-                gen.open_node(x.second.label, x.second.type);
-            }
-        } else {
-            assert(x.first == it.Close);
-            if (discard_next_close) {
-                discard_next_close = false;
-            } else {
-                gen.close_node();
+    /* Nodes are visited in their preorder storage, so that the variable check is done in
+     * a plain loop; ends holds the position where the subtree of each open node finishes */
+    auto nodes_len = pt.get_nodes_len();
+    const auto &nodes = pt.get_nodes();
+    std::vector< size_t > ends;
+    for (size_t i = 0; i < nodes_len; i++) {
+        while (!ends.empty() && ends.back() == i) {
+            gen.close_node();
+            ends.pop_back();
+        }
+        const auto &node = nodes[i];
+        if (is_var(node.label)) {
+            auto repl = lookup(node.label);
+            if (repl.get_nodes_len() != 0) {
+                assert(node.descendants_num == 0);
+                gen.copy_tree(repl);
+                continue;
             }
         }
+        gen.open_node(node.label, node.type);
+        ends.push_back(i + node.descendants_num + 1);
+    }
+    while (!ends.empty()) {
+        gen.close_node();
+        ends.pop_back();
     }
     ParsingTree2< SymType, LabType > ret = gen.get_parsing_tree();
+    assert(final_size == ret.nodes_storage.size());
+    return ret;
+}
+
+template< typename SymType, typename LabType >
+ParsingTree2< SymType, LabType > subst2_lookup(const SubstMap2< SymType, LabType > &subst, LabType var) {
+    auto it = subst.find(var);
+    if (it == subst.end()) {
+        return {};
+    }
+    return ParsingTree2< SymType, LabType >(it->second.get_nodes(), it->second.get_nodes_len());
+}
+
+template< typename SymType, typename LabType >
+ParsingTree2< SymType, LabType > subst2_lookup(const FlatSubstMap2< SymType, LabType > &subst, LabType var) {
+    size_t slot = subst.get_slots().get_slot(var);
+    if (slot == subst.get_slots().get_slots_num() || !subst.is_bound(slot)) {
+        return {};
+    }
+    return subst.get(slot);
+}
+
+template< typename SymType, typename LabType, typename IsVar >
+size_t substitute2_count(const ParsingTree2< SymType, LabType > &pt,
+                         const IsVar &is_var,
+                         const SubstMap2< SymType, LabType > &subst) {
+    return substitute2_count_internal(pt, is_var, [&subst](LabType var) { return subst2_lookup(subst, var); });
+}
+
+template< typename SymType, typename LabType, typename IsVar >
+ParsingTree2< SymType, LabType > substitute2(const ParsingTree2< SymType, LabType > &pt,
+                                             const IsVar &is_var,
+                                             const SubstMap2< SymType, LabType > &subst) {
+    ParsingTree2< SymType, LabType > ret = substitute2_internal(pt, is_var, [&subst](LabType var) { return subst2_lookup(subst, var); });
 #ifdef UNIFICATOR_SELF_TEST
     assert(ret == pt_to_pt2(substitute(pt2_to_pt(pt), is_var, subst2_to_subst(subst))));
 #endif
-    assert(final_size == ret.nodes_storage.size());
     return ret;
 }
 
-template< typename SymType, typename LabType >
+// Variables without a slot are left alone
+template< typename SymType, typename LabType, typename IsVar >
+ParsingTree2< SymType, LabType > substitute2(const ParsingTree2< SymType, LabType > &pt,
+                                             const IsVar &is_var,
+                                             const FlatSubstMap2< SymType, LabType > &subst) {
+    ParsingTree2< SymType, LabType > ret = substitute2_internal(pt, is_var, [&subst](LabType var) { return subst2_lookup(subst, var); });
+#ifdef UNIFICATOR_SELF_TEST
+    assert(ret == substitute2(pt, is_var, subst.to_subst_map()));
+#endif
+    return ret;
+}
+
+template< typename SymType, typename LabType, typename IsVar >
 ParsingTree2< SymType, LabType > substitute2_simple(const ParsingTree2< SymType, LabType > &pt,
-                                             const std::function< bool(LabType) > &is_var,
+                                             const IsVar &is_var,
                                              const SimpleSubstMap2< SymType, LabType > &subst) {
     ParsingTree2< SymType, LabType > ret = pt;
     ret.refresh();
@@ -158,8 +310,8 @@ ParsingTree2< SymType, LabType > substitute2_simple(const ParsingTree2< SymType,
     return ret;
 }
 
-template< typename SymType, typename LabType >
-SubstMap< SymType, LabType > compose(const SubstMap< SymType, LabType > &first, const SubstMap< SymType, LabType > &second, const std::function< bool(LabType) > &is_var) {
+template< typename SymType, typename LabType, typename IsVar >
+SubstMap< SymType, LabType > compose(const SubstMap< SymType, LabType > &first, const SubstMap< SymType, LabType > &second, const IsVar &is_var) {
     // Algorithm described in Chang, Lee (Symbolic logic and mechanical theorem proving), section 5.3 Substitution and unification
     SubstMap< SymType, LabType > ret;
     for (auto &first_pair : first) {
@@ -180,8 +332,8 @@ SubstMap< SymType, LabType > compose(const SubstMap< SymType, LabType > &first,
     return ret;
 }
 
-template< typename SymType, typename LabType >
-SubstMap2< SymType, LabType > compose2(const SubstMap2< SymType, LabType > &first, const SubstMap2< SymType, LabType > &second, const std::function< bool(LabType) > &is_var) {
+template< typename SymType, typename LabType, typename IsVar >
+SubstMap2< SymType, LabType > compose2(const SubstMap2< SymType, LabType > &first, const SubstMap2< SymType, LabType > &second, const IsVar &is_var) {
     // Algorithm described in Chang, Lee (Symbolic logic and mechanical theorem proving), section 5.3 Substitution and unification
     SubstMap2< SymType, LabType > ret;
     for (auto &first_pair : first) {
@@ -234,6 +386,54 @@ SubstMap2< SymType, LabType > update2(const SubstMap2< SymType, LabType > &first
     return ret;
 }
 
+// Both maps must be defined on the same slots
+template< typename SymType, typename LabType, typename IsVar >
+FlatSubstMap2< SymType, LabType > compose2(const FlatSubstMap2< SymType, LabType > &first, const FlatSubstMap2< SymType, LabType > &second, const IsVar &is_var) {
+    assert(&first.get_slots() == &second.get_slots());
+    const auto &slots = first.get_slots();
+    FlatSubstMap2< SymType, LabType > ret(slots);
+    for (size_t slot = 0; slot < slots.get_slots_num(); slot++) {
+        if (first.is_bound(slot)) {
+            auto tmp = substitute2(first.get(slot), is_var, second);
+            // Trivial substitutions are skipped, so that they do not hide the one from the second map
+            if (tmp.get_nodes_len() == 1 && tmp.get_nodes()[0].label == slots.get_var(slot)) {
+                assert(is_var(tmp.get_nodes()[0].label));
+            } else {
+                ret.bind(slot, tmp);
+                continue;
+            }
+        }
+        if (second.is_bound(slot)) {
+            ret.bind(slot, second.get(slot));
+        }
+    }
+#ifdef UNIFICATOR_SELF_TEST
+    assert(ret.to_subst_map() == subst_to_subst2(compose(subst2_to_subst(first.to_subst_map()), subst2_to_subst(second.to_subst_map()), is_var)));
+#endif
+    return ret;
+}
+
+// Both maps must be defined on the same slots
+template< typename SymType, typename LabType >
+FlatSubstMap2< SymType, LabType > update2(const FlatSubstMap2< SymType, LabType > &first, const FlatSubstMap2< SymType, LabType > &second, bool assert_disjoint = false) {
+    assert(&first.get_slots() == &second.get_slots());
+    FlatSubstMap2< SymType, LabType > ret = first;
+    for (size_t slot = 0; slot < second.get_slots().get_slots_num(); slot++) {
+        if (second.is_bound(slot)) {
+            if (assert_disjoint) {
+                assert(!first.is_bound(slot));
+            }
+            if (!ret.is_bound(slot)) {
+                ret.bind(slot, second.get(slot));
+            }
+        }
+    }
+#ifdef UNIFICATOR_SELF_TEST
+    assert(ret.to_subst_map() == update2(first.to_subst_map(), second.to_subst_map()));
+#endif
+    return ret;
+}
+
 template< typename SymType, typename LabType >
 bool contains_var(const ParsingTree< SymType, LabType > &pt, LabType var) {
     if (pt.label == var) {
@@ -265,8 +465,8 @@ bool contains_var2(const ParsingTree2< SymType, LabType > &pt, LabType var) {
     return contains_var2(pt.get_root(), var);
 }
 
-template< typename SymType, typename LabType >
-void collect_variables(const ParsingTree< SymType, LabType > &pt, const std::function< bool(LabType) > &is_var, std::set< LabType > &vars) {
+template< typename SymType, typename LabType, typename IsVar >
+void collect_variables(const ParsingTree< SymType, LabType > &pt, const IsVar &is_var, std::set< LabType > &vars) {
     if (is_var(pt.label)) {
         vars.insert(pt.label);
     } else {
@@ -276,8 +476,8 @@ void collect_variables(const ParsingTree< SymType, LabType > &pt, const std::fun
     }
 }
 
-template< typename SymType, typename LabType >
-void collect_variables2(const ParsingTreeIterator< SymType, LabType > &it, const std::function< bool(LabType) > &is_var, std::set< LabType > &vars) {
+template< typename SymType, typename LabType, typename IsVar >
+void collect_variables2(const ParsingTreeIterator< SymType, LabType > &it, const IsVar &is_var, std::set< LabType > &vars) {
     const auto tree = it.get_view();
     auto nodes_len = tree.get_nodes_len();
     const auto &nodes = tree.get_nodes();
@@ -289,17 +489,17 @@ void collect_variables2(const ParsingTreeIterator< SymType, LabType > &it, const
     }
 }
 
-template< typename SymType, typename LabType >
-void collect_variables2(const ParsingTree2< SymType, LabType > &pt, const std::function< bool(LabType) > &is_var, std::set< LabType > &vars) {
+template< typename SymType, typename LabType, typename IsVar >
+void collect_variables2(const ParsingTree2< SymType, LabType > &pt, const IsVar &is_var, std::set< LabType > &vars) {
     return collect_variables2(pt.get_root(), is_var, vars);
 }
 
 #ifdef UNIFICATOR_SELF_TEST
 // Slow unilateral unification
 
-template< typename SymType, typename LabType >
+template< typename SymType, typename LabType, typename IsVar >
 bool unify_slow_internal(const ParsingTree< SymType, LabType > &templ, const ParsingTree< SymType, LabType > &target,
-                    const std::function< bool(LabType) > &is_var, SubstMap< SymType, LabType > &subst) {
+                    const IsVar &is_var, SubstMap< SymType, LabType > &subst) {
     if (is_var(templ.label)) {
         assert(templ.children.empty());
         auto it = subst.find(templ.label);
@@ -325,9 +525,9 @@ bool unify_slow_internal(const ParsingTree< SymType, LabType > &templ, const Par
     }
 }
 
-template< typename SymType, typename LabType >
+template< typename SymType, typename LabType, typename IsVar >
 bool unify_slow(const ParsingTree< SymType, LabType > &templ, const ParsingTree< SymType, LabType > &target,
-           const std::function< bool(LabType) > &is_var, SubstMap< SymType, LabType > &subst) {
+           const IsVar &is_var, SubstMap< SymType, LabType > &subst) {
     bool ret = unify_slow_internal(templ, target, is_var, subst);
     if (ret) {
         assert(substitute(templ, is_var, subst) == target);
@@ -338,10 +538,10 @@ bool unify_slow(const ParsingTree< SymType, LabType > &templ, const ParsingTree<
 
 // Unilateral unification
 
-template< typename SymType, typename LabType >
+template< typename SymType, typename LabType, typename IsVar = std::function< bool(LabType) > >
 class UnilateralUnificator {
 public:
-    UnilateralUnificator(const std::function< bool(LabType) > &is_var) : failed(false), is_var(&is_var) {
+    UnilateralUnificator(const IsVar &is_var) : failed(false), is_var(&is_var) {
 #ifdef UNIFICATOR_SELF_TEST
         this->pt1.label = {};
         this->pt2.label = {};
@@ -445,7 +645,7 @@ private:
     }
 
     bool failed;
-    const std::function< bool(LabType) > *is_var;
+    const IsVar *is_var;
     SubstMap2< SymType, LabType > subst;
 
 #ifdef UNIFICATOR_SELF_TEST
@@ -454,12 +654,124 @@ private:
 #endif
 };
 
+/* Same as UnilateralUnificator, but the variables of the templates must all have a slot in
+ * the given VarSlots (as it happens for the hypotheses and the thesis of an assertion), and the
+ * substitution is kept in a FlatSubstMap2, so that the unificator can be cheaply copied to
+ * try alternatives. */
+template< typename SymType, typename LabType, typename IsVar = std::function< bool(LabType) > >
+class SlotUnilateralUnificator {
+public:
+    SlotUnilateralUnificator(const IsVar &is_var, const VarSlots< LabType > &slots) : failed(false), logging(false), is_var(&is_var), subst(slots) {
+    }
+
+    bool has_failed() const {
+        return this->failed;
+    }
+
+    bool is_unifiable() const {
+        return !this->failed;
+    }
+
+    // The map is empty if unification failed and no mark was taken
+    const FlatSubstMap2< SymType, LabType > &get_subst() const {
+        return this->subst;
+    }
+
+    std::pair< bool, SubstMap2< SymType, LabType > > unify2() const {
+        if (this->failed) {
+            return std::make_pair(false, SubstMap2< SymType, LabType >());
+        }
+        return std::make_pair(true, this->subst.to_subst_map());
+    }
+
+    // Same as BilateralUnificator::mark() and undo_to(): marks must be undone in reverse order
+    struct Mark {
+        bool failed;
+        size_t bound_num;
+    };
+
+    Mark mark() {
+        this->logging = true;
+        return Mark{ this->failed, this->subst.get_bound_num() };
+    }
+
+    void undo_to(const Mark &mark) {
+        assert(this->logging);
+        this->failed = mark.failed;
+        this->subst.unbind_to(mark.bound_num);
+    }
+
+    void add_parsing_trees2(const ParsingTree2< SymType, LabType > &pt1, const ParsingTree2< SymType, LabType > &pt2) {
+        if (this->failed) {
+            return;
+        }
+        bool res = this->process_tree(pt1.get_root(), pt2.get_root());
+        if (!res) {
+            this->fail();
+        }
+    }
+
+private:
+    void fail() {
+        this->failed = true;
+        // The bindings made before failing are kept if a mark can bring them back
+        if (!this->logging) {
+            this->subst.clear();
+        }
+    }
+
+    bool process_tree(ParsingTreeIterator< SymType, LabType > pt1, ParsingTreeIterator< SymType, LabType > pt2) {
+        const auto end1 = pt1.end();
+        const auto end2 = pt2.end();
+        const auto &slots = this->subst.get_slots();
+        while (true) {
+            if (pt1 == end1) {
+                return pt2 == end2;
+            }
+            if (pt2 == end2) {
+                return false;
+            }
+            const auto &n1 = pt1.get_node();
+            const auto &n2 = pt2.get_node();
+            if ((*this->is_var)(n1.label)) {
+                assert(n1.descendants_num == 0);
+                if (n1.type != n2.type) {
+                    return false;
+                }
+                size_t slot = slots.get_slot(n1.label);
+                assert(slot != slots.get_slots_num());
+                auto match = pt2.get_view();
+                if (!this->subst.is_bound(slot)) {
+                    this->subst.bind(slot, match);
+                } else {
+                    if (this->subst.get(slot) != match) {
+                        return false;
+                    }
+                }
+                ++pt1;
+                ++pt2;
+            } else {
+                if (n1.label != n2.label) {
+                    return false;
+                }
+                pt1.advance();
+                pt2.advance();
+            }
+        }
+    }
+
+    bool failed;
+    bool logging;
+    const IsVar *is_var;
+    FlatSubstMap2< SymType, LabType > subst;
+};
+
 #ifdef UNIFICATOR_SELF_TEST
 // Slow bilateral unification
 
-template< typename SymType, typename LabType >
+template< typename SymType, typename LabType, typename IsVar >
 std::tuple< bool, bool > unify2_slow_step(const ParsingTree< SymType, LabType > &pt1, const ParsingTree< SymType, LabType > &pt2,
-                                                   const std::function< bool(LabType) > &is_var, SubstMap< SymType, LabType > &subst) {
+                                                   const IsVar &is_var, SubstMap< SymType, LabType > &subst) {
     if (pt1.label == pt2.label) {
         assert(pt1.children.size() == pt2.children.size());
         for (size_t i = 0; i < pt1.children.size(); i++) {
@@ -486,9 +798,9 @@ std::tuple< bool, bool > unify2_slow_step(const ParsingTree< SymType, LabType >
     return std::make_pair(true, true);
 }
 
-template< typename SymType, typename LabType >
+template< typename SymType, typename LabType, typename IsVar >
 bool unify2_slow(const ParsingTree< SymType, LabType > &pt1, const ParsingTree< SymType, LabType > &pt2,
-                          const std::function< bool(LabType) > &is_var, SubstMap< SymType, LabType > &subst) {
+                          const IsVar &is_var, SubstMap< SymType, LabType > &subst) {
     // Algorithm described in Chang, Lee (Symbolic logic and mechanical theorem proving), section 5.4 Unification algorithm
     // It seems to be rather inefficient, but it is also simple, so it easier to trust; it can be used
     // to check that other implementations are correct
@@ -511,10 +823,10 @@ bool unify2_slow(const ParsingTree< SymType, LabType > &pt1, const ParsingTree<
 
 // Bilateral unification
 
-template< typename SymType, typename LabType >
+template< typename SymType, typename LabType, typename IsVar = std::function< bool(LabType) > >
 class BilateralUnificator {
 public:
-    BilateralUnificator(const std::function< bool(LabType) > &is_var) : failed(false), is_var(&is_var) {
+    BilateralUnificator(const IsVar &is_var) : failed(false), is_var(&is_var) {
 #ifdef UNIFICATOR_SELF_TEST
         this->pt1.label = {};
         this->pt2.label = {};
@@ -549,6 +861,48 @@ public:
         }
     }
 
+    /* Marks allow to explore alternatives without copying the unificator: once mark() has been
+     * called all changes are logged, and undo_to() brings the unificator back to the state it
+     * had when the mark was taken, in time proportional to the changes made since then. Marks
+     * must be undone in reverse order. */
+    struct Mark {
+        bool failed;
+        size_t subst_mark;
+        size_t djs_mark;
+        size_t cycle_mark;
+#ifdef UNIFICATOR_SELF_TEST
+        size_t pts_num;
+#endif
+    };
+
+    Mark mark() {
+        this->logging = true;
+        Mark ret;
+        ret.failed = this->failed;
+        ret.subst_mark = this->subst_log.size();
+        ret.djs_mark = this->djs.mark();
+        ret.cycle_mark = this->cycle_detector.mark();
+#ifdef UNIFICATOR_SELF_TEST
+        ret.pts_num = this->pt1.children.size();
+#endif
+        return ret;
+    }
+
+    void undo_to(const Mark &mark) {
+        assert(this->logging);
+        this->failed = mark.failed;
+        while (this->subst_log.size() > mark.subst_mark) {
+            this->subst.erase(this->subst_log.back());
+            this->subst_log.pop_back();
+        }
+        this->djs.undo_to(mark.djs_mark);
+        this->cycle_detector.undo_to(mark.cycle_mark);
+#ifdef UNIFICATOR_SELF_TEST
+        this->pt1.children.resize(mark.pts_num);
+        this->pt2.children.resize(mark.pts_num);
+#endif
+    }
+
     bool is_unifiable() {
         if (this->failed) {
             return false;
@@ -574,7 +928,7 @@ public:
 #ifdef UNIFICATOR_SELF_TEST
             assert(!res2);
 #endif
-            return std::make_pair(false, this->subst);
+            return std::make_pair(false, SubstMap2< SymType, LabType >());
         }
         //std::cerr << "Final graph has " << this->cycle_detector.get_node_num() << " nodes and " << this->cycle_detector.get_edge_num() << " edges (load factor: " << ((double) this->cycle_detector.get_edge_num()) / ((double) this->cycle_detector.get_node_num()) << ")" << std::endl;
         bool res;
@@ -585,7 +939,7 @@ public:
             assert(!res2);
 #endif
             this->fail();
-            return std::make_pair(false, this->subst);
+            return std::make_pair(false, SubstMap2< SymType, LabType >());
         }
         SubstMap2< SymType, LabType > actual_subst;
         for (const LabType &lab : topo_sort) {
@@ -605,11 +959,13 @@ public:
 
 private:
     void fail() {
-        // Once we have failed, there is not turning back: we can directly release resources
         this->failed = true;
-        this->subst.clear();
-        this->djs.clear();
-        this->cycle_detector.clear();
+        // Unless some mark can bring us back, there is not turning back: we can directly release resources
+        if (!this->logging) {
+            this->subst.clear();
+            this->djs.clear();
+            this->cycle_detector.clear();
+        }
     }
 
     bool process_tree(const ParsingTreeIterator< SymType, LabType > &pt1, const ParsingTreeIterator< SymType, LabType > &pt2) {
@@ -676,6 +1032,9 @@ private:
             std::tie(it, res) = this->subst.insert(std::make_pair(var, pt_temp));
             this->cycle_detector.make_node(var);
             if (res) {
+                if (this->logging) {
+                    this->subst_log.push_back(var);
+                }
                 std::set< LabType > vars;
                 collect_variables2(pt_temp, *this->is_var, vars);
                 for (const auto &var2 : vars) {
@@ -689,10 +1048,12 @@ private:
     }
 
     bool failed;
-    const std::function< bool(LabType) > *is_var;
+    const IsVar *is_var;
     SubstMap2< SymType, LabType > subst;
     DisjointSet< LabType > djs;
     NaiveIncrementalCycleDetector< LabType > cycle_detector;
+    bool logging = false;
+    std::vector< LabType > subst_log;
 
 #ifdef UNIFICATOR_SELF_TEST
     ParsingTree< SymType, LabType > pt1;
@@ -257,7 +257,7 @@ int subst_search_main(int argc, char *argv[]) {
             }
             const auto &rule = der2.second;
             bool has_vars = false;
-            for (const auto sym : rule) {
+            for (const auto &sym : rule) {
                 if (ders.find(sym) != ders.end()) {
                     has_vars = true;
                 }
@@ -267,7 +267,7 @@ int subst_search_main(int argc, char *argv[]) {
             }
 
             std::cout << std::endl << "Considering derivation " << tb.resolve_label(label) <<" for type " << tb.resolve_symbol(type) << ", with variables:";
-            for (const auto sym : rule) {
+            for (const auto &sym : rule) {
                 if (ders.find(sym) != ders.end()) {
                     std::cout << " " << tb.resolve_symbol(sym);
                 }
@@ -605,7 +605,7 @@ std::map< LabTok, std::tuple< LabTok, std::vector< LabTok >, std::vector< LabTok
             ParsingTree< SymTok, LabTok > pt_left;
             pt_left.type = type;
             pt_left.label = label;
-            for (const auto sym : rule) {
+            for (const auto &sym : rule) {
                 if (ders.find(sym) != ders.end()) {
                     auto temp_var = tb.new_temp_var(sym);
                     ParsingTree< SymTok, LabTok > pt_var;
@@ -724,11 +724,11 @@ std::map< LabTok, std::set< std::pair< size_t, size_t > > > compute_bound_vars(c
 
     // Insert bound variables data for labels without definition
     auto defless_labels = get_defless_labels(tb);
-    for (const auto label : defless_labels) {
+    for (const auto &label : defless_labels) {
         bound_vars[label] = {};
     }
     std::vector< LabTok > defless_bound = { tb.get_label("wal"), tb.get_label("cab") };
-    for (const auto label : defless_bound) {
+    for (const auto &label : defless_bound) {
         auto &pt = tb.get_parsed_sent(label);
         assert(pt.children.size() == 2);
         if (pt.children[0].type == tb.get_symbol("set")) {
@@ -803,7 +803,7 @@ ParsingTree< SymTok, LabTok > subst_defs(const ParsingTree< SymTok, LabTok > &pt
         for (size_t i = 0; i < vars.size(); i++) {
             subst_map[vars[i]] = pt.children[i];
         }
-        for (const auto var : fresh_vars) {
+        for (const auto &var : fresh_vars) {
             auto &new_var = subst_map[var];
             new_var.type = tb.get_var_lab_to_type_sym(var);
             new_var.label = tb.new_temp_var(new_var.type).first;
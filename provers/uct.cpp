@@ -226,7 +226,8 @@ VisitResult SentenceNode::visit()
             const Assertion &ass = tb.get_assertion(*this->ass_it);
             this->ass_it++;
             ParsingTree2< SymTok, LabTok > thesis = tb.get_parsed_sent2(ass.get_thesis());
-            UnilateralUnificator< SymTok, LabTok > unif(tb.get_standard_is_var());
+            const auto is_var = tb.get_standard_is_var_fast();
+            UnilateralUnificator< SymTok, LabTok, StandardIsVar > unif(is_var);
             unif.add_parsing_trees2(thesis, this->sentence);
             bool unifiable;
             SubstMap2< SymTok, LabTok > subst_map;
@@ -527,7 +528,7 @@ VisitResult StepNode::create_children()
     const Assertion &ass = tb.get_assertion(this->label);
     assert(ass.is_valid());
     for (auto hyp_tok : ass.get_ess_hyps()) {
-        auto subst_hyp = substitute2(tb.get_parsed_sent2(hyp_tok), tb.get_standard_is_var(), full_subst_map);
+        auto subst_hyp = substitute2(tb.get_parsed_sent2(hyp_tok), tb.get_standard_is_var_fast(), full_subst_map);
         VisitResult res = this->create_child(subst_hyp);
         assert(res != PROVED);
         if (res == DEAD) {
@@ -653,7 +654,7 @@ int uct_main(int argc, char *argv[]) {
             CreativeProofEngineImpl< Sentence > engine(tb, false);
             std::vector< std::function< void() > > children_cb;
             for (const auto &hyp : problem.second) {
-                LabTok hyp_lab = engine.create_new_hypothesis(tb.reconstruct_sentence(pt2_to_pt(hyp), tb.get_turnstile()));
+                LabTok hyp_lab = engine.create_new_hypothesis(tb.reconstruct_sentence(hyp, tb.get_turnstile()));
                 children_cb.emplace_back([hyp_lab,&engine]() {
                     engine.process_label(hyp_lab);
                 });
@@ -312,7 +312,7 @@ Var::Var(const std::string &string_repr, const LibraryToolbox &tb) :
 }
 
 Var::Var(const Var::NameType &name, const LibraryToolbox &tb) :
-    name(name), string_repr(tb.print_sentence(tb.reconstruct_sentence(pt2_to_pt(name))).to_string()) {
+    name(name), string_repr(tb.print_sentence(tb.reconstruct_sentence(name)).to_string()) {
 }
 
 std::string Var::to_string() const {
@@ -1226,6 +1226,54 @@ pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb
     }
 }
 
+pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb)
+{
+    const auto &node = pt.get_root().get_node();
+    assert(tb.resolve_symbol(node.type) == "wff");
+    std::vector< ParsingTree2< SymTok, LabTok > > children;
+    for (const auto &child : pt.get_root()) {
+        children.push_back(child.get_view());
+    }
+    if (node.label == tb.get_registered_prover_label(True::type_rp)) {
+        assert(children.size() == 0);
+        return True::create();
+    } else if (node.label == tb.get_registered_prover_label(False::type_rp)) {
+        assert(children.size() == 0);
+        return False::create();
+    } else if (node.label == tb.get_registered_prover_label(Not::type_rp)) {
+        assert(children.size() == 1);
+        return Not::create(wff_from_pt(children[0], tb));
+    } else if (node.label == tb.get_registered_prover_label(Imp::type_rp)) {
+        assert(children.size() == 2);
+        return Imp::create(wff_from_pt(children[0], tb), wff_from_pt(children[1], tb));
+    } else if (node.label == tb.get_registered_prover_label(Biimp::type_rp)) {
+        assert(children.size() == 2);
+        return Biimp::create(wff_from_pt(children[0], tb), wff_from_pt(children[1], tb));
+    } else if (node.label == tb.get_registered_prover_label(And::type_rp)) {
+        assert(children.size() == 2);
+        return And::create(wff_from_pt(children[0], tb), wff_from_pt(children[1], tb));
+    } else if (node.label == tb.get_registered_prover_label(Or::type_rp)) {
+        assert(children.size() == 2);
+        return Or::create(wff_from_pt(children[0], tb), wff_from_pt(children[1], tb));
+    } else if (node.label == tb.get_registered_prover_label(Nand::type_rp)) {
+        assert(children.size() == 2);
+        return Nand::create(wff_from_pt(children[0], tb), wff_from_pt(children[1], tb));
+    } else if (node.label == tb.get_registered_prover_label(Xor::type_rp)) {
+        assert(children.size() == 2);
+        return Xor::create(wff_from_pt(children[0], tb), wff_from_pt(children[1], tb));
+    } else if (node.label == tb.get_registered_prover_label(And3::type_rp)) {
+        assert(children.size() == 3);
+        return And3::create(wff_from_pt(children[0], tb), wff_from_pt(children[1], tb), wff_from_pt(children[2], tb));
+    } else if (node.label == tb.get_registered_prover_label(Or3::type_rp)) {
+        assert(children.size() == 3);
+        return Or3::create(wff_from_pt(children[0], tb), wff_from_pt(children[1], tb), wff_from_pt(children[2], tb));
+    } else {
+        auto var_pt = pt;
+        var_pt.refresh();
+        return Var::create(var_pt, tb);
+    }
+}
+
 pvar_set collect_tseitin_vars(const CNForm &cnf)
 {
     pvar_set ret;
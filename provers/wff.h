@@ -24,6 +24,7 @@ template< typename T >
 using pvar_map = std::map< pvar, T, pvar_comp >;
 
 pwff wff_from_pt(const ParsingTree< SymTok, LabTok > &pt, const LibraryToolbox &tb);
+pwff wff_from_pt(const ParsingTree2< SymTok, LabTok > &pt, const LibraryToolbox &tb);
 
 template< typename T >
 struct pvar_pair_comp {
@@ -95,6 +96,7 @@ private:
 
 class True : public Wff, public enable_create< True > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
     std::string to_string() const override;
     pwff imp_not_form() const override;
@@ -122,6 +124,7 @@ private:
 
 class False : public Wff, public enable_create< False > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
     std::string to_string() const override;
     pwff imp_not_form() const override;
@@ -149,6 +152,7 @@ private:
 
 class Var : public Wff, public enable_create< Var > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
   typedef ParsingTree2< SymTok, LabTok > NameType;
 
@@ -193,6 +197,7 @@ private:
 
 class Not : public Wff, public enable_create< Not > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
   std::string to_string() const override;
   pwff imp_not_form() const override;
@@ -228,6 +233,7 @@ private:
 
 class Imp : public Wff, public enable_create< Imp > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
   std::string to_string() const override;
   pwff imp_not_form() const override;
@@ -272,6 +278,7 @@ private:
 
 class Biimp : public ConvertibleWff, public enable_create< Biimp > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
   std::string to_string() const override;
   pwff imp_not_form() const override;
@@ -306,6 +313,7 @@ private:
 
 class And : public ConvertibleWff, public enable_create< And > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
   std::string to_string() const override;
   pwff imp_not_form() const override;
@@ -339,6 +347,7 @@ private:
 
 class Or : public ConvertibleWff, public enable_create< Or > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
   std::string to_string() const override;
   pwff imp_not_form() const override;
@@ -372,6 +381,7 @@ private:
 
 class Nand : public ConvertibleWff, public enable_create< Nand > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
   std::string to_string() const override;
   pwff imp_not_form() const override;
@@ -405,6 +415,7 @@ private:
 
 class Xor : public ConvertibleWff, public enable_create< Xor > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
   std::string to_string() const override;
   pwff imp_not_form() const override;
@@ -439,6 +450,7 @@ private:
 
 class And3 : public ConvertibleWff, public enable_create< And3 > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
     std::string to_string() const override;
     pwff imp_not_form() const override;
@@ -478,6 +490,7 @@ protected:
 
 class Or3 : public ConvertibleWff, public enable_create< Or3 > {
     friend pwff wff_from_pt(const ParsingTree<SymTok, LabTok> &pt, const LibraryToolbox &tb);
+    friend pwff wff_from_pt(const ParsingTree2<SymTok, LabTok> &pt, const LibraryToolbox &tb);
 public:
     std::string to_string() const override;
     pwff imp_not_form() const override;
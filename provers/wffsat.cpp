@@ -22,7 +22,7 @@ struct CNFCallbackImpl : public CNFCallbackTest {
             concl = Not::create(concl);
         }
         std::vector< pwff > orands;
-        for (const auto lit : context) {
+        for (const auto &lit : context) {
             pwff new_lit = this->atoms[lit.second];
             if (!lit.first) {
                 new_lit = Not::create(new_lit);
@@ -49,7 +49,7 @@ struct CNFCallbackImpl : public CNFCallbackTest {
         //CNFCallbackTest::prove_unit_res(clause, unsolved_idx, context);
         pwff loc_ctx = Not::create(this->clause_to_pwff(context));
         std::vector< pwff > orands;
-        for (const auto lit : clause) {
+        for (const auto &lit : clause) {
             pwff new_lit = this->atoms[lit.second];
             if (!lit.first) {
                 new_lit = Not::create(new_lit);
@@ -400,7 +400,7 @@ struct Z3Adapter {
 
     Prover< InspectableProofEngine< Sentence > > build_checked_prover(Prover< InspectableProofEngine< Sentence > > prover, pwff thesis) {
         pwff full_thesis = Imp::create(this->get_current_abs_hyps(), thesis);
-        auto sent = tb.reconstruct_sentence(pt2_to_pt(full_thesis->to_parsing_tree(this->tb)), this->tb.get_turnstile());
+        auto sent = tb.reconstruct_sentence(full_thesis->to_parsing_tree(this->tb), this->tb.get_turnstile());
         return checked_prover(prover, sent);
     }
 
@@ -16,10 +16,12 @@ export class StepManager {
   did_not_parse : boolean;
   found_proof : boolean;
   proof_data : any;
+  partial_results : any[];
   suggestion_ready : boolean;
 
   constructor() {
     this.sentence = [];
+    this.partial_results = [];
     this.suggestion_ready = false;
   }
 
@@ -33,11 +35,14 @@ export class StepManager {
       self.sentence = data.sentence;
       self.searching = data.searching;
       self.did_not_parse = data.did_not_parse;
-      if (!self.searching) {
-        self.found_proof = data.found_proof;
-        if (self.found_proof) {
-          self.proof_data = data.proof_data;
-        }
+      if (self.searching) {
+        self.partial_results = data.partial_results;
+      } else {
+        self.partial_results = [];
+      }
+      self.found_proof = data.found_proof;
+      if (self.found_proof) {
+        self.proof_data = data.proof_data;
       }
       return data;
     });
@@ -149,6 +154,13 @@ export class WorksetManager extends TreeManager implements NodePainter, WorksetE
     let full_id = this.editor_manager.compute_full_id(node);
     if (step.did_not_parse) {
       $(`#${full_id}_label`).html(Mustache.render(LABEL_DNP_TEMPL, {}));
+    } else if (step.searching && step.partial_results.length > 0 && step.partial_results[0].type == "unification") {
+      let partial = step.partial_results[0];
+      let label_params = {
+        label: workset.labels[partial.label],
+        results_num: step.partial_results.length,
+      };
+      $(`#${full_id}_label`).html(Mustache.render(LABEL_SEARCHING_PARTIAL_TEMPL, label_params));
     } else if (step.searching) {
       $(`#${full_id}_label`).html(Mustache.render(LABEL_SEARCHING_TEMPL, {}));
     } else if (!step.found_proof) {
@@ -483,6 +495,7 @@ const DATA1_TEMPL = `
 `;
 
 const LABEL_SEARCHING_TEMPL = `<span style="color: blue;">searching</span>`;
+const LABEL_SEARCHING_PARTIAL_TEMPL = `<span style="color: blue;">searching</span> <span class="strategy">Unif</span> {{ label }} ({{ results_num }} found)`;
 const LABEL_FAILED_TEMPL = `<span style="color: red;">failed</span>`;
 const LABEL_DNP_TEMPL = `<span style="color: red;">DNP</span>`;
 const LABEL_UNIFICATION_TEMPL = `<span class="strategy">Unif</span> {{ label }} <span class="r" style="color: {{ number_color }}">{{ number }}</span>`;
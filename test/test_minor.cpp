@@ -2,8 +2,18 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <sstream>
+
+#include <boost/filesystem/fstream.hpp>
 
 #include "mm/proof.h"
+#include "mm/reader.h"
+#include "mm/writer.h"
+#include "mm/proofstats.h"
+#include "mm/treeverifier.h"
+#include "mm/setmm.h"
+#include "utils/lrucache.h"
+#include "platform.h"
 #include "test.h"
 
 #ifdef ENABLE_TEST_CODE
@@ -69,4 +79,193 @@ BOOST_AUTO_TEST_CASE(test_has_no_diagonal) {
     BOOST_TEST(has_no_diagonal(x3.begin(), x3.end()));
 }
 
+BOOST_AUTO_TEST_CASE(test_lru_cache) {
+    // A single shard with room for three entries of unit cost
+    LRUCache< int, std::string > cache(3, [](const int&, const std::string&) { return size_t(1); }, 1);
+    std::string value;
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    BOOST_TEST(cache.get(1, value));
+    BOOST_TEST(value == "one");
+    // Now 2 is the least recently used entry
+    cache.put(4, "four");
+    BOOST_TEST(!cache.get(2, value));
+    BOOST_TEST(cache.get(3, value));
+    BOOST_TEST(cache.get(4, value));
+    cache.put(4, "FOUR");
+    BOOST_TEST(cache.get(4, value));
+    BOOST_TEST(value == "FOUR");
+    auto stats = cache.get_stats();
+    BOOST_TEST(stats.hits == 4);
+    BOOST_TEST(stats.misses == 1);
+    BOOST_TEST(stats.entries_num == 3);
+    BOOST_TEST(stats.size == 3);
+    cache.set_capacity(1);
+    BOOST_TEST(cache.get_stats().entries_num == 1);
+    BOOST_TEST(cache.get(4, value));
+}
+
+BOOST_AUTO_TEST_CASE(test_writer_roundtrip) {
+    auto filename = platform_get_resources_base() / "set.mm";
+    FileTokenizer ft(filename, nullptr, true);
+    Reader p(ft, false, true, true);
+    p.run();
+    std::ostringstream written;
+    Writer(p.get_library()).write(written);
+    boost::filesystem::ifstream fin(filename, std::ios_base::in | std::ios_base::binary);
+    std::ostringstream original;
+    original << fin.rdbuf();
+    BOOST_TEST((written.str() == original.str()));
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_proofs) {
+    auto filename = platform_get_resources_base() / "set.mm";
+    FileTokenizer ft(filename);
+    Reader p(ft, false, false);
+    p.run();
+    FileTokenizer ft_lazy(filename);
+    Reader p_lazy(ft_lazy, false, false, false, true);
+    p_lazy.run();
+    const auto &lib = p.get_library();
+    const auto &lib_lazy = p_lazy.get_library();
+    BOOST_TEST(lib.get_assertions().size() == lib_lazy.get_assertions().size());
+    for (size_t i = 0; i < lib.get_assertions().size(); i++) {
+        auto proof = std::dynamic_pointer_cast< const CompressedProof >(lib.get_assertions()[i].get_proof());
+        // Decoding without keeping must not prevent the proof from being decoded again later
+        auto proof_decoded = std::dynamic_pointer_cast< const CompressedProof >(lib_lazy.get_assertions()[i].decode_proof());
+        auto proof_lazy = std::dynamic_pointer_cast< const CompressedProof >(lib_lazy.get_assertions()[i].get_proof());
+        BOOST_TEST((proof == nullptr) == (proof_lazy == nullptr));
+        BOOST_TEST((proof == nullptr) == (proof_decoded == nullptr));
+        if (proof != nullptr && proof_lazy != nullptr && proof_decoded != nullptr) {
+            BOOST_TEST(proof->get_refs() == proof_lazy->get_refs());
+            BOOST_TEST(proof->get_codes() == proof_lazy->get_codes());
+            BOOST_TEST(proof->get_refs() == proof_decoded->get_refs());
+            BOOST_TEST(proof->get_codes() == proof_decoded->get_codes());
+        }
+    }
+}
+
+static void proof_stats_unwind_tree(const ProofTree< Sentence > &pt, const Assertion &ass, ProofStats &stats) {
+    stats.steps_num++;
+    if (pt.essential) {
+        stats.ess_steps_num++;
+        if (find(ass.get_ess_hyps().begin(), ass.get_ess_hyps().end(), pt.label) != ass.get_ess_hyps().end()) {
+            stats.ess_hyp_steps++;
+        }
+    }
+    for (const auto &child : pt.children) {
+        proof_stats_unwind_tree(child, ass, stats);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_proof_stats) {
+    FileTokenizer ft(platform_get_resources_base() / "set.mm");
+    Reader p(ft, false, false, false, true);
+    p.run();
+    const auto &lib = p.get_library();
+    for (const auto &x : compute_all_proof_stats(lib)) {
+        const Assertion &ass = lib.get_assertion(x.first);
+        // Uncompressed proofs are compressed before computing their statistics
+        std::shared_ptr< const Proof > proof = ass.get_proof();
+        if (dynamic_cast< const UncompressedProof* >(proof.get()) != nullptr) {
+            proof = std::make_shared< CompressedProof >(ass.get_proof_operator(lib)->compress());
+        }
+        auto exec = proof->get_executor< Sentence >(lib, ass, true);
+        exec->execute();
+        ProofStats tree_stats;
+        proof_stats_unwind_tree(exec->get_proof_tree(), ass, tree_stats);
+        BOOST_TEST(x.second.steps_num == tree_stats.steps_num);
+        BOOST_TEST(x.second.ess_steps_num == tree_stats.ess_steps_num);
+        BOOST_TEST(x.second.ess_hyp_steps == tree_stats.ess_hyp_steps);
+        try {
+            auto uncompressed = proof->get_operator(lib, ass)->uncompress();
+            BOOST_TEST(x.second.expanded_steps_num == uncompressed.get_labels().size());
+            auto uncompressed_stats = compute_proof_stats(lib, ass, uncompressed);
+            BOOST_TEST(x.second.expanded_ess_steps_num == uncompressed_stats.ess_steps_num);
+            BOOST_TEST(x.second.expanded_ess_hyp_steps == uncompressed_stats.ess_hyp_steps);
+            BOOST_TEST(x.second.depth == uncompressed_stats.depth);
+        } catch (const ProofException< Sentence >&) {
+            // The proof is too large to be uncompressed
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_tree_verifier) {
+    auto &data = get_set_mm();
+    TreeVerifier verifier(data.tb);
+    BOOST_TEST(verifier.verify_all().empty());
+
+    // Swapping the last two steps of a proof must make it fail
+    for (const auto &ass : data.lib.get_assertions()) {
+        if (ass.is_valid() && ass.is_theorem() && ass.get_ess_hyps().size() >= 2 && ass.get_proof() != nullptr) {
+            auto labels = ass.get_proof_operator(data.lib)->uncompress().get_labels();
+            std::swap(labels[labels.size()-1], labels[labels.size()-2]);
+            UncompressedProof proof(labels);
+            typedef ProofException< ParsingTree2< SymTok, LabTok > > TreeProofException;
+            BOOST_CHECK_THROW(verifier.verify(ass, proof), TreeProofException);
+            break;
+        }
+    }
+}
+
+
+// Forwards to another cache, but makes the parsing trees ill formed when loading
+class CorruptingToolboxCache : public ToolboxCache {
+public:
+    CorruptingToolboxCache(std::shared_ptr< ToolboxCache > inner, bool corrupt) : inner(inner), corrupt(corrupt) {}
+
+    bool load() override {
+        if (!this->inner->load()) {
+            return false;
+        }
+        this->data = this->inner->get_data();
+        this->nodes.assign(this->data.parsed_nodes, this->data.parsed_nodes + this->data.parsed_nodes_num);
+        for (size_t i = 0; this->corrupt && i < this->data.parsed_ranges_num; i += 2) {
+            // The first child of the first tree with children gets out of its parent
+            if (this->data.parsed_ranges[i+1] > 1) {
+                this->nodes[this->data.parsed_ranges[i]+1].descendants_num = static_cast< uint32_t >(this->data.parsed_ranges[i+1]);
+                break;
+            }
+        }
+        this->data.parsed_nodes = this->nodes.data();
+        return true;
+    }
+
+    bool store() override {
+        this->stores_num++;
+        return this->inner->store();
+    }
+
+    std::string get_digest() override { return this->inner->get_digest(); }
+    void set_digest(std::string digest) override { this->inner->set_digest(digest); }
+    const ToolboxCacheData &get_data() override { return this->data; }
+    void set_data(const ToolboxCacheData &data) override { this->inner->set_data(data); }
+
+    size_t stores_num = 0;
+
+private:
+    std::shared_ptr< ToolboxCache > inner;
+    bool corrupt;
+    ToolboxCacheData data;
+    std::vector< ParsingTreeNode< SymTok, LabTok > > nodes;
+};
+
+BOOST_AUTO_TEST_CASE(test_toolbox_cache_check) {
+    auto &data = get_set_mm();
+    auto cache_filename = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    LibraryToolbox tb(data.lib, "|-", std::make_shared< FileToolboxCache >(cache_filename));
+
+    // A good cache is used as it is, an ill formed one is a miss and is rebuilt
+    for (bool corrupt : { false, true }) {
+        auto cache = std::make_shared< CorruptingToolboxCache >(std::make_shared< FileToolboxCache >(cache_filename), corrupt);
+        LibraryToolbox tb2(data.lib, "|-", cache);
+        BOOST_TEST(cache->stores_num == (corrupt ? 1u : 0u));
+        for (LabTok label : tb.gen_labels()) {
+            BOOST_TEST((tb2.get_parsed_sent2(label) == tb.get_parsed_sent2(label)));
+        }
+    }
+    boost::filesystem::remove(cache_filename);
+}
+
 #endif
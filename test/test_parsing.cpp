@@ -1,9 +1,14 @@
 
 #include <iostream>
+#include <numeric>
+#include <algorithm>
 
 #include "mm/setmm.h"
 #include "parsing/earley.h"
 #include "parsing/lr.h"
+#include "parsing/discrtree.h"
+#include "parsing/termstore.h"
+#include "parsing/fingerprint.h"
 #include "test.h"
 
 #ifdef ENABLE_TEST_CODE
@@ -12,11 +17,15 @@ typedef ParsingTree<std::string, size_t> t1;
 typedef ParsingTree2<std::string, size_t> t2;
 typedef ParsingTree<char, size_t> t3;
 typedef ParsingTree2<char, size_t> t4;
+typedef ParsingTree<SymTok, LabTok> t5;
+typedef ParsingTree2<SymTok, LabTok> t6;
 
 BOOST_TEST_DONT_PRINT_LOG_VALUE(t1);
 BOOST_TEST_DONT_PRINT_LOG_VALUE(t2);
 BOOST_TEST_DONT_PRINT_LOG_VALUE(t3);
 BOOST_TEST_DONT_PRINT_LOG_VALUE(t4);
+BOOST_TEST_DONT_PRINT_LOG_VALUE(t5);
+BOOST_TEST_DONT_PRINT_LOG_VALUE(t6);
 
 template< typename SymType, typename LabType >
 void test_parsers(const std::vector<SymType> &sent, SymType type, const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector<SymType> > > > &derivations) {
@@ -44,6 +53,13 @@ void test_parsers(const std::vector<SymType> &sent, SymType type, const std::uno
     ParsingTree2< SymType, LabType > pt2_2 = pt_to_pt2(pt);
     BOOST_TEST(pt == lr_pt);
     BOOST_TEST(pt2 == pt2_2);
+
+    CompactParsingTree< SymType, LabType > cpt(pt2);
+    ParsingTree2< SymType, LabType > pt2_3 = cpt.expand([&ders_by_lab](LabType lab) { return ders_by_lab.at(lab).first; });
+    BOOST_TEST(pt2_3 == pt2);
+    for (size_t i = 0; i < pt2.get_nodes_len(); i++) {
+        BOOST_TEST(pt2_3.get_nodes()[i].type == pt2.get_nodes()[i].type);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(test_parsing1) {
@@ -115,6 +131,53 @@ BOOST_AUTO_TEST_CASE(test_parsing4) {
     test_parsers< char, size_t >(sent, 'S', derivations);
 }
 
+BOOST_AUTO_TEST_CASE(test_lr_reduction_order) {
+    /* A grammar where, after reading the first symbol, two reductions are available and
+     * one of them has no goto in the state below: the parser must go on with the other
+     * one in whichever order they are tried.
+     */
+    std::unordered_map<char, std::vector<std::pair< size_t, std::vector<char> > > > derivations;
+    derivations['T'].push_back(std::make_pair(1, std::vector< char >({ 'a' })));
+    derivations['T'].push_back(std::make_pair(2, std::vector< char >({ 'U', 'c' })));
+    derivations['U'].push_back(std::make_pair(3, std::vector< char >({ 'a' })));
+    const auto ders_by_lab = compute_derivations_by_label(derivations);
+    std::vector< char > sent = { 'a', 'c' };
+    LRParser< char, size_t > lr_parser(derivations);
+    lr_parser.initialize();
+    for (const auto &label_freqs : std::vector< std::unordered_map< size_t, size_t > >({ { { 1, 10 } }, { { 3, 10 } } })) {
+        lr_parser.sort_reductions(label_freqs);
+        auto pt = lr_parser.parse(sent, 'T');
+        BOOST_TEST(pt.label == 2);
+        BOOST_TEST(reconstruct_sentence(pt, derivations, ders_by_lab) == sent);
+        BOOST_TEST(lr_parser.parse(std::vector< char >({ 'a' }), 'T').label == 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_earley_nullable_ambiguous) {
+    /* A grammar with empty derivations, an ambiguous binary operator and a cycle, on
+     * which only the Earley parser can be used.
+     */
+    std::unordered_map<char, std::vector<std::pair< size_t, std::vector<char> > > > derivations;
+    derivations['S'].push_back(std::make_pair(1, std::vector< char >({ 'A', 'E', 'A' })));
+    derivations['A'].push_back(std::make_pair(2, std::vector< char >({})));
+    derivations['A'].push_back(std::make_pair(3, std::vector< char >({ 'a', 'A' })));
+    derivations['E'].push_back(std::make_pair(4, std::vector< char >({ 'E', '+', 'E' })));
+    derivations['E'].push_back(std::make_pair(5, std::vector< char >({ 'n' })));
+    derivations['E'].push_back(std::make_pair(6, std::vector< char >({ 'B', 'E', 'B' })));
+    derivations['B'].push_back(std::make_pair(7, std::vector< char >({})));
+    const auto ders_by_lab = compute_derivations_by_label(derivations);
+    EarleyParser< char, size_t > earley_parser(derivations);
+    for (const auto &sent : std::vector< std::vector< char > >({ { 'n' }, { 'a', 'n', '+', 'n', '+', 'n', 'a', 'a' }, { 'n', '+', 'n', '+', 'n', '+', 'n', '+', 'n', '+', 'n' } })) {
+        auto pt = earley_parser.parse(sent, 'S');
+        BOOST_TEST(pt.label != size_t{});
+        BOOST_TEST(reconstruct_sentence(pt, derivations, ders_by_lab) == sent);
+    }
+    for (const auto &sent : std::vector< std::vector< char > >({ {}, { 'a' }, { 'n', '+' }, { 'n', 'a', 'n' } })) {
+        auto pt = earley_parser.parse(sent, 'S');
+        BOOST_TEST(pt.label == size_t{});
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_lr_on_setmm) {
     //std::cout << "LR parsing on set.mm" << std::endl;
     auto &data = get_set_mm();
@@ -146,6 +209,46 @@ BOOST_AUTO_TEST_CASE(test_lr_on_setmm) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_parse_from_proofs_on_setmm) {
+    // The toolbox derives the parsing trees of theorems from their proofs; they must agree with the parser
+    auto &data = get_set_mm();
+    auto &lib = data.lib;
+    auto &tb = data.tb;
+    for (const Assertion &ass : lib.get_assertions()) {
+        if (!ass.is_valid() || !ass.is_theorem()) {
+            continue;
+        }
+        const Sentence &sent = lib.get_sentence(ass.get_thesis());
+        auto lr_pt = tb.parse_sentence(sent);
+        BOOST_TEST(lr_pt.label != LabTok{});
+        BOOST_TEST(tb.get_parsed_sent(ass.get_thesis()) == lr_pt);
+        BOOST_TEST(tb.get_parsed_sent2(ass.get_thesis()) == pt_to_pt2(lr_pt));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_parsing_on_setmm) {
+    auto &data = get_set_mm();
+    auto &lib = data.lib;
+    auto &tb = data.tb;
+    std::vector< LabTok > labels;
+    std::vector< std::pair< Sentence, SymTok > > sents;
+    for (const Assertion &ass : lib.get_assertions()) {
+        if (!ass.is_valid()) {
+            continue;
+        }
+        const Sentence &sent = lib.get_sentence(ass.get_thesis());
+        labels.push_back(ass.get_thesis());
+        sents.push_back(std::make_pair(Sentence(sent.begin()+1, sent.end()), lib.get_parsing_addendum().get_syntax().at(sent[0])));
+    }
+    size_t next_idx = 0;
+    tb.parse_sentences(sents, [&](size_t idx, const ParsingTree2< SymTok, LabTok > &pt) {
+        BOOST_TEST(idx == next_idx);
+        next_idx++;
+        BOOST_TEST(pt == tb.get_parsed_sent2(labels[idx]));
+    });
+    BOOST_TEST(next_idx == sents.size());
+}
+
 BOOST_AUTO_TEST_CASE(test_tree_unification) {
     auto &data = get_set_mm();
     auto &lib = data.lib;
@@ -186,6 +289,31 @@ BOOST_DATA_TEST_CASE(test_setmm_unification, boost::unit_test::data::make(setmm_
     Sentence sent = tb.read_sentence(str);
     auto res = tb.unify_assertion({}, sent, false, true);
     BOOST_TEST(res.empty() != positive);
+
+    // The streaming variant finds the same assertions, and stops when asked to
+    auto pt = tb.parse_sentence2(sent.begin()+1, sent.end(), tb.get_turnstile_alias());
+    if (pt.get_nodes_len() != 0) {
+        std::vector< LabTok > labels;
+        std::vector< LabTok > streamed_labels;
+        for (const auto &x : res) {
+            labels.push_back(std::get<0>(x));
+        }
+        bool complete = tb.unify_assertion_stream({}, std::make_pair(sent[0], pt), [&streamed_labels](const auto &x) {
+            streamed_labels.push_back(std::get<0>(x));
+            return true;
+        });
+        BOOST_TEST(complete);
+        std::sort(labels.begin(), labels.end());
+        std::sort(streamed_labels.begin(), streamed_labels.end());
+        BOOST_TEST(labels == streamed_labels);
+        size_t calls = 0;
+        complete = tb.unify_assertion_stream({}, std::make_pair(sent[0], pt), [&calls](const auto&) {
+            calls++;
+            return false;
+        });
+        BOOST_TEST(complete != positive);
+        BOOST_TEST(calls == (positive ? 1u : 0u));
+    }
     /*std::cout << "Trying to unify " << test << std::endl;
     std::cout << "Found " << res.size() << " matching assertions:" << std::endl;
     for (auto &match : res) {
@@ -201,6 +329,323 @@ BOOST_DATA_TEST_CASE(test_setmm_unification, boost::unit_test::data::make(setmm_
     }*/
 }
 
+/* The straightforward search of the unifying assertions, trying each permutation of the
+ * hypotheses in std::next_permutation order on each candidate returned by the theses index */
+static std::vector< std::tuple< LabTok, std::vector< size_t >, std::unordered_map< SymTok, Sentence > > > naive_unify_assertion(const LibraryToolbox &tb,
+                                                                                                                               const std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > &hyps,
+                                                                                                                               const std::pair< SymTok, ParsingTree2< SymTok, LabTok > > &thesis, bool up_to_hyps_perms) {
+    const auto &is_var = tb.get_standard_is_var();
+    std::vector< std::tuple< LabTok, std::vector< size_t >, std::unordered_map< SymTok, Sentence > > > ret;
+    auto candidates = tb.get_theses_index().retrieve(thesis.second);
+    std::sort(candidates.begin(), candidates.end());
+    for (const auto &label : candidates) {
+        const Assertion &ass = tb.get_assertion(label);
+        if (ass.is_usage_disc() || ass.get_ess_hyps().size() != hyps.size() || tb.get_sentence(label)[0] != thesis.first) {
+            continue;
+        }
+        std::vector< size_t > perm(hyps.size());
+        std::iota(perm.begin(), perm.end(), 0);
+        do {
+            UnilateralUnificator< SymTok, LabTok > unif(is_var);
+            unif.add_parsing_trees2(tb.get_parsed_sent2(label), thesis.second);
+            bool res = true;
+            for (size_t i = 0; i < hyps.size() && res; i++) {
+                const auto hyp = ass.get_ess_hyps()[perm[i]];
+                res = tb.get_sentence(hyp)[0] == hyps[i].first;
+                if (res) {
+                    unif.add_parsing_trees2(tb.get_parsed_sent2(hyp), hyps[i].second);
+                }
+            }
+            SubstMap2< SymTok, LabTok > subst;
+            if (res) {
+                std::tie(res, subst) = unif.unify2();
+            }
+            if (!res) {
+                continue;
+            }
+            std::unordered_map< SymTok, Sentence > subst2;
+            for (const auto &x : subst) {
+                subst2.insert(std::make_pair(tb.get_var_lab_to_sym(x.first), tb.reconstruct_sentence(pt2_to_pt(x.second))));
+            }
+            VectorMap< SymTok, Sentence > subst3(subst2.begin(), subst2.end());
+            auto dists = propagate_dists< Sentence >(ass, subst3, tb);
+            if (!has_no_diagonal(dists.begin(), dists.end())) {
+                continue;
+            }
+            ret.emplace_back(label, perm, subst2);
+            if (!up_to_hyps_perms) {
+                break;
+            }
+        } while (std::next_permutation(perm.begin(), perm.end()));
+    }
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(test_setmm_unification_perms) {
+    auto &data = get_set_mm();
+    auto &lib = data.lib;
+    auto &tb = data.tb;
+    size_t tested = 0;
+    for (const Assertion &ass : lib.get_assertions()) {
+        if (tested == 100) {
+            break;
+        }
+        if (!ass.is_valid() || ass.is_usage_disc() || ass.get_ess_hyps().size() < 2 || ass.get_ess_hyps().size() > 3) {
+            continue;
+        }
+        tested++;
+
+        // Pass the hypotheses of the assertion in reverse order
+        const auto query = make_unification_query(tb, ass, true);
+        const auto &hyps = query.hyps;
+        const auto &thesis = query.thesis;
+        auto res = tb.unify_assertion(hyps, thesis, false, true);
+
+        // The assertion itself is found, with the reversing permutation
+        std::vector< size_t > rev_perm(hyps.size());
+        for (size_t i = 0; i < hyps.size(); i++) {
+            rev_perm[i] = hyps.size() - 1 - i;
+        }
+        BOOST_TEST(std::any_of(res.begin(), res.end(), [&](const auto &x) { return std::get<0>(x) == ass.get_thesis() && std::get<1>(x) == rev_perm; }));
+
+        /* All the working permutations are found, in the same order; without up_to_hyps_perms
+         * only the first one for each assertion is returned */
+        auto expected = naive_unify_assertion(tb, hyps, thesis, true);
+        BOOST_TEST((res == expected));
+        BOOST_TEST((tb.unify_assertion(hyps, thesis, false, false) == naive_unify_assertion(tb, hyps, thesis, false)));
+        auto first = tb.unify_assertion(hyps, thesis, true, true);
+        BOOST_TEST(first.size() == 1u);
+        BOOST_TEST((first.empty() || first[0] == expected[0]));
+    }
+    BOOST_TEST(tested > 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_setmm_unification_threads) {
+    auto &data = get_set_mm();
+    auto &lib = data.lib;
+    auto &tb = data.tb;
+
+    // Pick the thesis with the most candidates, which must take the threaded path (at least 256 candidates)
+    const Assertion *best = nullptr;
+    size_t best_candidates = 0;
+    for (const Assertion &ass : lib.get_assertions()) {
+        if (!ass.is_valid() || lib.get_sentence(ass.get_thesis()).at(0) != tb.get_turnstile()) {
+            continue;
+        }
+        size_t candidates = tb.get_theses_index().retrieve(tb.get_parsed_sent2(ass.get_thesis())).size();
+        if (candidates > best_candidates) {
+            best = &ass;
+            best_candidates = candidates;
+        }
+    }
+    BOOST_REQUIRE(best_candidates >= 256u);
+
+    std::vector< Sentence > hyps;
+    for (auto it = best->get_ess_hyps().rbegin(); it != best->get_ess_hyps().rend(); ++it) {
+        hyps.push_back(lib.get_sentence(*it));
+    }
+    const Sentence &thesis = lib.get_sentence(best->get_thesis());
+    for (bool just_first : { false, true }) {
+        // Results are cached regardless of the number of threads, so the cache is cleared before each call
+        tb.clear_unification_cache();
+        auto serial = tb.unify_assertion(hyps, thesis, just_first, true, {}, 1);
+        tb.clear_unification_cache();
+        auto parallel = tb.unify_assertion(hyps, thesis, just_first, true, {}, 4);
+        BOOST_TEST(!serial.empty());
+        BOOST_TEST((serial == parallel));
+    }
+
+    // Queries spread across the library, most of which are too small to be split among threads
+    for (const auto &label : pick_unification_queries(tb, 50)) {
+        const auto query = make_unification_query(tb, tb.get_assertion(label), true);
+        for (bool just_first : { false, true }) {
+            tb.clear_unification_cache();
+            auto serial = tb.unify_assertion(query.hyps, query.thesis, just_first, true, {}, 1);
+            tb.clear_unification_cache();
+            auto parallel = tb.unify_assertion(query.hyps, query.thesis, just_first, true, {}, 4);
+            BOOST_TEST((serial == parallel));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_setmm_is_var) {
+    auto &data = get_set_mm();
+    auto &tb = data.tb;
+    const auto &is_var = tb.get_standard_is_var();
+    const auto is_var_fast = tb.get_standard_is_var_fast();
+    // The two predicates agree on all the labels of the library, and on temporary variables past them
+    for (size_t i = 1; i <= tb.get_labels_num() + 1; i++) {
+        const LabTok label(static_cast< LabTok::val_type >(i));
+        BOOST_TEST(is_var(label) == is_var_fast(label));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_setmm_theses_index) {
+    auto &data = get_set_mm();
+    auto &tb = data.tb;
+    const auto is_var = tb.get_standard_is_var_fast();
+    const auto queries = pick_unification_queries(tb, 20);
+    BOOST_REQUIRE(!queries.empty());
+    // The index returns all the theses that a linear scan of the library would find unifiable
+    for (const auto &query : queries) {
+        const auto &pt = tb.get_parsed_sent2(query);
+        std::set< LabTok > linear;
+        for (const Assertion &ass : tb.gen_assertions()) {
+            UnilateralUnificator< SymTok, LabTok, StandardIsVar > unif(is_var);
+            unif.add_parsing_trees2(tb.get_parsed_sent2(ass.get_thesis()), pt);
+            if (unif.is_unifiable()) {
+                linear.insert(ass.get_thesis());
+            }
+        }
+        std::set< LabTok > indexed;
+        for (const auto &cand : tb.get_theses_index().retrieve(pt)) {
+            UnilateralUnificator< SymTok, LabTok, StandardIsVar > unif(is_var);
+            unif.add_parsing_trees2(tb.get_parsed_sent2(cand), pt);
+            if (unif.is_unifiable()) {
+                indexed.insert(cand);
+            }
+        }
+        BOOST_TEST(linear.count(query) == 1u);
+        BOOST_TEST((linear == indexed));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_setmm_unification_stream) {
+    auto &data = get_set_mm();
+    auto &tb = data.tb;
+    const auto queries = pick_unification_queries(tb, 50, 1);
+    BOOST_REQUIRE(!queries.empty());
+    // The streaming search finds the same results as the complete one, possibly in a different order
+    for (const auto &label : queries) {
+        const auto query = make_unification_query(tb, tb.get_assertion(label), true);
+        std::vector< std::pair< LabTok, std::vector< size_t > > > streamed;
+        bool complete = tb.unify_assertion_stream(query.hyps, query.thesis, [&streamed](const auto &x) {
+            streamed.push_back(std::make_pair(std::get<0>(x), std::get<1>(x)));
+            return true;
+        });
+        BOOST_TEST(complete);
+        std::vector< std::pair< LabTok, std::vector< size_t > > > expected;
+        for (const auto &x : tb.unify_assertion(query.hyps, query.thesis, false, true)) {
+            expected.push_back(std::make_pair(std::get<0>(x), std::get<1>(x)));
+        }
+        BOOST_TEST(!expected.empty());
+        std::sort(streamed.begin(), streamed.end());
+        std::sort(expected.begin(), expected.end());
+        BOOST_TEST((streamed == expected));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_setmm_fingerprints) {
+    auto &data = get_set_mm();
+    auto &tb = data.tb;
+    const auto is_var = tb.get_standard_is_var_fast();
+    const auto queries = pick_unification_queries(tb, 20, 1);
+    BOOST_REQUIRE(!queries.empty());
+    // A fingerprint never rejects a hypothesis that unifies
+    size_t unifiable_num = 0;
+    for (const auto &label : queries) {
+        const Assertion &ass = tb.get_assertion(label);
+        for (const auto &cand : tb.get_theses_index().retrieve(tb.get_parsed_sent2(label))) {
+            const Assertion &cand_ass = tb.get_assertion(cand);
+            if (cand_ass.get_ess_hyps().size() != ass.get_ess_hyps().size()) {
+                continue;
+            }
+            for (const auto &hyp : ass.get_ess_hyps()) {
+                const auto hyp_fp = make_target_fingerprint(tb.get_parsed_sent2(hyp));
+                for (const auto &cand_hyp : cand_ass.get_ess_hyps()) {
+                    UnilateralUnificator< SymTok, LabTok, StandardIsVar > unif(is_var);
+                    unif.add_parsing_trees2(tb.get_parsed_sent2(cand_hyp), tb.get_parsed_sent2(hyp));
+                    if (unif.is_unifiable()) {
+                        unifiable_num++;
+                        BOOST_TEST(fingerprints_compatible(tb.get_fingerprint(cand_hyp), hyp_fp));
+                    }
+                }
+            }
+        }
+    }
+    BOOST_TEST(unifiable_num > 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_setmm_unification_cache) {
+    auto &data = get_set_mm();
+    auto &lib = data.lib;
+    auto &tb = data.tb;
+    size_t tested = 0;
+    for (const Assertion &ass : lib.get_assertions()) {
+        if (tested == 20) {
+            break;
+        }
+        if (!ass.is_valid() || ass.is_usage_disc() || ass.get_ess_hyps().empty()) {
+            continue;
+        }
+        const auto query = make_unification_query(tb, ass);
+        const auto &hyps = query.hyps;
+        const auto &thesis = query.thesis;
+        const auto vars = get_query_vars(tb, query);
+        if (vars.size() < 2) {
+            continue;
+        }
+        tested++;
+
+        tb.clear_unification_cache();
+        auto stats = tb.get_unification_cache_stats();
+        BOOST_TEST(stats.entries_num == 0u);
+        auto res = tb.unify_assertion(hyps, thesis, false, true);
+        auto new_stats = tb.get_unification_cache_stats();
+        BOOST_TEST(new_stats.misses == stats.misses + 1);
+        BOOST_TEST(new_stats.hits == stats.hits);
+        stats = new_stats;
+
+        // The same query on temporary variables is a hit, with the results renamed accordingly
+        tb.new_temp_var_frame();
+        std::unordered_map< SymTok, SymTok > sym_subst;
+        const auto renamed = rename_query_vars(tb, query, sym_subst);
+        auto expected = res;
+        rename_unification_results(expected, sym_subst);
+        auto renamed_res = tb.unify_assertion(renamed.hyps, renamed.thesis, false, true);
+        new_stats = tb.get_unification_cache_stats();
+        BOOST_TEST(new_stats.hits == stats.hits + 1);
+        BOOST_TEST(new_stats.misses == stats.misses);
+        BOOST_TEST((renamed_res == expected));
+        stats = new_stats;
+
+        // Antidistinct pairs on variables that do not appear in the query do not change the key
+        auto other1 = tb.new_temp_var(tb.get_var_lab_to_type_sym(vars[0]));
+        auto other2 = tb.new_temp_var(tb.get_var_lab_to_type_sym(vars[1]));
+        auto other_res = tb.unify_assertion(hyps, thesis, false, true, { std::make_pair(other1.second, other2.second) });
+        tb.release_temp_var_frame();
+        new_stats = tb.get_unification_cache_stats();
+        BOOST_TEST(new_stats.hits == stats.hits + 1);
+        BOOST_TEST(new_stats.misses == stats.misses);
+        BOOST_TEST((other_res == res));
+        stats = new_stats;
+
+        // Antidistinct pairs on variables of the query do
+        std::set< std::pair< SymTok, SymTok > > antidists = { std::make_pair(tb.get_var_lab_to_sym(vars[0]), tb.get_var_lab_to_sym(vars[1])) };
+        tb.unify_assertion(hyps, thesis, false, true, antidists);
+        new_stats = tb.get_unification_cache_stats();
+        BOOST_TEST(new_stats.misses == stats.misses + 1);
+        BOOST_TEST(new_stats.hits == stats.hits);
+        stats = new_stats;
+        tb.unify_assertion(hyps, thesis, false, true, antidists);
+        new_stats = tb.get_unification_cache_stats();
+        BOOST_TEST(new_stats.hits == stats.hits + 1);
+        BOOST_TEST(new_stats.misses == stats.misses);
+        stats = new_stats;
+
+        // Clearing the cache invalidates all the entries
+        BOOST_TEST(stats.entries_num == 2u);
+        tb.clear_unification_cache();
+        BOOST_TEST(tb.get_unification_cache_stats().entries_num == 0u);
+        auto cleared_res = tb.unify_assertion(hyps, thesis, false, true);
+        new_stats = tb.get_unification_cache_stats();
+        BOOST_TEST(new_stats.misses == stats.misses + 1);
+        BOOST_TEST(new_stats.hits == stats.hits);
+        BOOST_TEST((cleared_res == res));
+    }
+    BOOST_TEST(tested > 0u);
+}
+
 decltype(auto) get_unification_test_derivation() {
     std::unordered_map<char, std::vector<std::pair< size_t, std::vector<char> > > > derivations;
     derivations['S'].push_back(std::make_pair(100, std::vector< char >({ 'S', '+', 'P' })));
@@ -310,6 +755,41 @@ void test_unification_impl(const UnificationTest &sample) {
         std::tie(res, std::ignore) = unif.unify();
         BOOST_TEST(!res);
     }
+
+    // The slot based unificator must agree with the map based one
+    if (!bilateral) {
+        auto left_pt2 = pt_to_pt2(left_pt);
+        auto right_pt2 = pt_to_pt2(right_pt);
+        std::set< size_t > vars;
+        collect_variables2(left_pt2, is_var, vars);
+        VarSlots< size_t > slots(std::vector< size_t >(vars.begin(), vars.end()));
+        SlotUnilateralUnificator< char, size_t > slot_unif(is_var, slots);
+        slot_unif.add_parsing_trees2(left_pt2, right_pt2);
+        BOOST_TEST(slot_unif.is_unifiable() == sample.valid);
+        if (sample.valid) {
+            auto subst = slot_unif.unify2().second;
+            BOOST_TEST(subst == unif.unify2().second);
+            BOOST_TEST(substitute2(left_pt2, is_var, slot_unif.get_subst()) == right_pt2);
+            BOOST_TEST(update2(slot_unif.get_subst(), FlatSubstMap2< char, size_t >(slots)).to_subst_map() == subst);
+            BOOST_TEST(compose2(slot_unif.get_subst(), FlatSubstMap2< char, size_t >(slots), is_var).to_subst_map() == subst);
+        }
+    }
+
+    // Going back to a mark must leave no trace of what was done after it
+    if (bilateral) {
+        BilateralUnificator< char, size_t > trail_unif(is_var);
+        auto mark = trail_unif.mark();
+        trail_unif.add_parsing_trees(left_pt, right_pt);
+        trail_unif.add_parsing_trees(right_pt, left_pt);
+        trail_unif.undo_to(mark);
+        BOOST_TEST(trail_unif.is_unifiable());
+        BOOST_TEST(trail_unif.unify2().second.empty());
+        trail_unif.add_parsing_trees(left_pt, right_pt);
+        BOOST_TEST(trail_unif.is_unifiable() == sample.valid);
+        if (sample.valid) {
+            BOOST_TEST(trail_unif.unify().second == unif.unify().second);
+        }
+    }
 }
 
 BOOST_DATA_TEST_CASE(test_unification, boost::unit_test::data::make(unification_test_data)) {
@@ -320,4 +800,139 @@ BOOST_DATA_TEST_CASE(test_unification, boost::unit_test::data::make(unification_
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_unification_trail) {
+    // Labels 1 to 4 are variables, 10 is a binary constructor and 12 and 13 are constants
+    std::function< bool(size_t) > is_var = [](size_t x) { return x < 10; };
+    auto leaf = [](size_t label) {
+        return ParsingTree< char, size_t >{ label, 'T', {} };
+    };
+    auto bin = [](const ParsingTree< char, size_t > &x, const ParsingTree< char, size_t > &y) {
+        return ParsingTree< char, size_t >{ 10, 'T', { x, y } };
+    };
+    // Each reference unificator receives the equations that must survive the undos
+    auto check_subst = [&](BilateralUnificator< char, size_t > &unif, const std::vector< std::pair< ParsingTree< char, size_t >, ParsingTree< char, size_t > > > &eqs) {
+        BilateralUnificator< char, size_t > ref(is_var);
+        for (const auto &eq : eqs) {
+            ref.add_parsing_trees(eq.first, eq.second);
+        }
+        BOOST_TEST(unif.is_unifiable());
+        BOOST_TEST(unif.unify().second == ref.unify().second);
+    };
+
+    auto eq1 = std::make_pair(bin(leaf(1), leaf(12)), bin(leaf(13), leaf(2)));
+    auto eq2 = std::make_pair(leaf(3), leaf(4));
+    auto eq3 = std::make_pair(leaf(3), bin(leaf(4), leaf(12)));
+    auto conflict = std::make_pair(leaf(1), leaf(12));
+
+    BilateralUnificator< char, size_t > unif(is_var);
+    unif.add_parsing_trees(eq1.first, eq1.second);
+    auto mark1 = unif.mark();
+
+    // A conflicting equation is forgotten, and the earlier substitution is back
+    unif.add_parsing_trees(conflict.first, conflict.second);
+    BOOST_TEST(!unif.is_unifiable());
+    unif.undo_to(mark1);
+    check_subst(unif, { eq1 });
+
+    // Variables 3 and 4 are merged, so equating 3 to a term containing 4 creates a cycle
+    unif.add_parsing_trees(eq2.first, eq2.second);
+    auto mark2 = unif.mark();
+    unif.add_parsing_trees(eq3.first, eq3.second);
+    BOOST_TEST(!unif.is_unifiable());
+    unif.undo_to(mark2);
+    check_subst(unif, { eq1, eq2 });
+
+    // Going back to the outer mark, 3 and 4 are separate again and the same equation is acceptable
+    unif.add_parsing_trees(conflict.first, conflict.second);
+    BOOST_TEST(!unif.is_unifiable());
+    unif.undo_to(mark1);
+    check_subst(unif, { eq1 });
+    auto mark3 = unif.mark();
+    unif.add_parsing_trees(eq3.first, eq3.second);
+    check_subst(unif, { eq1, eq3 });
+
+    // Merging 3 and 4 again must record the substitution, as if they had never been merged
+    unif.undo_to(mark3);
+    unif.add_parsing_trees(eq2.first, eq2.second);
+    check_subst(unif, { eq1, eq2 });
+}
+
+/* Small trees for the indexing tests, given as their nodes in prefix order with the number of
+ * their descendants: labels 1 and 2 are variables, 10 is a binary constructor, 11 is unary and 12
+ * is a constant */
+static const std::function< bool(size_t) > is_tree_var = [](size_t x) { return x < 10; };
+
+static ParsingTree2< char, size_t > make_tree(const std::vector< std::pair< size_t, uint32_t > > &nodes) {
+    std::vector< ParsingTreeNode< char, size_t > > storage;
+    for (const auto &node : nodes) {
+        storage.push_back({ node.first, 'T', node.second });
+    }
+    return ParsingTree2< char, size_t >(std::move(storage), NULL, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_discrimination_tree) {
+    DiscriminationTree< char, size_t, int > index;
+    index.insert(make_tree({ { 10, 2 }, { 1, 0 }, { 2, 0 } }), is_tree_var, 1);
+    index.insert(make_tree({ { 10, 2 }, { 1, 0 }, { 1, 0 } }), is_tree_var, 2);
+    index.insert(make_tree({ { 10, 2 }, { 12, 0 }, { 1, 0 } }), is_tree_var, 3);
+    index.insert(make_tree({ { 11, 1 }, { 1, 0 } }), is_tree_var, 4);
+    index.insert(make_tree({ { 1, 0 } }), is_tree_var, 5);
+    BOOST_TEST(index.get_values_num() == 5u);
+
+    auto retrieve = [&index](const ParsingTree2< char, size_t > &pt) {
+        auto res = index.retrieve(pt);
+        return std::set< int >(res.begin(), res.end());
+    };
+    BOOST_TEST((retrieve(make_tree({ { 10, 3 }, { 11, 1 }, { 12, 0 }, { 12, 0 } })) == std::set< int >({ 1, 2, 5 })));
+    BOOST_TEST((retrieve(make_tree({ { 10, 2 }, { 12, 0 }, { 12, 0 } })) == std::set< int >({ 1, 2, 3, 5 })));
+    BOOST_TEST((retrieve(make_tree({ { 11, 1 }, { 12, 0 } })) == std::set< int >({ 4, 5 })));
+    BOOST_TEST((retrieve(make_tree({ { 12, 0 } })) == std::set< int >({ 5 })));
+}
+
+BOOST_AUTO_TEST_CASE(test_fingerprints) {
+    auto templ = make_fingerprint(make_tree({ { 10, 3 }, { 11, 1 }, { 1, 0 }, { 2, 0 } }), is_tree_var);
+    BOOST_TEST(templ.labels[0] == 10u);
+    BOOST_TEST(templ.labels[1] == 11u);
+    BOOST_TEST(templ.labels[2] == 0u);
+    BOOST_TEST(templ.labels[4] == 0u);
+    BOOST_TEST(fingerprints_compatible(templ, make_target_fingerprint(make_tree({ { 10, 4 }, { 11, 1 }, { 12, 0 }, { 11, 1 }, { 12, 0 } }))));
+    BOOST_TEST(!fingerprints_compatible(templ, make_target_fingerprint(make_tree({ { 10, 2 }, { 12, 0 }, { 12, 0 } }))));
+    BOOST_TEST(!fingerprints_compatible(templ, make_target_fingerprint(make_tree({ { 11, 1 }, { 12, 0 } }))));
+    BOOST_TEST(fingerprints_compatible(make_fingerprint(make_tree({ { 1, 0 } }), is_tree_var), make_target_fingerprint(make_tree({ { 11, 1 }, { 12, 0 } }))));
+}
+
+BOOST_AUTO_TEST_CASE(test_term_store) {
+    TermStore< char, size_t > store;
+    auto templ = make_tree({ { 10, 4 }, { 11, 1 }, { 1, 0 }, { 11, 1 }, { 1, 0 } });
+    auto target = make_tree({ { 10, 6 }, { 11, 2 }, { 11, 1 }, { 12, 0 }, { 11, 2 }, { 11, 1 }, { 12, 0 } });
+    auto templ_id = store.intern(templ);
+    auto target_id = store.intern(target);
+    // The two arguments of each tree are shared
+    BOOST_TEST(store.get_arg(templ_id, 0) == store.get_arg(templ_id, 1));
+    BOOST_TEST(store.get_arg(target_id, 0) == store.get_arg(target_id, 1));
+    BOOST_TEST(store.get_terms_num() == 7u);
+    BOOST_TEST(store.get_size(target_id) == target.get_nodes_len());
+    BOOST_TEST(store.extract(target_id) == target);
+    BOOST_TEST(store.intern(store.extract(templ_id)) == templ_id);
+
+    TermSubstMap< size_t > subst;
+    BOOST_TEST(unify_term(store, templ_id, target_id, is_tree_var, subst));
+    UnilateralUnificator< char, size_t > unif(is_tree_var);
+    unif.add_parsing_trees2(templ, target);
+    BOOST_TEST(term_subst_to_subst2(store, subst) == unif.unify2().second);
+    BOOST_TEST(substitute_term(store, templ_id, is_tree_var, subst) == target_id);
+    BOOST_TEST(store.extract(substitute_term(store, templ_id, is_tree_var, subst)) == substitute2(templ, is_tree_var, unif.unify2().second));
+
+    // The two occurrences of the variable cannot be matched with different subtrees
+    auto target2_id = store.intern(make_tree({ { 10, 4 }, { 11, 1 }, { 12, 0 }, { 11, 1 }, { 2, 0 } }));
+    TermSubstMap< size_t > subst2;
+    BOOST_TEST(!unify_term(store, templ_id, target2_id, is_tree_var, subst2));
+    BOOST_TEST(subst2.empty());
+
+    // A failed unification only removes the bindings it added itself
+    TermSubstMap< size_t > subst3 = { { 2, target_id } };
+    BOOST_TEST(!unify_term(store, templ_id, target2_id, [](size_t x) { return x < 10; }, subst3));
+    BOOST_TEST((subst3 == TermSubstMap< size_t >({ { 2, target_id } })));
+}
+
 #endif
@@ -207,6 +207,8 @@ std::vector< std::string > wff_from_pt_data = {
 
 typedef ParsingTree<SymTok, LabTok> t1;
 BOOST_TEST_DONT_PRINT_LOG_VALUE(t1);
+typedef ParsingTree2<SymTok, LabTok> t2;
+BOOST_TEST_DONT_PRINT_LOG_VALUE(t2);
 
 BOOST_DATA_TEST_CASE(test_wff_from_pt, boost::unit_test::data::make(wff_from_pt_data)) {
     auto &data = get_set_mm();
@@ -217,6 +219,10 @@ BOOST_DATA_TEST_CASE(test_wff_from_pt, boost::unit_test::data::make(wff_from_pt_
     auto pt = tb.parse_sentence(sent);
     auto parsed = wff_from_pt(pt, tb);
     BOOST_TEST(pt2_to_pt(parsed->to_parsing_tree(tb)) == pt);
+    auto pt2 = tb.parse_sentence2(sent.begin()+1, sent.end(), tb.get_turnstile_alias());
+    auto parsed2 = wff_from_pt(pt2, tb);
+    BOOST_TEST(parsed2->to_parsing_tree(tb) == pt2);
+    BOOST_TEST(tb.reconstruct_sentence(pt2, sent[0]) == sent);
 }
 
 #endif
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+struct LRUCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t entries_num;
+    size_t size;
+    size_t capacity;
+};
+
+/* A thread safe least recently used cache, bounded by the total cost of its entries
+ * (typically their approximate memory footprint) as computed by a user supplied
+ * function. To reduce contention the keys are distributed among independent shards,
+ * each one with its own lock and a fraction of the capacity. */
+template< typename Key, typename Value, typename Hash = std::hash< Key > >
+class LRUCache {
+public:
+    LRUCache(size_t capacity, const std::function< size_t(const Key&, const Value&) > &cost, size_t shards_num = 16) :
+        cost(cost), shards(shards_num), capacity(capacity), hits(0), misses(0) {
+        for (auto &shard : this->shards) {
+            shard = std::make_unique< Shard >();
+        }
+    }
+
+    bool get(const Key &key, Value &value) {
+        Shard &shard = this->get_shard(key);
+        std::unique_lock< std::mutex > lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            this->misses++;
+            return false;
+        }
+        // Move the entry to the front of the recency list
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        value = it->second->value;
+        this->hits++;
+        return true;
+    }
+
+    void put(const Key &key, const Value &value) {
+        size_t entry_cost = this->cost(key, value);
+        size_t shard_capacity = this->capacity / this->shards.size();
+        if (entry_cost > shard_capacity) {
+            return;
+        }
+        Shard &shard = this->get_shard(key);
+        std::unique_lock< std::mutex > lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.size -= it->second->cost;
+            shard.entries.erase(it->second);
+            shard.index.erase(it);
+        }
+        shard.entries.push_front({ key, value, entry_cost });
+        shard.index.insert(std::make_pair(key, shard.entries.begin()));
+        shard.size += entry_cost;
+        this->evict(shard, shard_capacity);
+    }
+
+    void clear() {
+        for (auto &shard : this->shards) {
+            std::unique_lock< std::mutex > lock(shard->mutex);
+            shard->index.clear();
+            shard->entries.clear();
+            shard->size = 0;
+        }
+    }
+
+    void set_capacity(size_t capacity) {
+        this->capacity = capacity;
+        for (auto &shard : this->shards) {
+            std::unique_lock< std::mutex > lock(shard->mutex);
+            this->evict(*shard, capacity / this->shards.size());
+        }
+    }
+
+    LRUCacheStats get_stats() const {
+        LRUCacheStats stats = { this->hits.load(), this->misses.load(), 0, 0, this->capacity.load() };
+        for (const auto &shard : this->shards) {
+            std::unique_lock< std::mutex > lock(shard->mutex);
+            stats.entries_num += shard->entries.size();
+            stats.size += shard->size;
+        }
+        return stats;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        Value value;
+        size_t cost;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list< Entry > entries;
+        std::unordered_map< Key, typename std::list< Entry >::iterator, Hash > index;
+        size_t size = 0;
+    };
+
+    Shard &get_shard(const Key &key) {
+        return *this->shards[Hash()(key) % this->shards.size()];
+    }
+
+    void evict(Shard &shard, size_t shard_capacity) {
+        while (shard.size > shard_capacity) {
+            const Entry &entry = shard.entries.back();
+            shard.size -= entry.cost;
+            shard.index.erase(entry.key);
+            shard.entries.pop_back();
+        }
+    }
+
+    const std::function< size_t(const Key&, const Value&) > cost;
+    std::vector< std::unique_ptr< Shard > > shards;
+    std::atomic< size_t > capacity;
+    std::atomic< uint64_t > hits;
+    std::atomic< uint64_t > misses;
+};
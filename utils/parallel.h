@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+// The number of threads to use when zero is requested
+inline size_t default_threads_num() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/* Call worker(thread_idx) on threads_num threads, the first of which is the calling thread,
+ * and wait for all of them. If some of them throw, the exception of the one with the lowest
+ * index is rethrown after all the threads have been joined. */
+template< typename Worker >
+void run_on_threads(size_t threads_num, const Worker &worker) {
+    threads_num = std::max(threads_num, size_t(1));
+    std::vector< std::exception_ptr > exceptions(threads_num);
+    auto wrapper = [&](size_t thread_idx) {
+        try {
+            worker(thread_idx);
+        } catch (...) {
+            exceptions[thread_idx] = std::current_exception();
+        }
+    };
+    std::vector< std::thread > threads;
+    for (size_t i = 1; i < threads_num; i++) {
+        threads.emplace_back(wrapper, i);
+    }
+    wrapper(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (const auto &exc : exceptions) {
+        if (exc) {
+            std::rethrow_exception(exc);
+        }
+    }
+}
+
+/* Call func(idx) for each idx from 0 to num-1 on threads_num threads (as many as the hardware
+ * supports when it is zero); indices are handed out in increasing order to whichever thread is
+ * free. After an exception no more indices are handed out, and the exception is rethrown once
+ * all the threads are finished.
+ *
+ * Invariant: by the time idx is handed out, every lower index has already been taken by a
+ * running thread. Therefore func(idx) may block waiting for the result of func(j) with j < idx
+ * (as long as func(j) does not in turn wait on idx), but it must never wait for a higher index,
+ * which might not be handed out until func(idx) returns; callers that depend on this should
+ * check it. */
+template< typename Function >
+void parallel_for(size_t num, size_t threads_num, const Function &func) {
+    if (threads_num == 0) {
+        threads_num = default_threads_num();
+    }
+    std::atomic< size_t > next_idx(0);
+    run_on_threads(std::min(threads_num, num), [&](size_t) {
+        try {
+            size_t idx;
+            while ((idx = next_idx++) < num) {
+                func(idx);
+            }
+        } catch (...) {
+            next_idx = num;
+            throw;
+        }
+    });
+}
@@ -92,15 +92,20 @@ nlohmann::json jsonize(Step &step)
         ret["children"].push_back(child.lock()->get_id());
     }
     ret["sentence"] = step.get_sentence();
-    ret["did_not_parse"] = step.get_parsing_tree().label == LabTok{};
+    ret["did_not_parse"] = !step.get_parsing_tree().quick_is_valid();
     bool searching = step.is_searching();
     ret["searching"] = searching;
-    if (!searching) {
-        auto result = step.get_result();
-        ret["found_proof"] = static_cast< bool >(result);
-        if (result) {
-            ret["proof_data"] = result->get_web_json();
+    if (searching) {
+        ret["partial_results"] = nlohmann::json::array();
+        for (const auto &result : step.get_partial_results()) {
+            ret["partial_results"].push_back(result->get_web_json());
         }
     }
+    // A strategy can report its result before it has finished searching
+    auto result = step.get_result();
+    ret["found_proof"] = static_cast< bool >(result);
+    if (result) {
+        ret["proof_data"] = result->get_web_json();
+    }
     return ret;
 }
@@ -93,12 +93,13 @@ void Step::restart_search()
     this->active_strategies.swap(old_strategies);
     old_strategies.clear();
     this->winning_strategy = nullptr;
+    this->partial_results.clear();
 
     // If any of this step or of its children does not parse, then do not call any strategy
     this->current_data = std::make_shared< StepStrategyData >();
     this->current_data->thesis = this->get_sentence();
     this->current_data->pt_thesis = this->get_parsing_tree();
-    if (this->current_data->pt_thesis.label == LabTok{}) {
+    if (!this->current_data->pt_thesis.quick_is_valid()) {
         this->maybe_notify_update();
         return;
     }
@@ -108,7 +109,7 @@ void Step::restart_search()
         auto strong_child = child.lock();
         this->current_data->hypotheses.push_back(strong_child->get_sentence());
         this->current_data->pt_hypotheses.push_back(strong_child->get_parsing_tree());
-        if (this->current_data->pt_hypotheses.back().label == LabTok{}) {
+        if (!this->current_data->pt_hypotheses.back().quick_is_valid()) {
             this->maybe_notify_update();
             return;
         }
@@ -179,6 +180,39 @@ void Step::report_result(std::shared_ptr<StepStrategy> strategy, std::shared_ptr
     }
 }
 
+void Step::report_partial_result(std::shared_ptr<StepStrategy> strategy, std::shared_ptr<StepStrategyResult> result)
+{
+    std::unique_lock< std::recursive_mutex > lock(this->global_mutex);
+    auto it = find_if(this->active_strategies.begin(), this->active_strategies.end(), [&strategy](const auto &x) { return x.first == strategy; });
+    if (it == this->active_strategies.end()) {
+        return;
+    }
+    this->partial_results.push_back(result);
+    this->maybe_notify_update();
+}
+
+void Step::report_early_result(std::shared_ptr<StepStrategy> strategy, std::shared_ptr<StepStrategyResult> result)
+{
+    std::unique_lock< std::recursive_mutex > lock(this->global_mutex);
+    auto it = find_if(this->active_strategies.begin(), this->active_strategies.end(), [&strategy](const auto &x) { return x.first == strategy; });
+    if (it == this->active_strategies.end()) {
+        return;
+    }
+    assert(result->get_success());
+#ifdef LOG_STEP_OPS
+    std::cerr << "Strategy reported early success for step with id " << this->id << std::endl;
+#endif
+    /* The reporting strategy is still running, so it is kept, while the others are stopped;
+     * as in restart_search(), they are first moved to a local list, so that a re-entering
+     * report_result() does not find them. */
+    std::list< std::pair< std::shared_ptr< StepStrategy >, std::shared_ptr< Coroutine > > > old_strategies;
+    this->active_strategies.swap(old_strategies);
+    this->active_strategies.splice(this->active_strategies.end(), old_strategies, it);
+    old_strategies.clear();
+    this->winning_strategy = result;
+    this->maybe_notify_update();
+}
+
 bool Step::reaches_by_parents(const Step &to)
 {
     std::vector< std::unique_lock< std::recursive_mutex > > locks;
@@ -218,7 +252,7 @@ const Sentence Step::get_sentence()
     return this->sentence;
 }
 
-const ParsingTree<SymTok, LabTok> Step::get_parsing_tree()
+const ParsingTree2<SymTok, LabTok> Step::get_parsing_tree()
 {
     std::unique_lock< std::recursive_mutex > lock(this->global_mutex);
     return this->parsing_tree;
@@ -227,7 +261,7 @@ const ParsingTree<SymTok, LabTok> Step::get_parsing_tree()
 bool Step::get_did_not_parse()
 {
     std::unique_lock< std::recursive_mutex > lock(this->global_mutex);
-    return this->parsing_tree.label != LabTok{};
+    return this->parsing_tree.quick_is_valid();
 }
 
 std::weak_ptr<Workset> Step::get_workset()
@@ -251,13 +285,12 @@ void Step::set_sentence(const Sentence &sentence)
         auto &tb = this->get_workset().lock()->get_toolbox();
         auto type_it = tb.get_parsing_addendum().get_syntax().find(sentence[0]);
         if (type_it != tb.get_parsing_addendum().get_syntax().end()) {
-            this->parsing_tree = tb.parse_sentence(sentence.begin()+1, sentence.end(), type_it->second);
+            this->parsing_tree = tb.parse_sentence2(sentence.begin()+1, sentence.end(), type_it->second);
         } else {
-            this->parsing_tree = tb.parse_sentence(sentence.begin()+1, sentence.end(), sentence[0]);
+            this->parsing_tree = tb.parse_sentence2(sentence.begin()+1, sentence.end(), sentence[0]);
         }
     } else {
         this->parsing_tree = {};
-        this->parsing_tree.label = {};
     }
     this->clean_listeners();
     this->after_new_sentence(old_sentence);
@@ -526,7 +559,7 @@ nlohmann::json Step::answer_api1(HTTPCallback &cb, std::vector< std::string >::c
                 collect_variables(hyp.second, toolbox.get_standard_is_var_sym(), vars);
                 ess_hyps.push_back(hyp.first);
             }
-            for (const auto var : vars) {
+            for (const auto &var : vars) {
                 float_hyps.push_back(toolbox.get_var_sym_to_lab(var));
             }
             // Sorting floating hypotheses by their label shoud give the expected order in the Assertion
@@ -606,6 +639,12 @@ std::shared_ptr<const StepStrategyResult> Step::get_result()
     return this->winning_strategy;
 }
 
+std::vector<std::shared_ptr<const StepStrategyResult> > Step::get_partial_results()
+{
+    std::unique_lock< std::recursive_mutex > lock(this->global_mutex);
+    return this->partial_results;
+}
+
 struct StepStrategyCallbackImpl final : public StepStrategyCallback {
     StepStrategyCallbackImpl(std::shared_ptr< Step > step, CreativeCheckpointedProofEngine< Sentence > &engine) : step(step), engine(engine) {}
 
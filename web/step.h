@@ -65,7 +65,7 @@ public:
     size_t get_id();
     const std::vector<SafeWeakPtr<Step> > &get_children();
     const Sentence get_sentence();
-    const ParsingTree<SymTok, LabTok> get_parsing_tree();
+    const ParsingTree2<SymTok, LabTok> get_parsing_tree();
     bool get_did_not_parse();
     std::weak_ptr<Workset> get_workset();
     void set_sentence(const Sentence &sentence);
@@ -74,6 +74,8 @@ public:
     bool orphan();
     bool reparent(std::shared_ptr< Step > parent, size_t idx);
     void report_result(std::shared_ptr< StepStrategy > strategy, std::shared_ptr< StepStrategyResult > result);
+    void report_partial_result(std::shared_ptr< StepStrategy > strategy, std::shared_ptr< StepStrategyResult > result);
+    void report_early_result(std::shared_ptr< StepStrategy > strategy, std::shared_ptr< StepStrategyResult > result);
     nlohmann::json answer_api1(HTTPCallback &cb, std::vector< std::string >::const_iterator path_begin, std::vector< std::string >::const_iterator path_end);
     nlohmann::json dump();
     void load_dump(const nlohmann::json &dump);
@@ -82,6 +84,7 @@ public:
     bool is_searching();
     bool found_proof();
     std::shared_ptr< const StepStrategyResult > get_result();
+    std::vector< std::shared_ptr< const StepStrategyResult > > get_partial_results();
     bool prove(CreativeCheckpointedProofEngine<Sentence> &engine);
     void workset_reload();
 
@@ -116,10 +119,11 @@ private:
     std::list< std::weak_ptr< StepOperationsListener > > listeners;
 
     Sentence sentence;
-    ParsingTree< SymTok, LabTok > parsing_tree;
+    ParsingTree2< SymTok, LabTok > parsing_tree;
 
     unsigned current_priority;
     std::shared_ptr< StepStrategyData > current_data;
     std::list< std::pair< std::shared_ptr< StepStrategy >, std::shared_ptr< Coroutine > > > active_strategies;
     std::shared_ptr< const StepStrategyResult > winning_strategy;
+    std::vector< std::shared_ptr< const StepStrategyResult > > partial_results;
 };
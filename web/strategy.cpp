@@ -19,6 +19,20 @@ void StepStrategy::maybe_report_result(std::shared_ptr< StepStrategy > strategy,
     }
 }
 
+void StepStrategy::maybe_report_partial_result(std::shared_ptr< StepStrategy > strategy, std::shared_ptr<StepStrategyResult> result) {
+    auto strong_manager = this->manager.lock();
+    if (strong_manager) {
+        strong_manager->report_partial_result(strategy, result);
+    }
+}
+
+void StepStrategy::maybe_report_early_result(std::shared_ptr< StepStrategy > strategy, std::shared_ptr<StepStrategyResult> result) {
+    auto strong_manager = this->manager.lock();
+    if (strong_manager) {
+        strong_manager->report_early_result(strategy, result);
+    }
+}
+
 class FailingStrategyResult : public StepStrategyResult, public enable_create< FailingStrategyResult > {
 protected:
     FailingStrategyResult() {}
@@ -99,6 +113,11 @@ struct UnificationStrategyResult : public StepStrategyResult, public enable_crea
     const LibraryToolbox &toolbox;
 };
 
+/* The search is stopped after this many matches or this much running time (not counting the time
+ * spent yielding to other coroutines), keeping what was found so far */
+static const size_t UNIFICATION_STRATEGY_MAX_RESULTS = 10;
+static const auto UNIFICATION_STRATEGY_TIME_BUDGET = std::chrono::seconds(2);
+
 void UnificationStrategy::operator()(Yielder &yield) {
     auto result = UnificationStrategyResult::create(this->toolbox);
     result->success = false;
@@ -110,16 +129,39 @@ void UnificationStrategy::operator()(Yielder &yield) {
     yield();
 
     auto pt_th = std::make_pair(this->data->thesis[0], this->data->pt_thesis);
-    std::vector< std::pair< SymTok, ParsingTree< SymTok, LabTok > > > pt_hyps;
+    std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > pt_hyps;
     for (size_t i = 0; i < this->data->pt_hypotheses.size(); i++) {
         pt_hyps.push_back(std::make_pair(this->data->hypotheses[i][0], this->data->pt_hypotheses[i]));
     }
 
-    auto res = this->toolbox.unify_assertion(pt_hyps, pt_th, true, true, this->data->antidists);
-    if (!res.empty()) {
-        result->success = true;
-        result->data = res[0];
-    }
+    /* Each match is sent to the client as soon as it is found; the first one, which comes
+     * from the smallest assertion, immediately becomes the winning result, while the search
+     * goes on for the others. The coroutine yields between candidates, so other strategies
+     * can run and a restarted search cancels this one. */
+    size_t results_num = 0;
+    auto running_time = std::chrono::steady_clock::duration::zero();
+    auto resumed = std::chrono::steady_clock::now();
+    this->toolbox.unify_assertion_stream(pt_hyps, pt_th, [&](const auto &res) {
+        auto partial = UnificationStrategyResult::create(this->toolbox);
+        partial->success = true;
+        partial->data = res;
+        this->maybe_report_partial_result(this->shared_from_this(), partial);
+        if (results_num == 0) {
+            result->success = true;
+            result->data = res;
+            this->maybe_report_early_result(this->shared_from_this(), result);
+        }
+        results_num++;
+        return results_num < UNIFICATION_STRATEGY_MAX_RESULTS;
+    }, true, this->data->antidists, [&]() {
+        running_time += std::chrono::steady_clock::now() - resumed;
+        if (running_time >= UNIFICATION_STRATEGY_TIME_BUDGET) {
+            return true;
+        }
+        yield();
+        resumed = std::chrono::steady_clock::now();
+        return false;
+    });
 }
 
 struct WffStrategyResult : public StepStrategyResult, public enable_create< WffStrategyResult > {
@@ -240,10 +282,7 @@ void UctStrategy::operator()(Yielder &yield)
         this->maybe_report_result(this->shared_from_this(), result);
     });
 
-    auto thesis = pt_to_pt2(this->data->pt_thesis);
-    auto hyps = vector_map(this->data->pt_hypotheses.begin(), this->data->pt_hypotheses.end(),
-                           [](const auto &x) { return pt_to_pt2(x); });
-    result->prover = UCTProver::create(this->toolbox, thesis, hyps, this->data->lab_antidists);
+    result->prover = UCTProver::create(this->toolbox, this->data->pt_thesis, this->data->pt_hypotheses, this->data->lab_antidists);
     result->visits_num = 0;
 
     yield();
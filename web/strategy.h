@@ -11,8 +11,8 @@
 struct StepStrategyData {
     Sentence thesis;
     std::vector< Sentence > hypotheses;
-    ParsingTree< SymTok, LabTok > pt_thesis;
-    std::vector< ParsingTree< SymTok, LabTok > > pt_hypotheses;
+    ParsingTree2< SymTok, LabTok > pt_thesis;
+    std::vector< ParsingTree2< SymTok, LabTok > > pt_hypotheses;
     std::set< std::pair< SymTok, SymTok > > antidists;
     std::set< std::pair< LabTok, LabTok > > lab_antidists;
 };
@@ -35,6 +35,11 @@ class StepStrategy;
 class StrategyManager {
 public:
     virtual void report_result(std::shared_ptr< StepStrategy > strategy, std::shared_ptr< StepStrategyResult > result) = 0;
+    // Successful results found while the strategy is still running, which can be shown before it finishes
+    virtual void report_partial_result(std::shared_ptr< StepStrategy > strategy, std::shared_ptr< StepStrategyResult > result) = 0;
+    /* A successful result that becomes the winning one immediately, while the strategy keeps
+     * running to report more partial results; the other strategies are stopped */
+    virtual void report_early_result(std::shared_ptr< StepStrategy > strategy, std::shared_ptr< StepStrategyResult > result) = 0;
 };
 
 class StepStrategy {
@@ -45,6 +50,8 @@ public:
 protected:
     StepStrategy(std::weak_ptr< StrategyManager > manager, std::shared_ptr< const StepStrategyData > data, const LibraryToolbox &toolbox);
     void maybe_report_result(std::shared_ptr<StepStrategy> strategy, std::shared_ptr< StepStrategyResult > result);
+    void maybe_report_partial_result(std::shared_ptr<StepStrategy> strategy, std::shared_ptr< StepStrategyResult > result);
+    void maybe_report_early_result(std::shared_ptr<StepStrategy> strategy, std::shared_ptr< StepStrategyResult > result);
 
     std::weak_ptr< StrategyManager > manager;
     std::shared_ptr< const StepStrategyData > data;
@@ -40,6 +40,18 @@ nlohmann::json Workset::get_stats()
     ret["running_coros"] = std::get<0>(ctm_stats);
     ret["queued_coros"] = std::get<1>(ctm_stats);
     ret["queued_timed_coros"] = std::get<2>(ctm_stats);
+    if (this->toolbox != nullptr) {
+        auto parse_cache_stats = this->toolbox->get_parse_cache_stats();
+        ret["parse_cache_hits"] = parse_cache_stats.hits;
+        ret["parse_cache_misses"] = parse_cache_stats.misses;
+        ret["parse_cache_entries"] = parse_cache_stats.entries_num;
+        ret["parse_cache_size"] = size_to_string(parse_cache_stats.size);
+        auto unification_cache_stats = this->toolbox->get_unification_cache_stats();
+        ret["unification_cache_hits"] = unification_cache_stats.hits;
+        ret["unification_cache_misses"] = unification_cache_stats.misses;
+        ret["unification_cache_entries"] = unification_cache_stats.entries_num;
+        ret["unification_cache_size"] = size_to_string(unification_cache_stats.size);
+    }
     return ret;
 }
 
@@ -119,6 +131,55 @@ nlohmann::json Workset::answer_api1(HTTPCallback &cb, std::vector< std::string >
         } catch (std::out_of_range&) {
             throw SendError(404);
         }
+    } else if (*path_begin == "parse_sentences") {
+        /* Parse many sentences at once, one per line, each beginning with its typecode; there
+         * is one result for each line, and lines without any symbol are marked as empty */
+        path_begin++;
+        assert_or_throw< SendError >(path_begin == path_end, 404);
+        assert_or_throw< SendError >(cb.get_method() == "POST", 405);
+        throw WaitForPost([this] (const auto &post_data) {
+            std::unique_lock< std::recursive_mutex > lock(this->global_mutex);
+            assert_or_throw< SendError >(this->toolbox != nullptr, 404);
+            const auto &tb = *this->toolbox;
+            std::string sents_str = safe_at(post_data, "sentences").value;
+            std::vector< std::string > lines;
+            boost::split(lines, sents_str, boost::is_any_of("\n"));
+            nlohmann::json ret = nlohmann::json::object();
+            ret["results"] = nlohmann::json::array();
+            std::vector< std::pair< Sentence, SymTok > > to_parse;
+            std::vector< size_t > results_idx;
+            for (const auto &line : lines) {
+                nlohmann::json res = nlohmann::json::object();
+                Sentence sent;
+                try {
+                    sent = tb.read_sentence(line);
+                } catch (const MMPPException &e) {
+                    res["error"] = e.get_reason();
+                }
+                if (sent.empty()) {
+                    if (res.find("error") == res.end()) {
+                        res["empty"] = true;
+                    }
+                } else {
+                    res["sentence"] = tok_to_int_vect(sent);
+                    auto type_it = tb.get_parsing_addendum().get_syntax().find(sent[0]);
+                    SymTok type = type_it != tb.get_parsing_addendum().get_syntax().end() ? type_it->second : sent[0];
+                    to_parse.push_back(std::make_pair(Sentence(sent.begin()+1, sent.end()), type));
+                    results_idx.push_back(ret["results"].size());
+                }
+                ret["results"].push_back(res);
+            }
+            tb.parse_sentences(to_parse, [&](size_t idx, const ParsingTree2< SymTok, LabTok > &pt) {
+                auto &res = ret["results"][results_idx[idx]];
+                res["did_not_parse"] = pt.get_nodes_len() == 0;
+                // The tree is sent as the list of its labels in preorder
+                res["tree"] = nlohmann::json::array();
+                for (size_t i = 0; i < pt.get_nodes_len(); i++) {
+                    res["tree"].push_back(pt.get_nodes()[i].label.val());
+                }
+            });
+            return ret;
+        });
     } else if (*path_begin == "destroy") {
         path_begin++;
         assert_or_throw< SendError >(path_begin == path_end, 404);
@@ -243,11 +304,11 @@ nlohmann::json Workset::answer_api1(HTTPCallback &cb, std::vector< std::string >
 void Workset::load_library(boost::filesystem::path filename, boost::filesystem::path cache_filename, std::string turnstile)
 {
     FileTokenizer ft(filename);
-    Reader p(ft, false, true);
+    Reader p(ft, false, true, false, true);
     p.run();
     this->library = std::make_unique< LibraryImpl >(p.get_library());
     std::shared_ptr< ToolboxCache > cache = std::make_shared< FileToolboxCache >(cache_filename);
-    this->toolbox = std::make_unique< LibraryToolbox >(*this->library, turnstile, cache);
+    this->toolbox = std::make_unique< LibraryToolbox >(*this->library, turnstile, cache, true);
 }
 
 const std::string &Workset::get_name()